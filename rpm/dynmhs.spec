@@ -49,6 +49,7 @@ can take advantage of multi-homing for redundancy and load balancing.
 %{_mandir}/man1/dynmhs.1.gz
 %dir %attr(0755, root, root) %{_sysconfdir}/dynmhs
 %config(noreplace) %{_sysconfdir}/dynmhs/dynmhs.conf
+%config(noreplace) %{_sysconfdir}/iproute2/rt_protos.d/dynmhs.conf
 %{_prefix}/lib/systemd/system/dynmhs.service
 
 
@@ -0,0 +1,130 @@
+// ==========================================================================
+//                    ____              __  __ _   _ ____
+//                   |  _ \ _   _ _ __ |  \/  | | | / ___|
+//                   | | | | | | | '_ \| |\/| | |_| \___ \
+//                   | |_| | |_| | | | | |  | |  _  |___) |
+//                   |____/ \__, |_| |_|_|  |_|_| |_|____/
+//                          |___/
+//
+//                ---  Dynamic Multi-Homing Setup (DynMHS)  ---
+//                     https://www.nntb.no/~dreibh/dynmhs/
+// ==========================================================================
+//
+// Dynamic Multi-Homing Setup (DynMHS)
+// Copyright (C) 2024-2026 by Thomas Dreibholz
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Contact: dreibh@simula.no
+
+#include "cgrouphook.h"
+#include "logger.h"
+
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/bpf.h>
+
+
+// ###### bpf() system call #################################################
+static int bpf(const int cmd, bpf_attr* attr)
+{
+   return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+
+// ###### Constructor #######################################################
+CGroupHook::CGroupHook()
+{
+   ProgramFD = -1;
+   LinkFD    = -1;
+}
+
+
+// ###### Destructor ########################################################
+CGroupHook::~CGroupHook()
+{
+   detach();
+}
+
+
+// ###### Attach hook to cgroup #############################################
+bool CGroupHook::attach(const std::string& cgroupPath, const uint32_t mark)
+{
+   detach();
+
+   // ====== Load the program ===============================================
+   /* r2 = mark
+    * *(u32*)(r1 + offsetof(struct bpf_sock, mark)) = r2
+    * r0 = 1   (allow the socket)
+    * exit */
+   const bpf_insn program[] = {
+      { BPF_ALU64 | BPF_MOV | BPF_K,   BPF_REG_2, 0,         0, (int32_t)mark },
+      { BPF_STX   | BPF_MEM | BPF_W,   BPF_REG_1, BPF_REG_2,
+        offsetof(bpf_sock, mark), 0 },
+      { BPF_ALU64 | BPF_MOV | BPF_K,   BPF_REG_0, 0,         0, 1 },
+      { BPF_JMP   | BPF_EXIT,          0,         0,         0, 0 }
+   };
+   static const char license[] = "GPL";
+   bpf_attr attr;
+   memset(&attr, 0, sizeof(attr));
+   attr.prog_type            = BPF_PROG_TYPE_CGROUP_SOCK;
+   attr.expected_attach_type = BPF_CGROUP_INET_SOCK_CREATE;
+   attr.insns                = (uint64_t)(uintptr_t)program;
+   attr.insn_cnt             = sizeof(program) / sizeof(program[0]);
+   attr.license              = (uint64_t)(uintptr_t)license;
+   ProgramFD = bpf(BPF_PROG_LOAD, &attr);
+   if(ProgramFD < 0) {
+      DMHS_LOG(error) << "Unable to load cgroup socket program: " << strerror(errno);
+      return false;
+   }
+
+   // ====== Attach the program to the cgroup by a BPF link =================
+   const int cgroupFD = open(cgroupPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+   if(cgroupFD < 0) {
+      DMHS_LOG(error) << "Unable to open cgroup " << cgroupPath << ": " << strerror(errno);
+      detach();
+      return false;
+   }
+   memset(&attr, 0, sizeof(attr));
+   attr.link_create.prog_fd     = ProgramFD;
+   attr.link_create.target_fd   = cgroupFD;
+   attr.link_create.attach_type = BPF_CGROUP_INET_SOCK_CREATE;
+   LinkFD = bpf(BPF_LINK_CREATE, &attr);
+   const int error = errno;
+   close(cgroupFD);
+   if(LinkFD < 0) {
+      DMHS_LOG(error) << "Unable to attach socket program to cgroup " << cgroupPath
+                      << ": " << strerror(error);
+      detach();
+      return false;
+   }
+   return true;
+}
+
+
+// ###### Detach hook from cgroup ###########################################
+void CGroupHook::detach()
+{
+   if(LinkFD >= 0) {
+      close(LinkFD);
+      LinkFD = -1;
+   }
+   if(ProgramFD >= 0) {
+      close(ProgramFD);
+      ProgramFD = -1;
+   }
+}
@@ -0,0 +1,58 @@
+// ==========================================================================
+//                    ____              __  __ _   _ ____
+//                   |  _ \ _   _ _ __ |  \/  | | | / ___|
+//                   | | | | | | | '_ \| |\/| | |_| \___ \
+//                   | |_| | |_| | | | | |  | |  _  |___) |
+//                   |____/ \__, |_| |_|_|  |_|_| |_|____/
+//                          |___/
+//
+//                ---  Dynamic Multi-Homing Setup (DynMHS)  ---
+//                     https://www.nntb.no/~dreibh/dynmhs/
+// ==========================================================================
+//
+// Dynamic Multi-Homing Setup (DynMHS)
+// Copyright (C) 2024-2026 by Thomas Dreibholz
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Contact: dreibh@simula.no
+
+#ifndef CGROUPHOOK_H
+#define CGROUPHOOK_H
+
+#include <cstdint>
+#include <string>
+
+
+// ###### eBPF socket hook of a cgroup ######################################
+/* The hook is a cgroup/sock program, which sets the mark of each socket
+ * created in the cgroup (or its descendants). The program is attached by a
+ * BPF link, so that the kernel detaches it when DynMHS exits, even after a
+ * crash. */
+class CGroupHook
+{
+   public:
+   CGroupHook();
+   ~CGroupHook();
+
+   bool attach(const std::string& cgroupPath, const uint32_t mark);
+   void detach();
+   inline bool isAttached() const { return LinkFD >= 0; }
+
+   private:
+   int ProgramFD;
+   int LinkFD;
+};
+
+#endif
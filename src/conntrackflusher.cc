@@ -0,0 +1,260 @@
+// ==========================================================================
+//                    ____              __  __ _   _ ____
+//                   |  _ \ _   _ _ __ |  \/  | | | / ___|
+//                   | | | | | | | '_ \| |\/| | |_| \___ \
+//                   | |_| | |_| | | | | |  | |  _  |___) |
+//                   |____/ \__, |_| |_|_|  |_|_| |_|____/
+//                          |___/
+//
+//                ---  Dynamic Multi-Homing Setup (DynMHS)  ---
+//                     https://www.nntb.no/~dreibh/dynmhs/
+// ==========================================================================
+//
+// Dynamic Multi-Homing Setup (DynMHS)
+// Copyright (C) 2024-2026 by Thomas Dreibholz
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Contact: dreibh@simula.no
+
+#include "conntrackflusher.h"
+#include "logger.h"
+
+#include <cstring>
+#include <sys/socket.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nfnetlink_conntrack.h>
+
+
+// Flags of CTA_FILTER_ORIG_FLAGS/CTA_FILTER_REPLY_FLAGS (not in the UAPI)
+#define CONNTRACK_FILTER_IP_SRC (1 << 0)
+#define CONNTRACK_FILTER_IP_DST (1 << 1)
+
+struct ConntrackRequest {
+   nlmsghdr Header;
+   nfgenmsg Message;
+};
+
+
+// ###### Constructor #######################################################
+ConntrackFlusher::ConntrackFlusher()
+{
+   KernelFilter = true;
+}
+
+
+// ###### Destructor ########################################################
+ConntrackFlusher::~ConntrackFlusher()
+{
+   close();
+}
+
+
+// ###### Open the ctnetlink socket #########################################
+bool ConntrackFlusher::open()
+{
+   return Netlink.open(NETLINK_NETFILTER);
+}
+
+
+// ###### Close the ctnetlink socket ########################################
+void ConntrackFlusher::close()
+{
+   Netlink.close();
+}
+
+
+// ###### Delete the conntrack entries using one of the addresses ###########
+unsigned int ConntrackFlusher::flush(const std::vector<Address>& addresses)
+{
+   static const uint8_t families[] = { AF_INET, AF_INET6 };
+   if( (!Netlink.isOpen()) || (addresses.empty()) ) {
+      return 0;
+   }
+
+   // ====== Find the entries using one of the addresses ====================
+   /* A local flow without NAT matches both filters of its address, i.e.
+    * the IDs of the entries found are kept to skip duplicates. */
+   std::set<uint32_t> ids;
+   std::vector<char>  requests;
+   for(const uint8_t family : families) {
+      bool complete = false;   // All entries of the family have been dumped
+      for(auto address = addresses.begin();
+          (!complete) && (address != addresses.end()); address++) {
+         if(address->Family != family) {
+            continue;
+         }
+         if(!KernelFilter) {
+            if(!dump(family, nullptr, false, addresses, ids, requests)) {
+               return 0;
+            }
+            complete = true;
+         }
+         else {
+            for(const bool reply : { false, true }) {
+               if(!dump(family, &(*address), reply, addresses, ids, requests)) {
+                  return 0;
+               }
+               if(!KernelFilter) {
+                  complete = true;   // The kernel has ignored the filter
+                  break;
+               }
+            }
+         }
+      }
+   }
+
+   // ====== Delete the entries =============================================
+   unsigned int entries = 0;
+   for(size_t offset = 0; offset < requests.size();
+       offset += NLMSG_ALIGN(((const nlmsghdr*)&requests[offset])->nlmsg_len)) {
+      entries++;
+   }
+   const bool deleted = Netlink.sendRequests(requests, "Conntrack deletion",
+                                             [](const int error) {
+      DMHS_LOG(debug) << "Conntrack deletion failed: " << strerror(error);
+      return true;
+   });
+   return (deleted) ? entries : 0;
+}
+
+
+// ###### Find an address within a tuple ####################################
+static const void* findTupleAddress(const nlattr*        tuple,
+                                    const unsigned short type,
+                                    const size_t         length)
+{
+   if(tuple != nullptr) {
+      const nlattr* ip = NetlinkSocket::findAttribute((const char*)tuple + NLA_HDRLEN,
+                                                      tuple->nla_len - NLA_HDRLEN, CTA_TUPLE_IP);
+      if(ip != nullptr) {
+         return NetlinkSocket::getPayload(
+                   NetlinkSocket::findAttribute((const char*)ip + NLA_HDRLEN,
+                                                ip->nla_len - NLA_HDRLEN, type),
+                   length);
+      }
+   }
+   return nullptr;
+}
+
+
+// ###### Check whether an address is one of the addresses ##################
+static bool matchesAddress(const uint8_t                                  family,
+                           const void*                                    address,
+                           const std::vector<ConntrackFlusher::Address>& addresses)
+{
+   if(address != nullptr) {
+      const size_t length = (family == AF_INET6) ? 16 : 4;
+      for(const ConntrackFlusher::Address& candidate : addresses) {
+         if( (candidate.Family == family) &&
+             (memcmp(address, &candidate.Address, length) == 0) ) {
+            return true;
+         }
+      }
+   }
+   return false;
+}
+
+
+// ###### Dump the conntrack entries and collect the delete requests ########
+/* With a filter address, the kernel only dumps the entries with it as
+ * original source, or as reply destination. Without filter, it dumps all
+ * entries of the family. The delete requests identify an entry by its
+ * original tuple and zone; its ID ensures that a new entry with the same
+ * tuple is not deleted. */
+bool ConntrackFlusher::dump(const uint8_t               family,
+                            const Address*              filter,
+                            const bool                  reply,
+                            const std::vector<Address>& addresses,
+                            std::set<uint32_t>&         ids,
+                            std::vector<char>&          requests)
+{
+   const unsigned short sourceType      = (family == AF_INET6) ? CTA_IP_V6_SRC : CTA_IP_V4_SRC;
+   const unsigned short destinationType = (family == AF_INET6) ? CTA_IP_V6_DST : CTA_IP_V4_DST;
+   const size_t         addressLength   = (family == AF_INET6) ? 16 : 4;
+
+   // ====== Build the dump request =========================================
+   ConntrackRequest header;
+   memset(&header, 0, sizeof(header));
+   header.Header.nlmsg_type    = (NFNL_SUBSYS_CTNETLINK << 8) | IPCTNL_MSG_CT_GET;
+   header.Header.nlmsg_flags   = NLM_F_REQUEST | NLM_F_DUMP;
+   header.Message.nfgen_family = family;
+   header.Message.version      = NFNETLINK_V0;
+   std::vector<char> request((const char*)&header, (const char*)&header + sizeof(header));
+   if(filter != nullptr) {
+      const size_t tuple = request.size();
+      NetlinkSocket::appendAttribute(request, NLA_F_NESTED | ((reply) ? CTA_TUPLE_REPLY : CTA_TUPLE_ORIG),
+                                     nullptr, 0);
+      const size_t ip    = request.size();
+      NetlinkSocket::appendAttribute(request, NLA_F_NESTED | CTA_TUPLE_IP, nullptr, 0);
+      NetlinkSocket::appendAttribute(request, (reply) ? destinationType : sourceType,
+                                     &filter->Address, addressLength);
+      ((nlattr*)&request[ip])->nla_len    = request.size() - ip;
+      ((nlattr*)&request[tuple])->nla_len = request.size() - tuple;
+
+      const size_t   nested = request.size();
+      const uint32_t flags  = (reply) ? CONNTRACK_FILTER_IP_DST : CONNTRACK_FILTER_IP_SRC;
+      NetlinkSocket::appendAttribute(request, NLA_F_NESTED | CTA_FILTER, nullptr, 0);
+      NetlinkSocket::appendAttribute(request, (reply) ? CTA_FILTER_REPLY_FLAGS : CTA_FILTER_ORIG_FLAGS,
+                                     &flags, sizeof(flags));
+      ((nlattr*)&request[nested])->nla_len = request.size() - nested;
+   }
+   ((nlmsghdr*)request.data())->nlmsg_len = request.size();
+
+   // ====== Find the entries using one of the addresses ====================
+   bool ignored = false;
+   const bool dumped = Netlink.query((nlmsghdr*)request.data(), "Conntrack dump",
+                                     [&](const nlmsghdr* message) {
+      if(message->nlmsg_len < NLMSG_LENGTH(sizeof(nfgenmsg))) {
+         return;
+      }
+      const char*   data          = (const char*)NLMSG_DATA(message) + NLMSG_ALIGN(sizeof(nfgenmsg));
+      const int     dataLength    = message->nlmsg_len - NLMSG_LENGTH(NLMSG_ALIGN(sizeof(nfgenmsg)));
+      const nlattr* originalTuple = NetlinkSocket::findAttribute(data, dataLength, CTA_TUPLE_ORIG);
+      const nlattr* replyTuple    = NetlinkSocket::findAttribute(data, dataLength, CTA_TUPLE_REPLY);
+      const void*   source        = findTupleAddress(originalTuple, sourceType, addressLength);
+      const void*   destination   = findTupleAddress(replyTuple, destinationType, addressLength);
+      if(filter != nullptr) {
+         const void* filtered = (reply) ? destination : source;
+         if( (filtered == nullptr) ||
+             (memcmp(filtered, &filter->Address, addressLength) != 0) ) {
+            ignored = true;
+         }
+      }
+      if( (originalTuple == nullptr) ||
+          ( (!matchesAddress(family, source, addresses)) &&
+            (!matchesAddress(family, destination, addresses)) ) ) {
+         return;
+      }
+      const nlattr*   idAttribute = NetlinkSocket::findAttribute(data, dataLength, CTA_ID);
+      const uint32_t* id          = (const uint32_t*)NetlinkSocket::getPayload(idAttribute, sizeof(uint32_t));
+      if( (id != nullptr) && (!ids.insert(*id).second) ) {
+         return;   // Already found by the other filter
+      }
+      const size_t offset = requests.size();
+      requests.insert(requests.end(), (const char*)&header, (const char*)&header + sizeof(header));
+      NetlinkSocket::appendAttribute(requests, originalTuple);
+      NetlinkSocket::appendAttribute(requests, NetlinkSocket::findAttribute(data, dataLength, CTA_ZONE));
+      NetlinkSocket::appendAttribute(requests, idAttribute);
+      nlmsghdr* deleteRequest = (nlmsghdr*)&requests[offset];
+      deleteRequest->nlmsg_len   = requests.size() - offset;
+      deleteRequest->nlmsg_type  = (NFNL_SUBSYS_CTNETLINK << 8) | IPCTNL_MSG_CT_DELETE;
+      deleteRequest->nlmsg_flags = NLM_F_REQUEST;
+   });
+   if( (dumped) && (ignored) ) {
+      DMHS_LOG(info) << "The kernel does not filter conntrack dumps (CTA_FILTER), using unfiltered dumps";
+      KernelFilter = false;
+   }
+   return dumped;
+}
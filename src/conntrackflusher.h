@@ -0,0 +1,76 @@
+// ==========================================================================
+//                    ____              __  __ _   _ ____
+//                   |  _ \ _   _ _ __ |  \/  | | | / ___|
+//                   | | | | | | | '_ \| |\/| | |_| \___ \
+//                   | |_| | |_| | | | | |  | |  _  |___) |
+//                   |____/ \__, |_| |_|_|  |_|_| |_|____/
+//                          |___/
+//
+//                ---  Dynamic Multi-Homing Setup (DynMHS)  ---
+//                     https://www.nntb.no/~dreibh/dynmhs/
+// ==========================================================================
+//
+// Dynamic Multi-Homing Setup (DynMHS)
+// Copyright (C) 2024-2026 by Thomas Dreibholz
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Contact: dreibh@simula.no
+
+#ifndef CONNTRACKFLUSHER_H
+#define CONNTRACKFLUSHER_H
+
+#include "netlinksocket.h"
+#include "socketdestroyer.h"
+
+#include <cstdint>
+#include <set>
+#include <vector>
+
+
+// ###### Flusher of conntrack entries using an address #####################
+/* An entry matches if the original source or the reply destination is one
+ * of the addresses, i.e. for local flows as well as for flows NATed to the
+ * address. The entries are found by ctnetlink dumps, filtered by the kernel
+ * (CTA_FILTER, Linux 5.10+): one for the original source and one for the
+ * reply destination of each address. A kernel without CTA_FILTER ignores
+ * the filter; then, one unfiltered dump per address family is made. All
+ * matching entries are deleted by requests sent in batches. */
+class ConntrackFlusher
+{
+   public:
+   typedef SocketDestroyer::Address Address;
+
+   ConntrackFlusher();
+   ~ConntrackFlusher();
+
+   bool open();
+   void close();
+   inline bool isOpen() const { return Netlink.isOpen(); }
+
+   unsigned int flush(const std::vector<Address>& addresses);
+
+   private:
+   bool dump(const uint8_t               family,
+             const Address*              filter,
+             const bool                  reply,
+             const std::vector<Address>& addresses,
+             std::set<uint32_t>&         ids,
+             std::vector<char>&          requests);
+
+   NetlinkSocket Netlink;
+   bool          KernelFilter;
+};
+
+#endif
@@ -28,13 +28,17 @@
 //
 // Contact: dreibh@simula.no
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <map>
 #include <queue>
+#include <set>
 #include <vector>
 #include <boost/algorithm/string.hpp>
 #include <boost/asio/ip/address.hpp>
@@ -44,27 +48,154 @@
 #include <sys/signalfd.h>
 #include <linux/rtnetlink.h>
 #include <linux/fib_rules.h>
+#include <linux/if.h>
+#include <linux/if_link.h>
+#include <linux/nexthop.h>
+#include <linux/mptcp.h>
 
 #include "assure.h"
+#include "cgrouphook.h"
+#include "conntrackflusher.h"
+#include "journal.h"
 #include "logger.h"
+#include "mptcppathmanager.h"
 #include "package-version.h"
+#include "prefixtrie.h"
+#include "prober.h"
+#include "socketdestroyer.h"
+#include "timerwheel.h"
 
 
 
-#define NETLINK_TIMEOUT 5000   // 5000 ms
+#define NETLINK_TIMEOUT      5000    // 5000 ms
+#define NETLINK_BUFFER       65536   // 64 KiB
+#define NETLINK_BATCH_SIZE   32768   // 32 KiB, below the socket send buffer size
+#define NETLINK_DUMP_RETRIES 5       // Retries of an interrupted dump
+#define NETLINK_DUMP_BACKOFF 10      // 10 ms, doubled for each retry
+#define NETLINK_EVENT_BATCH  4096    // Events per batch
+
+#define DYNMHS_PROTOCOL   213   // Protocol ID "dynmhs" in rt_protos
+#define RUNTIME_DIRECTORY "/run/dynmhs"
+#define OWNED_TABLES_FILE RUNTIME_DIRECTORY "/owned-tables"
+#define JOURNAL_FILE      RUNTIME_DIRECTORY "/journal"
+#define VRF_NAME_PREFIX   "dmhs"   // VRF devices are named "dmhs<table>"
+#define FWMARKS_FILE      RUNTIME_DIRECTORY "/fwmarks"
+#define FWMARKS_NFT_FILE  RUNTIME_DIRECTORY "/fwmarks.nft"
+#define HEALTH_FILE       RUNTIME_DIRECTORY "/health"
+#define CGROUP_ROOT       "/sys/fs/cgroup"
+#define NEXTHOP_ID_BASE   ((uint32_t)Protocol << 24)   // Owned nexthop IDs, per protocol ID
+#define NEXTHOP_ID_LAST   (NEXTHOP_ID_BASE | 0x00ffffff)
+
+#define MULTIPATH_HOLD_TIME  10     // 10 s between two weight changes
+#define MULTIPATH_MIN_CHANGE 0.25   // Relative weight change to apply
+#define MULTIPATH_MIN_RTT    1.0    // 1 ms, lower RTTs are not distinguished
+#define UTILISATION_SMOOTHING 0.5   // Weight of the latest utilisation sample
+
+#define INFINITE_LIFETIME 0xffffffff   // Lifetime of an address without expiry
 
 enum DynMHSOperatingMode {
    Undefined   = 0,
    Reset       = 1,
    Operational = 2
 };
+enum EventClass {
+   EC_Link     = 0,   // Carrier changes first, since they trigger the failover
+   EC_Address  = 1,
+   EC_Rule     = 2,
+   EC_Nexthop  = 3,   // Before the routes referencing the nexthop objects
+   EC_Route    = 4,
+   EC_Classes  = 5
+};
+enum RulePriorityClass {
+   RPC_UIDRange = 0,   // uidrange rules
+   RPC_FwMark   = 1,   // fwmark rule
+   RPC_Address  = 2,   // Rules of single addresses
+   RPC_Prefix   = 3,   // Rules of prefixes
+   RPC_Classes  = 4
+};
+enum SuspendReason {
+   SR_Carrier = (1 << 0),   // Link without carrier
+   SR_Health  = (1 << 1)    // Targets unreachable by the prober
+};
+enum ClonePolicyFlags {
+   CP_All       = (1 << 0),   // All routes of the interface
+   CP_Default   = (1 << 1),   // Default routes
+   CP_Connected = (1 << 2)    // Routes without gateway, and link-scope routes
+};
+enum TemporaryAddressPolicy {
+   TA_Include   = 0,   // Rules for the temporary addresses, like for any other address
+   TA_Exclude   = 1,   // No rules for the temporary addresses
+   TA_Aggregate = 2    // One rule for the prefix of the temporary addresses
+};
+enum LifetimeType {
+   LT_Route      = 'R',   // Lifetime of a source route
+   LT_Valid      = 'V',   // Valid lifetime of a managed address
+   LT_Deprecated = 'G'    // Grace period of a deprecated address
+};
+struct NetworkConfig {
+   unsigned int                               Table;
+   uint32_t                                   PriorityBase;   // Rule priority of the first class
+   uint32_t                                   PriorityStride; // Distance between the classes
+   uint32_t                                   FwMark;         // fwmark rule to the custom table
+   uint32_t                                   FwMarkMask;     // 0 for no fwmark rule
+   std::vector<std::pair<uint32_t, uint32_t>> UIDRanges;      // uidrange rules to the custom table
+   std::vector<std::string>                   CGroups;        // cgroups marked with FwMark
+   unsigned int                               CloneFlags;     // ClonePolicyFlags
+   PrefixTrie                                 ClonePrefixes;  // Destinations to clone
+   std::vector<unsigned int>                  SourceTables;   // Sorted tables to clone from
+   std::vector<Prober::Address>               ProbeTargets;   // Targets of the prober
+   unsigned int                               Weight;         // Multipath weight, 0 for measured
+   double                                     Capacity;       // Link capacity in Mbit/s, 0 if unknown
+   uint32_t                                   MPTCPFlags;     // MPTCP endpoint flags, 0 for none
+};
 static DynMHSOperatingMode                            Mode                     = Undefined;
 static uint32_t                                       SeqNumber                = 1000000000;
 static uint32_t                                       AwaitedSeqNumber         = 0;
 static int                                            LastError                = 0;
 static bool                                           WaitingForAcknowlegement = false;
-static std::map<std::string, unsigned int>            InterfaceMap;
+static int                                            EventSD                  = -1;   // Handled while backing off
+static bool                                           DumpInterrupted          = false;
+static bool                                           ResyncNecessary          = false;   // Events have been lost
+static std::set<uint8_t>                              InterruptedFamilies;
+static std::map<std::string, NetworkConfig>           InterfaceMap;
 static std::queue<std::pair<const nlmsghdr*, size_t>> RequestQueue;
+static unsigned int                                   AuditInterval            = 30;
+static unsigned int                                   AuditBudget              = 256;
+static unsigned int                                   AuditUnit                = 0;
+static bool                                           WarmRestart              = false;
+static unsigned int                                   Protocol                 = DYNMHS_PROTOCOL;
+static bool                                           UseJournal               = true;
+static Journal                                        OwnershipJournal;
+static bool                                           VRFMode                  = false;
+static std::map<unsigned int, int>                    VRFDevices;
+static std::map<int, int>                             LinkMasters;
+static std::map<int, unsigned int>                    PendingVRFMembers;   // Interface index -> table
+static bool                                           PrefixRules              = false;
+static bool                                           FwMarkRules              = false;
+static std::vector<CGroupHook*>                       CGroupHooks;
+static bool                                           OwnNexthops              = false;
+static bool                                           Aggregate                = false;
+static std::vector<unsigned int>                      SourceTables;   // Sorted, of all networks
+static bool                                           Failover                 = false;
+static std::map<unsigned int, unsigned int>           SuspendedTables;   // Table -> SuspendReason
+static Prober                                         HealthProber;
+static unsigned int                                   ProbeInterval            = 1000;
+static bool                                           ProbeWithdraw            = true;
+static unsigned int                                   MultipathMetric          = 0;
+static std::map<std::string, int>                     LinkIndices;   // Interface name -> index
+static unsigned int                                   StatisticsInterval       = 1000;
+static bool                                           DestroySockets           = false;
+static SocketDestroyer                                AddressSocketDestroyer;
+static bool                                           FlushConntrack           = false;
+static ConntrackFlusher                               AddressConntrackFlusher;
+static std::vector<SocketDestroyer::Address>          WithdrawnAddresses;   // Sockets/entries to remove
+static MPTCPPathManager                               EndpointManager;
+static std::set<int>                                  MPTCPInterfaces;   // Interfaces with endpoints
+static bool                                           MPTCPEndpointsChanged    = false;
+static unsigned int                                   DeprecatedGrace          = 0;
+static TemporaryAddressPolicy                         TemporaryAddresses       = TA_Include;
+static TimerWheel                                     LifetimeWheel;   // Timers of all LifetimeType
+static std::vector<char>                              EventQueues[EC_Classes];
 
 
 // ###### Append strings from source vector to destination vector ###########
@@ -75,474 +206,3589 @@ static void addStringsToVector(std::vector<std::string>&       destination,
 }
 
 
-// ###### Attribute helper ##################################################
-#define NLMSG_TAIL(message) \
-           ((rtattr*)(((long)(message)) + (long)NLMSG_ALIGN((message)->nlmsg_len)))
-static int addattr(nlmsghdr* message, const unsigned int maxlen,
-                   const int type, const void* data, const unsigned int alen)
+// ###### Parse a target address of the prober ##############################
+static bool parseProbeTarget(const std::string& value, Prober::Address& target)
 {
-   int     len = RTA_LENGTH(alen);
-   rtattr* rta;
-
-   assure((unsigned int)NLMSG_ALIGN(message->nlmsg_len) + (unsigned int)RTA_ALIGN(len) <= maxlen);
-   rta = NLMSG_TAIL(message);
-   rta->rta_type = type;
-   rta->rta_len  = len;
-   if(alen) {
-      memcpy(RTA_DATA(rta), data, alen);
-   }
-   message->nlmsg_len = NLMSG_ALIGN(message->nlmsg_len) + RTA_ALIGN(len);
-   return 0;
+   target.Family  = (value.find(':') != std::string::npos) ? AF_INET6 : AF_INET;
+   target.IfIndex = 0;
+   memset(&target.Address, 0, sizeof(target.Address));
+   return (inet_pton(target.Family, value.c_str(), &target.Address) == 1);
 }
 
 
-// ###### Handle error ######################################################
-static void handleError(const nlmsghdr* message)
+// ###### Parse an option of a network configuration ########################
+static bool parseNetworkOption(NetworkConfig& networkConfig, const std::string& option)
 {
-   const nlmsgerr* errormsg = (const nlmsgerr*)NLMSG_DATA(message);
-   if(errormsg != nullptr) {
-      // ====== Acknowledgement =============================================
-      if(errormsg->error == 0) {
-        DMHS_LOG(trace) << boost::format("ack for seqnum %u")
-                              % errormsg->msg.nlmsg_seq;
-      }
-      // ====== Error =======================================================
-      else {
-        DMHS_LOG(trace) << boost::format("Netlink error %d (%s) for seqnum %u")
-                              % errormsg->error
-                              % strerror(-errormsg->error)
-                              % errormsg->msg.nlmsg_seq;
-      }
+   const size_t delimiter = option.find('=');
+   if(delimiter == std::string::npos) {
+      return false;
    }
-}
+   const std::string name  = option.substr(0, delimiter);
+   const std::string value = option.substr(delimiter + 1);
+   char*             end;
 
-
-// ###### Handle link change event ##########################################
-static void handleLinkEvent(const nlmsghdr* message)
-{
-   // ====== Initialise =====================================================
-   const ifinfomsg* ifinfo = (const ifinfomsg*)NLMSG_DATA(message);
-   unsigned int     length = message->nlmsg_len - NLMSG_LENGTH(sizeof(*ifinfo));
-   const char*      eventName;
-   if(message->nlmsg_type != RTM_NEWLINK) {
-      eventName = "RTM_NEWLINK";
-   }
-   else if(message->nlmsg_type != RTM_DELLINK) {
-      eventName = "RTM_DELLINK";
+   // ====== fwmark=mark[/mask] =============================================
+   if(name == "fwmark") {
+      networkConfig.FwMark     = strtoul(value.c_str(), &end, 0);
+      networkConfig.FwMarkMask = 0xffffffff;
+      if(*end == '/') {
+         networkConfig.FwMarkMask = strtoul(end + 1, &end, 0);
+      }
+      return ( (*end == 0) && (value != "") && (networkConfig.FwMarkMask != 0) );
    }
-   else {
-      return;
+
+   // ====== uidrange=start[-end] ===========================================
+   else if(name == "uidrange") {
+      const uint32_t start = strtoul(value.c_str(), &end, 10);
+      uint32_t       last  = start;
+      if(*end == '-') {
+         last = strtoul(end + 1, &end, 10);
+      }
+      networkConfig.UIDRanges.push_back(std::pair<uint32_t, uint32_t>(start, last));
+      return ( (*end == 0) && (value != "") && (start <= last) );
    }
 
-   // ====== Parse attributes ===============================================
-   const char* ifName = nullptr;
-   for(const rtattr* rta = IFLA_RTA(ifinfo); RTA_OK(rta, length); rta = RTA_NEXT(rta, length)) {
-      if(rta->rta_type == IFLA_IFNAME) {
-         ifName = (const char*)RTA_DATA(rta);
+   // ====== cgroup=path ====================================================
+   /* Relative paths are relative to the cgroup v2 hierarchy. */
+   else if(name == "cgroup") {
+      if(value == "") {
+         return false;
       }
+      networkConfig.CGroups.push_back((value[0] == '/') ? value :
+                                         std::string(CGROUP_ROOT "/") + value);
+      return true;
    }
 
-   // ====== Show status ====================================================
-   DMHS_LOG(debug) << boost::format("Link event: event=%s ifindex=%d ifname=%s")
-                         % eventName
-                         % ifinfo->ifi_index
-                         % ((ifName != nullptr) ? ifName : "UNKNOWN?!");
-}
+   // ====== clone=all|default|connected|prefix[/length] ====================
+   else if(name == "clone") {
+      if(value == "all") {
+         networkConfig.CloneFlags |= CP_All;
+         return true;
+      }
+      else if(value == "default") {
+         networkConfig.CloneFlags |= CP_Default;
+         return true;
+      }
+      else if(value == "connected") {
+         networkConfig.CloneFlags |= CP_Connected;
+         return true;
+      }
+      const size_t       slash     = value.find('/');
+      const std::string  address   = value.substr(0, slash);
+      const uint8_t      family    = (address.find(':') != std::string::npos) ? AF_INET6 : AF_INET;
+      const unsigned int maxLength = (family == AF_INET6) ? 128 : 32;
+      unsigned int       length    = maxLength;
+      uint8_t            prefix[16];
+      if(inet_pton(family, address.c_str(), &prefix) != 1) {
+         return false;
+      }
+      if(slash != std::string::npos) {
+         const std::string lengthString = value.substr(slash + 1);
+         length = strtoul(lengthString.c_str(), &end, 10);
+         if( (*end != 0) || (lengthString == "") || (length > maxLength) ) {
+            return false;
+         }
+      }
+      networkConfig.ClonePrefixes.insert(family, prefix, length);
+      return true;
+   }
 
+   // ====== priority=base[/stride] =========================================
+   else if(name == "priority") {
+      networkConfig.PriorityBase = strtoul(value.c_str(), &end, 10);
+      if(*end == '/') {
+         networkConfig.PriorityStride = strtoul(end + 1, &end, 10);
+      }
+      return ( (*end == 0) && (value != "") && (networkConfig.PriorityBase > 0) &&
+               ((uint64_t)networkConfig.PriorityBase +
+                   (uint64_t)(RPC_Classes - 1) * networkConfig.PriorityStride < 32766) );
+   }
 
-// ###### Handle address change event ##########################################
-static void handleAddressEvent(const nlmsghdr* message)
-{
-   // ====== Initialise =====================================================
-   const ifaddrmsg*   ifa       = (const ifaddrmsg*)NLMSG_DATA(message);
-   const unsigned int ifalength = message->nlmsg_len;
-   const char*        eventName;
-   if(message->nlmsg_type != RTM_NEWADDR) {
-      eventName = "RTM_NEWADDR";
+   // ====== source=main|table ==============================================
+   else if(name == "source") {
+      const unsigned int table = (value == "main") ? (unsigned int)RT_TABLE_MAIN :
+                                                     strtoul(value.c_str(), &end, 10);
+      if( (value != "main") && ( (*end != 0) || (value == "") ) ) {
+         return false;
+      }
+      if( (table == RT_TABLE_UNSPEC) || (table == networkConfig.Table) ) {
+         return false;
+      }
+      const auto position = std::lower_bound(networkConfig.SourceTables.begin(),
+                                             networkConfig.SourceTables.end(), table);
+      if( (position == networkConfig.SourceTables.end()) || (*position != table) ) {
+         networkConfig.SourceTables.insert(position, table);
+      }
+      return true;
    }
-   else if(message->nlmsg_type != RTM_DELADDR) {
-      eventName = "RTM_DELADDR";
+
+   // ====== weight=weight ==================================================
+   else if(name == "weight") {
+      networkConfig.Weight = strtoul(value.c_str(), &end, 10);
+      return ( (*end == 0) && (value != "") &&
+               (networkConfig.Weight >= 1) && (networkConfig.Weight <= 256) );
    }
-   else {
-      return;
+
+   // ====== capacity=Mbit/s ================================================
+   else if(name == "capacity") {
+      networkConfig.Capacity = strtod(value.c_str(), &end);
+      return ( (*end == 0) && (value != "") && (networkConfig.Capacity > 0.0) );
    }
 
-   // ====== Parse attributes ===============================================
-   const unsigned int       ifIndex = ifa->ifa_index;
-   char                     ifNameBuffer[IF_NAMESIZE];
-   const char*              ifName;
-   boost::asio::ip::address address;
-   const char*              addressPtr  = nullptr;
-   bool                     isLinkLocal = false;
-   const unsigned int       prefixLength = ifa->ifa_prefixlen;
-   unsigned int             length = ifalength - NLMSG_LENGTH(sizeof(*ifa));
-   for(const rtattr* rta = IFA_RTA(ifa); RTA_OK(rta, length); rta = RTA_NEXT(rta, length)) {
-      switch(rta->rta_type) {
-         case IFA_ADDRESS:
-            if(ifa->ifa_family == AF_INET) {
-               address    = boost::asio::ip::make_address_v4(*((boost::asio::ip::address_v4::bytes_type*)RTA_DATA(rta)));
-               addressPtr = (const char*)RTA_DATA(rta);
-            }
-            else if(ifa->ifa_family == AF_INET6) {
-               const boost::asio::ip::address_v6 a =
-                  boost::asio::ip::make_address_v6(*((boost::asio::ip::address_v6::bytes_type*)RTA_DATA(rta)));
-               if(a.is_link_local()) {
-                  isLinkLocal = true;
-               }
-               address    = a;
-               addressPtr = (const char*)RTA_DATA(rta);
-            }
-          break;
+   // ====== mptcp=subflow|signal|backup|fullmesh ===========================
+   else if(name == "mptcp") {
+      if(value == "subflow") {
+         networkConfig.MPTCPFlags |= MPTCP_PM_ADDR_FLAG_SUBFLOW;
       }
-   }
-   ifName = if_indextoname(ifIndex, (char*)&ifNameBuffer);
-   if(ifName == nullptr) {
-      ifName = "UNKNOWN";
+      else if(value == "signal") {
+         networkConfig.MPTCPFlags |= MPTCP_PM_ADDR_FLAG_SIGNAL;
+      }
+      else if(value == "backup") {
+         networkConfig.MPTCPFlags |= MPTCP_PM_ADDR_FLAG_BACKUP;
+      }
+      else if(value == "fullmesh") {
+         networkConfig.MPTCPFlags |= MPTCP_PM_ADDR_FLAG_FULLMESH;
+      }
+      else {
+         return false;
+      }
+      return true;
    }
 
+   // ====== probe=address ==================================================
+   else if(name == "probe") {
+      Prober::Address target;
+      if(!parseProbeTarget(value, target)) {
+         return false;
+      }
+      networkConfig.ProbeTargets.push_back(target);
+      return true;
+   }
+   return false;
+}
 
-   // ====== Show status ====================================================
-   DMHS_LOG(trace) << boost::format("Address event: event=%s if=%s (%d) address=%s/%d")
-                         % eventName
-                         % ifName
-                         % ifIndex
-                         % address.to_string()
-                         % prefixLength;
 
+// ###### Get the rule priority of a class of rules #########################
+/* Each network has its own range of priorities, with one priority per class
+ * of rules. So, the lookup order of the rules is deterministic, regardless
+ * of the order of their installation. */
+static inline uint32_t getRulePriority(const NetworkConfig&    networkConfig,
+                                       const RulePriorityClass priorityClass)
+{
+   return networkConfig.PriorityBase + priorityClass * networkConfig.PriorityStride;
+}
 
-   // ====== Check whether an update in the custom table is necessary =======
-   /* In Operational mode:
-    * If there is an address change on an interface with custom table:
-    * Update the rule pointing from the address to the custom table
-    * */
-   if( (Mode == Operational)   &&
-       (addressPtr != nullptr) &&
-       (!isLinkLocal) ) {
 
-      // ------ Check whether interface has a custom table ------------------
-      const auto found = InterfaceMap.find(ifName);
-      if(found != InterfaceMap.end()) {
-         const uint32_t customTable = found->second;
-         DMHS_LOG(debug) << "Update of rule for table " << customTable << " is necessary ...";
+// ###### Get the network configuration of a custom table ###################
+static const NetworkConfig* getNetworkConfig(const unsigned int table)
+{
+   for(auto iterator = InterfaceMap.begin(); iterator != InterfaceMap.end(); iterator++) {
+      if(iterator->second.Table == table) {
+         return &iterator->second;
+      }
+   }
+   return nullptr;
+}
 
-         // ------ Build RTM_NEWRULE/RTM_DELRULE request --------------------
-         struct _request {
-            nlmsghdr     header;
-            fib_rule_hdr frh;
-            char         buffer[256];
-         };
-         _request* request = (_request*)new char[sizeof(*request)];
-         assure(request != nullptr);
-         memset(request, 0, sizeof(*request));
-
-         request->header.nlmsg_len   = NLMSG_LENGTH(sizeof(request->frh));
-         if(message->nlmsg_type == RTM_NEWADDR) {
-            request->header.nlmsg_type  = RTM_NEWRULE;
-            request->header.nlmsg_flags = NLM_F_REQUEST | NLM_F_CREATE | NLM_F_EXCL | NLM_F_ACK;
-         }
-         else {
-            request->header.nlmsg_type  = RTM_DELRULE;
-            request->header.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
-         }
-         request->header.nlmsg_pid   = 0;  // This field is opaque to netlink.
-         request->header.nlmsg_seq   = ++SeqNumber;
-         request->frh.family         = ifa->ifa_family;
-         request->frh.action         = FR_ACT_TO_TBL;
-         request->frh.table          = RT_TABLE_UNSPEC;
 
-         // ------ "from" parameter: address/prefix -------------------------
-         if(ifa->ifa_family == AF_INET) {
-            assure( addattr(&request->header, sizeof(*request), FRA_SRC,
-                            addressPtr, 4) == 0 );
-            request->frh.src_len = 32;
-         }
-         else {
-            assure( addattr(&request->header, sizeof(*request), FRA_SRC,
-                            addressPtr, 16) == 0 );
-            request->frh.src_len = 128;
-         }
+// ###### Check whether a table is a source table ###########################
+/* The route events of all tables pass here. So, the tables are looked up in
+ * sorted vectors, first in the tables of all networks, then in the tables of
+ * the network. */
+static inline bool isSourceTable(const unsigned int table)
+{
+   return std::binary_search(SourceTables.begin(), SourceTables.end(), table);
+}
 
-         // ------ "priority" parameter -------------------------------------
-         assure( addattr(&request->header, sizeof(*request), FRA_PRIORITY,
-                         &customTable, sizeof(uint32_t)) == 0 );
+static inline bool isSourceTable(const NetworkConfig& networkConfig,
+                                 const unsigned int   table)
+{
+   return std::binary_search(networkConfig.SourceTables.begin(),
+                             networkConfig.SourceTables.end(), table);
+}
 
-         // ------ "lookup" parameter ---------------------------------------
-         assure( addattr(&request->header, sizeof(*request), FRA_TABLE,
-                         &customTable, sizeof(uint32_t)) == 0 );
 
-         // ------ Enqueue message for sending it later ---------------------
-         RequestQueue.push(std::pair<const nlmsghdr*, size_t>(
-            &request->header, request->header.nlmsg_len));
-         DMHS_LOG(trace) << "Request seqnum " << SeqNumber;
-      }
-   }
+// ###### Check whether the rules of a network are suspended ################
+static inline bool isSuspended(const unsigned int table)
+{
+   return (SuspendedTables.find(table) != SuspendedTables.end());
 }
 
 
-// ###### Handle route change event #########################################
-static void handleRouteEvent(const nlmsghdr* message)
+// ###### Check whether a route is to be cloned #############################
+/* The policy is compiled into flags and a prefix trie, so that a route
+ * not to be cloned (e.g. of a full BGP feed) is rejected without any
+ * allocation. A prefix matches all destinations within it. */
+static bool matchesClonePolicy(const NetworkConfig& networkConfig,
+                               const nlmsghdr*      message)
 {
-   // ====== Initialise =====================================================
-   const unsigned int messageLength = message->nlmsg_len;
-   const rtmsg*       rtm           = (const rtmsg*)NLMSG_DATA(message);
-   const unsigned int rtmLength     = message->nlmsg_len;
-   const char*        eventName;
-   if(message->nlmsg_type != RTM_NEWROUTE) {
-      eventName = "RTM_NEWROUTE";
-   }
-   else if(message->nlmsg_type != RTM_DELROUTE) {
-      eventName = "RTM_DELROUTE";
+   if(networkConfig.CloneFlags & CP_All) {
+      return true;
    }
-   else {
-      return;
+   const rtmsg* rtm = (const rtmsg*)NLMSG_DATA(message);
+   if( (networkConfig.CloneFlags & CP_Default) && (rtm->rtm_dst_len == 0) ) {
+      return true;
    }
 
-   // ====== Parse attributes ===============================================
-   boost::asio::ip::address destination =
-      (rtm->rtm_family == AF_INET) ?
-         boost::asio::ip::address(boost::asio::ip::address_v4()) :
-         boost::asio::ip::address(boost::asio::ip::address_v6());
-   const unsigned int       destinationPrefixLength = rtm->rtm_dst_len;
-   boost::asio::ip::address gateway;
-   bool                     hasGateway = false;
-   unsigned int*            tablePtr   = nullptr;
-   int                      metric     = -1;
-   int                      oifIndex   = -1;
-   char                     oifNameBuffer[IF_NAMESIZE];
-   const char*              oifName;
-   int                      length = rtmLength - NLMSG_LENGTH(sizeof(*rtm));
+   static const uint8_t zero[16] = { };
+   const uint8_t*       dst        = zero;
+   bool                 hasGateway = false;
+   int                  length     = message->nlmsg_len - NLMSG_LENGTH(sizeof(*rtm));
    for(const rtattr* rta = RTM_RTA(rtm); RTA_OK(rta, length); rta = RTA_NEXT(rta, length)) {
       switch(rta->rta_type) {
          case RTA_DST:
-            if(rtm->rtm_family == AF_INET) {
-               destination = boost::asio::ip::make_address_v4(*((boost::asio::ip::address_v4::bytes_type*)RTA_DATA(rta)));
-            }
-            else if(rtm->rtm_family == AF_INET6) {
-               destination = boost::asio::ip::make_address_v6(*((boost::asio::ip::address_v6::bytes_type*)RTA_DATA(rta)));
-            }
+            dst = (const uint8_t*)RTA_DATA(rta);
           break;
          case RTA_GATEWAY:
-            if(rtm->rtm_family == AF_INET) {
-               gateway = boost::asio::ip::make_address_v4(*((boost::asio::ip::address_v4::bytes_type*)RTA_DATA(rta)));
-            }
-            else if(rtm->rtm_family == AF_INET6) {
-               gateway = boost::asio::ip::make_address_v6(*((boost::asio::ip::address_v6::bytes_type*)RTA_DATA(rta)));
-            }
-          break;
-         case RTA_TABLE:
-            tablePtr = (unsigned int*)RTA_DATA(rta);
-          break;
-         case RTA_METRICS:
-            metric = *(int*)RTA_DATA(rta);
-          break;
-         case RTA_OIF:
-            oifIndex = *(int*)RTA_DATA(rta);
-            if(oifIndex >= 0) {
-               oifName = if_indextoname(oifIndex, (char*)&oifNameBuffer);
-               if(oifName == nullptr) {
-                  oifName = "UNKNOWN";
-               }
-            }
+         case RTA_VIA:
+         case RTA_MULTIPATH:
+         case RTA_NH_ID:
+            hasGateway = true;
           break;
       }
    }
-   assure(tablePtr != nullptr);
-
-
-   // ====== Show status =================================================
-   const char* scopeName;
-   switch(rtm->rtm_scope) {
-      case RT_SCOPE_UNIVERSE:
-         scopeName = "universe";
-       break;
-      case RT_SCOPE_LINK:
-         scopeName = "link";
-       break;
-       default:
-         scopeName = "UNKNOWN";
-       break;
+   if( (networkConfig.CloneFlags & CP_Connected) &&
+       ( (rtm->rtm_scope == RT_SCOPE_LINK) || (!hasGateway) ) ) {
+      return true;
    }
-   DMHS_LOG(trace) << boost::format("Route event: event=%s: table=%d destination=%s scope=%s %s if=%s (%d) %s")
-                         % eventName
-                         % *tablePtr
-                         % (destination.to_string() + "/" +
-                              std::to_string(destinationPrefixLength))
-                         % scopeName
-                         % ((hasGateway == true) ? ("G=" + gateway.to_string()) : "G=---")
-                         % oifName
-                         % oifIndex
-                         % ((metric >= 0) ? std::to_string(metric) : "");
+   return networkConfig.ClonePrefixes.covers(rtm->rtm_family, dst, rtm->rtm_dst_len);
+}
 
 
-   // ====== Check whether an update in the custom table is necessary =======
-   bool     updateNecessary = false;
-   uint16_t updateType;
-   if( (Mode == Operational) &&
-       (*tablePtr == RT_TABLE_MAIN) &&
-       ( (message->nlmsg_type == RTM_NEWROUTE) ||
-         (message->nlmsg_type == RTM_DELROUTE) ) ) {
-      /* In Operational mode, synchronise a routing change from the main table
-       * into the custom table. Only changes in the main table are of interest
-       * here! */
-      // ------ Find custom table in the InterfaceMap -----------------------
-      const auto found = InterfaceMap.find(oifName);
-      if(found != InterfaceMap.end()) {
-          const unsigned int customTable = found->second;
-         DMHS_LOG(debug) << "Update of route in table " << customTable << " is necessary ...";
-         updateNecessary = true;
-         updateType      = message->nlmsg_type;
-         *tablePtr       = customTable;   // <<-- clone entry into custom table
+// ###### Get description of the options of a network configuration #########
+static std::string getNetworkOptions(const NetworkConfig& networkConfig)
+{
+   std::string description;
+   if(networkConfig.FwMarkMask != 0) {
+      description += str(boost::format(", fwmark 0x%x/0x%x")
+                            % networkConfig.FwMark % networkConfig.FwMarkMask);
+   }
+   for(const std::pair<uint32_t, uint32_t>& uidRange : networkConfig.UIDRanges) {
+      description += str(boost::format(", uidrange %u-%u")
+                            % uidRange.first % uidRange.second);
+   }
+   for(const std::string& cgroup : networkConfig.CGroups) {
+      description += ", cgroup " + cgroup;
+   }
+   if( (networkConfig.PriorityBase != networkConfig.Table) ||
+       (networkConfig.PriorityStride != 0) ) {
+      description += str(boost::format(", priority %u/%u")
+                            % networkConfig.PriorityBase % networkConfig.PriorityStride);
+   }
+   if( (networkConfig.SourceTables.size() != 1) ||
+       (networkConfig.SourceTables.front() != RT_TABLE_MAIN) ) {
+      description += ", source";
+      for(const unsigned int table : networkConfig.SourceTables) {
+         description += " " + ((table == RT_TABLE_MAIN) ? std::string("main") :
+                                                          std::to_string(table));
       }
    }
-   else if( (Mode == Reset) &&
-            (*tablePtr != RT_TABLE_MAIN) ) {
-      /* In Reset mode, delete all routing table entries in the custom tables.
-       * Here, only the custom tables are of interest! */
-      // ------ Check if entry belongs to custom table in the InterfaceMap --
-      for(auto iterator = InterfaceMap.begin(); iterator != InterfaceMap.end(); iterator++) {
-         const unsigned int customTable = iterator->second;
-         if(*tablePtr == customTable) {
-            DMHS_LOG(trace) << "Removing route from table " << customTable << " ...";
-            updateNecessary = true;
-            updateType      = RTM_DELROUTE;
-            break;
-         }
+   if(networkConfig.Weight != 0) {
+      description += str(boost::format(", weight %u") % networkConfig.Weight);
+   }
+   if(networkConfig.Capacity > 0.0) {
+      description += str(boost::format(", capacity %1.1f Mbit/s") % networkConfig.Capacity);
+   }
+   if(networkConfig.MPTCPFlags != 0) {
+      description += ", mptcp";
+      if(networkConfig.MPTCPFlags & MPTCP_PM_ADDR_FLAG_SUBFLOW) {
+         description += " subflow";
+      }
+      if(networkConfig.MPTCPFlags & MPTCP_PM_ADDR_FLAG_SIGNAL) {
+         description += " signal";
+      }
+      if(networkConfig.MPTCPFlags & MPTCP_PM_ADDR_FLAG_BACKUP) {
+         description += " backup";
+      }
+      if(networkConfig.MPTCPFlags & MPTCP_PM_ADDR_FLAG_FULLMESH) {
+         description += " fullmesh";
+      }
+   }
+   for(const Prober::Address& target : networkConfig.ProbeTargets) {
+      char buffer[INET6_ADDRSTRLEN];
+      description += std::string(", probe ") +
+                        inet_ntop(target.Family, &target.Address, (char*)&buffer, sizeof(buffer));
+   }
+   if(!(networkConfig.CloneFlags & CP_All)) {
+      description += ", clone";
+      if(networkConfig.CloneFlags & CP_Default) {
+         description += " default";
+      }
+      if(networkConfig.CloneFlags & CP_Connected) {
+         description += " connected";
+      }
+      if(networkConfig.ClonePrefixes.getPrefixes() > 0) {
+         description += str(boost::format(" %u prefix(es)")
+                               % networkConfig.ClonePrefixes.getPrefixes());
       }
    }
+   return description;
+}
 
-   // ====== Apply update ===================================================
-   if(updateNecessary) {
-      // ------ Copy the message and enqueue it for sending it later -----
-      nlmsghdr* updateMessage = (nlmsghdr*)new char[messageLength];
-      assure(updateMessage != nullptr);
-      memcpy(updateMessage, message, messageLength);
 
-      updateMessage->nlmsg_type  = updateType;
-      updateMessage->nlmsg_flags = (updateType == RTM_NEWROUTE) ?
-         NLM_F_REQUEST | NLM_F_CREATE | NLM_F_EXCL | NLM_F_ACK :
-         NLM_F_REQUEST | NLM_F_ACK;
-      updateMessage->nlmsg_seq   = ++SeqNumber;
+// ###### Attribute helper ##################################################
+#define NLMSG_TAIL(message) \
+           ((rtattr*)(((long)(message)) + (long)NLMSG_ALIGN((message)->nlmsg_len)))
+static int addattr(nlmsghdr* message, const unsigned int maxlen,
+                   const int type, const void* data, const unsigned int alen)
+{
+   int     len = RTA_LENGTH(alen);
+   rtattr* rta;
 
-      RequestQueue.push(std::pair<const nlmsghdr*, size_t>(
-         updateMessage, messageLength));
-      DMHS_LOG(trace) << "Request seqnum " << SeqNumber;
+   assure((unsigned int)NLMSG_ALIGN(message->nlmsg_len) + (unsigned int)RTA_ALIGN(len) <= maxlen);
+   rta = NLMSG_TAIL(message);
+   rta->rta_type = type;
+   rta->rta_len  = len;
+   if(alen) {
+      memcpy(RTA_DATA(rta), data, alen);
    }
+   message->nlmsg_len = NLMSG_ALIGN(message->nlmsg_len) + RTA_ALIGN(len);
+   return 0;
 }
 
+static rtattr* addattr_nest(nlmsghdr* message, const unsigned int maxlen,
+                            const int type)
+{
+   rtattr* nest = NLMSG_TAIL(message);
+   assure( addattr(message, maxlen, type, nullptr, 0) == 0 );
+   return nest;
+}
 
-// ###### Handle rule change event ##########################################
-static void handleRuleEvent(const nlmsghdr* message)
+static void addattr_nest_end(nlmsghdr* message, rtattr* nest)
 {
-   // ====== Initialise =====================================================
-   const unsigned int  messageLength = message->nlmsg_len;
-   const fib_rule_hdr* frh           = (const fib_rule_hdr*)NLMSG_DATA(message);
-   const unsigned int  frhLength     = message->nlmsg_len;
-   const char*         eventName;
-   if(message->nlmsg_type != RTM_NEWRULE) {
-      eventName = "RTM_NEWRULE";
+   nest->rta_len = (long)NLMSG_TAIL(message) - (long)nest;
+}
+
+
+// ###### Get address length of address family ##############################
+static unsigned int getAddressLength(const uint8_t family)
+{
+   return (family == AF_INET) ? 4 : 16;
+}
+
+
+// ###### Compute FNV-1a hash ###############################################
+static uint64_t computeHash(const void*  data,
+                            const size_t length,
+                            uint64_t     hash = 14695981039346656037ULL)
+{
+   const uint8_t* bytes = (const uint8_t*)data;
+   for(size_t i = 0; i < length; i++) {
+      hash ^= bytes[i];
+      hash *= 1099511628211ULL;
    }
-   else if(message->nlmsg_type != RTM_DELRULE) {
-      eventName = "RTM_DELRULE";
+   return hash;
+}
+
+
+// ###### Kernel object bookkeeping #########################################
+/* DynMHS keeps the expected state of the objects it owns in the kernel:
+ * the routes of each custom table (per address family), and the rules
+ * pointing to the custom tables (per address family). Each set has an
+ * order-independent digest (XOR of the object digests), so that an audit
+ * can cheaply compare a kernel dump against the expected state. */
+struct ObjectIdentity {
+   std::string  Key;      // Identity of the object within its table
+   uint64_t     Digest;   // Hash of key and relevant content
+   uint8_t      Family;
+   uint8_t      Protocol;
+   unsigned int Table;
+   int          OIF;
+};
+struct KernelObject {
+   std::vector<char> Message;   // Message to (re-)install the object
+   uint64_t          Digest;
+};
+struct ObjectSet {
+   std::map<std::string, KernelObject> Objects;
+   uint64_t                            Digest = 0;
+   std::map<std::string, KernelObject> Adoptable;   // Left by warm restart
+};
+struct SourceClone {
+   unsigned int Table;
+   std::string  Key;
+   uint32_t     Nexthop;   // Nexthop object of the clone, or 0
+};
+struct SourceRoute {
+   uint64_t                 Digest;
+   uint8_t                  Family;
+   std::vector<SourceClone> Clones;   // One per custom table
+};
+static std::map<std::pair<uint8_t, unsigned int>, ObjectSet> RouteSets;
+static std::map<uint8_t, ObjectSet>                          RuleSets;
+static std::map<std::string, SourceRoute>                    SourceRoutes;
+
+/* Routes of different source tables may have clones with the same key, e.g.
+ * with the same destination and metric over the same interface. Such a
+ * clone is shared: the clone of the most recently updated source route is
+ * installed, and the clone is only withdrawn with its last source route.
+ * Only for a shared clone, the clones of all its source routes are kept, in
+ * order to install the clone of a remaining one. */
+struct CloneUsers {
+   std::string                              Owner;    // Source route of the installed clone
+   std::map<std::string, std::vector<char>> Shared;   // Source route -> clone, if shared
+};
+static std::map<std::string, CloneUsers>                     CloneReferences;   // Clone key -> users
+
+/* The kernel nexthop objects are cached, in order to find the interface of
+ * a route referencing a nexthop object. Nexthop objects owned by DynMHS
+ * are shared by all clones with the same gateway (or the same group), and
+ * reference-counted. */
+struct NexthopInfo {
+   uint8_t               Family;
+   int                   OIF;       // -1 for a group
+   std::vector<uint32_t> Members;   // Members of a group
+};
+struct OwnedNexthop {
+   uint32_t                                  ID;
+   unsigned int                              References;
+   std::vector<std::pair<uint32_t, uint8_t>> Members;   // (ID, weight) of a group
+};
+static std::map<uint32_t, NexthopInfo>                       Nexthops;
+static std::map<std::string, OwnedNexthop>                   OwnedNexthops;
+static std::map<uint32_t, std::string>                       OwnedNexthopKeys;
+static uint32_t                                              NextNexthopID = 0;   // Set in main()
+static std::vector<uint32_t>                                 PendingNexthopReleases;
+
+/* With aggregation, the clones are candidates in a binary trie per custom
+ * table. The routes installed into the custom table are derived from the
+ * trie: sibling prefixes with the same next hop (signature) are merged
+ * into their covering prefix, and a route with the same signature as its
+ * nearest covering route is left out. A node with several routes, or with
+ * a route that cannot be aggregated, is opaque: its routes are installed
+ * unchanged. A change only updates the states of the affected node and its
+ * ancestors, and the routes below the highest changed node. Afterwards,
+ * the branches without routes are pruned, and their nodes are reused. */
+struct AggregationRoute {
+   std::vector<char> Message;
+   uint64_t          Signature;
+   bool              Aggregatable;
+};
+struct AggregationNode {
+   uint32_t                                Child[2];   // 0 for none
+   uint32_t                                Parent;
+   uint8_t                                 Length;
+   uint8_t                                 Prefix[16];
+   std::map<std::string, AggregationRoute> Routes;
+   bool                                    Opaque;
+   bool                                    Effective;   // Covered with Signature
+   bool                                    Merged;      // Effective by merged children
+   uint64_t                                Signature;
+   std::vector<std::string>                Output;      // Keys of the installed routes
+   bool                                    Free;        // Pruned, in FreeNodes
+};
+struct AggregationTrie {
+   std::vector<AggregationNode>    Nodes;
+   std::map<std::string, uint32_t> CandidateNodes;   // Clone key -> node
+   std::set<uint32_t>              DirtyNodes;
+   std::vector<uint32_t>           FreeNodes;        // Pruned nodes for reuse
+};
+static std::map<std::pair<uint8_t, unsigned int>, AggregationTrie> AggregationTries;
+
+/* The rules pointing to the custom tables are derived from the addresses
+ * of the interfaces with custom table. A deprecated address keeps its rule
+ * for the grace period, so that its connections can finish. */
+struct ManagedAddress {
+   uint8_t      Family;
+   uint8_t      PrefixLength;
+   unsigned int Table;
+   unsigned int IfIndex;
+   uint32_t     Flags;     // IFA_F_*
+   bool         Expired;   // Grace period is over
+   uint8_t      Address[16];
+};
+static std::map<std::string, ManagedAddress>                 ManagedAddresses;
+static std::map<uint8_t, std::set<std::string>>              AddressRuleKeys;
+static std::map<uint8_t, std::set<std::string>>              NetworkRuleKeys;
+static std::map<uint8_t, std::set<std::string>>              OverlappingPrefixes;
+
+/* The default routes of the main table provide the gateways of the
+ * multipath default route. Its weights are only changed after a hold time,
+ * unless the set of networks changes. */
+struct UplinkGateway {
+   int     OIF;
+   uint8_t Gateway[16];
+};
+struct DefaultRoute {
+   uint8_t                    Family;
+   std::vector<UplinkGateway> Gateways;
+};
+struct MultipathRoute {
+   std::string                                        Key;        // Installed route
+   std::string                                        Nexthops;   // Interfaces and gateways of the legs
+   std::map<unsigned int, unsigned int>               Weights;    // Table -> weight
+   std::chrono::time_point<std::chrono::steady_clock> LastChange;
+};
+static std::map<std::string, DefaultRoute>                   MainDefaultRoutes;
+static std::map<uint8_t, MultipathRoute>                     MultipathRoutes;
+
+/* The utilisation of a network is derived from the byte counters of its
+ * interface, relative to its configured capacity. */
+struct LinkStatistics {
+   uint64_t                                           RxBytes;
+   uint64_t                                           TxBytes;
+   std::chrono::time_point<std::chrono::steady_clock> SampleTime;
+   double                                             Utilisation;   // Smoothed, 0 to 1
+};
+static std::map<unsigned int, LinkStatistics>               NetworkStatistics;   // Table -> statistics
+
+
+// ###### Append value to identity key ######################################
+static void appendToKey(std::string& key, const void* data, const size_t length)
+{
+   key.append((const char*)data, length);
+}
+
+
+// ###### Get the legs of a multipath route #################################
+struct MultipathLeg {
+   int              OIF;
+   const uint8_t*   Gateway;   // nullptr for a direct leg
+   uint8_t          Weight;    // 1 to 256, minus 1 (as in rtnh_hops)
+   const rtnexthop* Nexthop;   // The leg within RTA_MULTIPATH
+};
+static std::vector<MultipathLeg> getMultipathLegs(const rtattr* multipath)
+{
+   std::vector<MultipathLeg> legs;
+   int length = RTA_PAYLOAD(multipath);
+   for(const rtnexthop* rtnh = (const rtnexthop*)RTA_DATA(multipath);
+       RTNH_OK(rtnh, length);
+       length -= NLMSG_ALIGN(rtnh->rtnh_len), rtnh = RTNH_NEXT(rtnh)) {
+      MultipathLeg leg = { rtnh->rtnh_ifindex, nullptr, rtnh->rtnh_hops, rtnh };
+      int attributesLength = rtnh->rtnh_len - sizeof(*rtnh);
+      for(const rtattr* rta = RTNH_DATA(rtnh); RTA_OK(rta, attributesLength);
+          rta = RTA_NEXT(rta, attributesLength)) {
+         if(rta->rta_type == RTA_GATEWAY) {
+            leg.Gateway = (const uint8_t*)RTA_DATA(rta);
+         }
+      }
+      legs.push_back(leg);
    }
-   else {
-      return;
+   return legs;
+}
+
+
+// ###### Get identity of a route ###########################################
+static bool getRouteIdentity(const nlmsghdr* message, ObjectIdentity& identity)
+{
+   const rtmsg* rtm = (const rtmsg*)NLMSG_DATA(message);
+   if( (message->nlmsg_len < NLMSG_LENGTH(sizeof(*rtm))) ||
+       ( (rtm->rtm_family != AF_INET) && (rtm->rtm_family != AF_INET6) ) ) {
+      return false;
    }
+   const unsigned int addressLength = getAddressLength(rtm->rtm_family);
 
    // ====== Parse attributes ===============================================
-   unsigned int* tablePtr   = nullptr;
-   unsigned int  priority   = 0;
-   unsigned int  length     = frhLength - NLMSG_LENGTH(sizeof(*frh));
+   unsigned int  table     = rtm->rtm_table;
+   uint32_t      priority  = 0;
+   const char*   dst       = nullptr;
+   const char*   src       = nullptr;
+   const char*   gateway   = nullptr;
+   int           oif       = -1;
+   uint32_t      nexthop   = 0;
+   const rtattr* multipath = nullptr;
+   int           length    = message->nlmsg_len - NLMSG_LENGTH(sizeof(*rtm));
+   for(const rtattr* rta = RTM_RTA(rtm); RTA_OK(rta, length); rta = RTA_NEXT(rta, length)) {
+      switch(rta->rta_type) {
+         case RTA_TABLE:
+            table = *(const uint32_t*)RTA_DATA(rta);
+          break;
+         case RTA_PRIORITY:
+            priority = *(const uint32_t*)RTA_DATA(rta);
+          break;
+         case RTA_DST:
+            dst = (const char*)RTA_DATA(rta);
+          break;
+         case RTA_SRC:
+            src = (const char*)RTA_DATA(rta);
+          break;
+         case RTA_GATEWAY:
+            gateway = (const char*)RTA_DATA(rta);
+          break;
+         case RTA_OIF:
+            oif = *(const int*)RTA_DATA(rta);
+          break;
+         case RTA_NH_ID:
+            nexthop = *(const uint32_t*)RTA_DATA(rta);
+          break;
+         case RTA_MULTIPATH:
+            multipath = rta;
+          break;
+      }
+   }
+   if(nexthop != 0) {
+      // The kernel may report the interface and gateway of the nexthop
+      // object as well (nexthop_compat_mode). They are not part of the route.
+      oif     = -1;
+      gateway = nullptr;
+   }
+
+   // ====== Build key and digest ===========================================
+   /* The key consists of the fields the kernel uses to identify a route
+    * within a table. The outgoing interface is part of the key, since IPv6
+    * keeps routes to the same destination over different interfaces as
+    * separate entries. The digest additionally covers the gateway, the
+    * interfaces, gateways and weights of the legs, or the nexthop object. */
+   static const char zero[16] = { };
+   identity.Family   = rtm->rtm_family;
+   identity.Protocol = rtm->rtm_protocol;
+   identity.Table    = table;
+   identity.OIF      = oif;
+   identity.Key.clear();
+   appendToKey(identity.Key, &rtm->rtm_family,  sizeof(rtm->rtm_family));
+   appendToKey(identity.Key, &table,            sizeof(table));
+   appendToKey(identity.Key, &rtm->rtm_dst_len, sizeof(rtm->rtm_dst_len));
+   appendToKey(identity.Key, &rtm->rtm_src_len, sizeof(rtm->rtm_src_len));
+   appendToKey(identity.Key, &rtm->rtm_tos,     sizeof(rtm->rtm_tos));
+   appendToKey(identity.Key, &priority,         sizeof(priority));
+   appendToKey(identity.Key, &oif,              sizeof(oif));
+   appendToKey(identity.Key, (dst != nullptr) ? dst : zero, addressLength);
+   appendToKey(identity.Key, (src != nullptr) ? src : zero, addressLength);
+
+   identity.Digest = computeHash(identity.Key.data(), identity.Key.size());
+   identity.Digest = computeHash(&rtm->rtm_type, sizeof(rtm->rtm_type), identity.Digest);
+   identity.Digest = computeHash(&rtm->rtm_protocol, sizeof(rtm->rtm_protocol), identity.Digest);
+   identity.Digest = computeHash((gateway != nullptr) ? gateway : zero,
+                                 addressLength, identity.Digest);
+   identity.Digest = computeHash(&nexthop, sizeof(nexthop), identity.Digest);
+   if(multipath != nullptr) {
+      for(const MultipathLeg& leg : getMultipathLegs(multipath)) {
+         identity.Digest = computeHash(&leg.OIF, sizeof(leg.OIF), identity.Digest);
+         identity.Digest = computeHash(&leg.Weight, sizeof(leg.Weight), identity.Digest);
+         identity.Digest = computeHash((leg.Gateway != nullptr) ? leg.Gateway : (const uint8_t*)zero,
+                                       addressLength, identity.Digest);
+      }
+   }
+   return true;
+}
+
+
+// ###### Get identity of a rule ############################################
+static bool getRuleIdentity(const nlmsghdr* message, ObjectIdentity& identity)
+{
+   const fib_rule_hdr* frh = (const fib_rule_hdr*)NLMSG_DATA(message);
+   if( (message->nlmsg_len < NLMSG_LENGTH(sizeof(*frh))) ||
+       ( (frh->family != AF_INET) && (frh->family != AF_INET6) ) ) {
+      return false;
+   }
+   const unsigned int addressLength = getAddressLength(frh->family);
+
+   // ====== Parse attributes ===============================================
+   unsigned int       table    = frh->table;
+   uint32_t           priority = 0;
+   uint32_t           fwmark   = 0;
+   uint32_t           fwmask   = 0;
+   fib_rule_uid_range uidRange = { 0, 0 };
+   uint8_t            protocol = RTPROT_UNSPEC;
+   const char*        dst      = nullptr;
+   const char*        src      = nullptr;
+   const char*        iifName  = "";
+   unsigned int       length   = message->nlmsg_len - NLMSG_LENGTH(sizeof(*frh));
    for(const rtattr* rta = (const rtattr*)((char*)frh + NLMSG_ALIGN(sizeof(fib_rule_hdr)));
        RTA_OK(rta, length); rta = RTA_NEXT(rta, length)) {
       switch(rta->rta_type) {
          case FRA_TABLE:
-            tablePtr = (unsigned int*)RTA_DATA(rta);
+            table = *(const uint32_t*)RTA_DATA(rta);
           break;
          case FRA_PRIORITY:
-            priority = *(unsigned int*)RTA_DATA(rta);
+            priority = *(const uint32_t*)RTA_DATA(rta);
+          break;
+         case FRA_FWMARK:
+            fwmark = *(const uint32_t*)RTA_DATA(rta);
+          break;
+         case FRA_FWMASK:
+            fwmask = *(const uint32_t*)RTA_DATA(rta);
+          break;
+         case FRA_UID_RANGE:
+            memcpy(&uidRange, RTA_DATA(rta), sizeof(uidRange));
+          break;
+         case FRA_PROTOCOL:
+            protocol = *(const uint8_t*)RTA_DATA(rta);
+          break;
+         case FRA_DST:
+            dst = (const char*)RTA_DATA(rta);
+          break;
+         case FRA_SRC:
+            src = (const char*)RTA_DATA(rta);
+          break;
+         case FRA_IIFNAME:
+            iifName = (const char*)RTA_DATA(rta);
           break;
       }
    }
-   assure(tablePtr != nullptr);
 
+   // ====== Build key and digest ===========================================
+   static const char zero[16] = { };
+   identity.Family   = frh->family;
+   identity.Protocol = protocol;
+   identity.Table    = table;
+   identity.OIF      = -1;
+   identity.Key.clear();
+   appendToKey(identity.Key, &frh->family,  sizeof(frh->family));
+   appendToKey(identity.Key, &protocol,     sizeof(protocol));
+   appendToKey(identity.Key, &table,        sizeof(table));
+   appendToKey(identity.Key, &frh->action,  sizeof(frh->action));
+   appendToKey(identity.Key, &frh->dst_len, sizeof(frh->dst_len));
+   appendToKey(identity.Key, &frh->src_len, sizeof(frh->src_len));
+   appendToKey(identity.Key, &priority,     sizeof(priority));
+   appendToKey(identity.Key, &fwmark,       sizeof(fwmark));
+   appendToKey(identity.Key, &fwmask,       sizeof(fwmask));
+   appendToKey(identity.Key, &uidRange,     sizeof(uidRange));
+   appendToKey(identity.Key, (dst != nullptr) ? dst : zero, addressLength);
+   appendToKey(identity.Key, (src != nullptr) ? src : zero, addressLength);
+   appendToKey(identity.Key, iifName,       strnlen(iifName, IFNAMSIZ));
 
-   // ====== Show status ====================================================
-   DMHS_LOG(trace) << boost::format("Rule event: event=%s: table=%u priority=%u")
-                         % eventName
-                         % *tablePtr
-                         % priority;
+   identity.Digest = computeHash(identity.Key.data(), identity.Key.size());
+   return true;
+}
 
 
-   // ====== Check whether a removal of the rule is necessary ===============
-   bool removalNecessary = false;
-   if( (Mode == Reset) && (tablePtr != nullptr) ) {
-      // ------ Check if entry belongs to custom table in the InterfaceMap --
-      for(auto iterator = InterfaceMap.begin(); iterator != InterfaceMap.end(); iterator++) {
-         const unsigned int customTable = iterator->second;
-         if(*tablePtr == customTable) {
-            DMHS_LOG(info) << "Removing rule for table " << customTable << " ...";
-            removalNecessary = true;
-            break;
+// ###### Queue copy of a Netlink message ###################################
+static void queueMessage(const nlmsghdr* message,
+                         const uint16_t  type,
+                         const uint16_t  flags)
+{
+   nlmsghdr* request = (nlmsghdr*)new char[message->nlmsg_len];
+   assure(request != nullptr);
+   memcpy(request, message, message->nlmsg_len);
+
+   request->nlmsg_type  = type;
+   request->nlmsg_flags = flags;
+   request->nlmsg_pid   = 0;  // This field is opaque to netlink.
+   request->nlmsg_seq   = ++SeqNumber;
+
+   RequestQueue.push(std::pair<const nlmsghdr*, size_t>(
+      request, request->nlmsg_len));
+   DMHS_LOG(trace) << "Request seqnum " << SeqNumber;
+}
+
+
+// ###### Get journal key of an object ######################################
+static std::string getJournalKey(const uint16_t type, const std::string& key)
+{
+   const bool isRoute = (type == RTM_NEWROUTE) || (type == RTM_DELROUTE);
+   return std::string(isRoute ? "r" : "u") + key;
+}
+
+
+// ###### Get flags for installing an object ################################
+static uint16_t getInstallFlags(const uint16_t type)
+{
+   // Routes are replaced, to also correct a stale entry with the same key.
+   // Rules have no replace semantics, i.e. NLM_F_EXCL avoids duplicates.
+   return (type == RTM_NEWROUTE) ?
+             NLM_F_REQUEST | NLM_F_CREATE | NLM_F_REPLACE | NLM_F_ACK :
+             NLM_F_REQUEST | NLM_F_CREATE | NLM_F_EXCL    | NLM_F_ACK;
+}
+
+
+// ###### Install object, if not already installed ##########################
+static bool installObject(ObjectSet&            objectSet,
+                          const ObjectIdentity& identity,
+                          const nlmsghdr*       message,
+                          const uint16_t        type)
+{
+   const auto found = objectSet.Objects.find(identity.Key);
+   if(found != objectSet.Objects.end()) {
+      if(found->second.Digest == identity.Digest) {
+         return false;   // Already installed
+      }
+      objectSet.Digest ^= found->second.Digest;
+   }
+
+   KernelObject& object = objectSet.Objects[identity.Key];
+   object.Message.assign((const char*)message, (const char*)message + message->nlmsg_len);
+   object.Digest     = identity.Digest;
+   objectSet.Digest ^= identity.Digest;
+   OwnershipJournal.add(getJournalKey(type, identity.Key), message, message->nlmsg_len);
+
+   // ====== Adopt an identical object left in place by a warm restart ======
+   const auto adoptable = objectSet.Adoptable.find(identity.Key);
+   if(adoptable != objectSet.Adoptable.end()) {
+      const bool identical = (adoptable->second.Digest == identity.Digest);
+      objectSet.Adoptable.erase(adoptable);
+      if(identical) {
+         return false;
+      }
+   }
+
+   queueMessage(message, type, getInstallFlags(type));
+   return true;
+}
+
+
+// ###### Withdraw object, if installed #####################################
+static bool withdrawObject(ObjectSet&         objectSet,
+                           const std::string& key,
+                           const uint16_t     type)
+{
+   const auto found = objectSet.Objects.find(key);
+   if(found == objectSet.Objects.end()) {
+      return false;
+   }
+   queueMessage((const nlmsghdr*)found->second.Message.data(), type,
+                NLM_F_REQUEST | NLM_F_ACK);
+   OwnershipJournal.remove(getJournalKey(type, key));
+   objectSet.Digest ^= found->second.Digest;
+   objectSet.Objects.erase(found);
+   return true;
+}
+
+
+// ###### Forget object, if installed #######################################
+/* For an object the kernel has removed already: its record is dropped,
+ * without request. */
+static bool forgetObject(ObjectSet&         objectSet,
+                         const std::string& key,
+                         const uint16_t     type)
+{
+   const auto found = objectSet.Objects.find(key);
+   if(found == objectSet.Objects.end()) {
+      return false;
+   }
+   OwnershipJournal.remove(getJournalKey(type, key));
+   objectSet.Digest ^= found->second.Digest;
+   objectSet.Objects.erase(found);
+   return true;
+}
+
+
+// ###### Get the key of a lifetime timer ###################################
+static std::string getLifetimeKey(const LifetimeType type, const std::string& key)
+{
+   return std::string(1, (char)type) + key;
+}
+
+
+// ###### Get the remaining lifetime of a route #############################
+/* Dumps and notifications carry the remaining lifetime of a route learned
+ * from a router advertisement in RTA_CACHEINFO, in clock ticks. It is
+ * negative for an expired route that has not been collected yet. Returns
+ * the lifetime in ms, or 0 for a route without lifetime. */
+static long long getRouteLifetime(const nlmsghdr* message)
+{
+   static const long ticksPerSecond = sysconf(_SC_CLK_TCK);
+   const rtmsg*      rtm    = (const rtmsg*)NLMSG_DATA(message);
+   int               length = message->nlmsg_len - NLMSG_LENGTH(sizeof(*rtm));
+   for(const rtattr* rta = RTM_RTA(rtm); RTA_OK(rta, length); rta = RTA_NEXT(rta, length)) {
+      if( (rta->rta_type == RTA_CACHEINFO) &&
+          (RTA_PAYLOAD(rta) >= sizeof(rta_cacheinfo)) ) {
+         const long long expires = ((const rta_cacheinfo*)RTA_DATA(rta))->rta_expires;
+         return (expires * 1000) / ticksPerSecond;
+      }
+   }
+   return 0;
+}
+
+
+// ###### Clone route into a custom table ###################################
+/* If nexthop is set, the clone references this nexthop object instead of
+ * its own interface and gateway(s). A route referencing a nexthop object
+ * keeps it, so that the clone shares the nexthop object with the main
+ * table route. */
+static void cloneRoute(const nlmsghdr*    message,
+                       const unsigned int customTable,
+                       std::vector<char>& clone,
+                       uint32_t           nexthop = 0)
+{
+   const rtmsg* source = (const rtmsg*)NLMSG_DATA(message);
+   clone.assign(NLMSG_ALIGN(message->nlmsg_len) + 2 * RTA_SPACE(sizeof(uint32_t)), 0);
+   nlmsghdr* header = (nlmsghdr*)clone.data();
+   memcpy(header, message, NLMSG_LENGTH(sizeof(*source)));
+   header->nlmsg_len = NLMSG_LENGTH(sizeof(*source));
+
+   rtmsg* rtm       = (rtmsg*)NLMSG_DATA(header);
+   rtm->rtm_table   = (customTable < 256) ? customTable : RT_TABLE_UNSPEC;
+   rtm->rtm_flags  &= ~(RTNH_F_DEAD | RTNH_F_LINKDOWN);   // Kernel state, rejected
+   if(Protocol != RTPROT_UNSPEC) {
+      rtm->rtm_protocol = Protocol;   // Tag the route as owned by DynMHS
+   }
+
+   // ====== Copy the attributes ============================================
+   int length = message->nlmsg_len - NLMSG_LENGTH(sizeof(*source));
+   for(const rtattr* rta = RTM_RTA(source); RTA_OK(rta, length); rta = RTA_NEXT(rta, length)) {
+      if(rta->rta_type == RTA_NH_ID) {
+         if(nexthop == 0) {
+            nexthop = *(const uint32_t*)RTA_DATA(rta);
          }
+         continue;
+      }
+      if( (rta->rta_type == RTA_TABLE) ||
+          (rta->rta_type == RTA_OIF)   || (rta->rta_type == RTA_GATEWAY) ||
+          (rta->rta_type == RTA_VIA)   || (rta->rta_type == RTA_MULTIPATH) ) {
+         continue;   // Added below
       }
+      if( (rta->rta_type == RTA_CACHEINFO) || (rta->rta_type == RTA_EXPIRES) ) {
+         continue;   // The lifetime is tracked by LifetimeWheel
+      }
+      assure( addattr(header, clone.size(), rta->rta_type,
+                      RTA_DATA(rta), RTA_PAYLOAD(rta)) == 0 );
    }
+   assure( addattr(header, clone.size(), RTA_TABLE,
+                   &customTable, sizeof(uint32_t)) == 0 );   // <<-- clone entry into custom table
 
-   // ====== Apply removal ==================================================
-   if(removalNecessary) {
-      // ------ Copy the message and enqueue it for sending it later -----
-      nlmsghdr* updateMessage = (nlmsghdr*)new char[messageLength];
-      assure(updateMessage != nullptr);
-      memcpy(updateMessage, message, messageLength);
+   // ====== Next hop: nexthop object, or interface and gateway(s) ==========
+   if(nexthop != 0) {
+      assure( addattr(header, clone.size(), RTA_NH_ID,
+                      &nexthop, sizeof(uint32_t)) == 0 );
+   }
+   else {
+      length = message->nlmsg_len - NLMSG_LENGTH(sizeof(*source));
+      for(const rtattr* rta = RTM_RTA(source); RTA_OK(rta, length); rta = RTA_NEXT(rta, length)) {
+         if( (rta->rta_type == RTA_OIF)   || (rta->rta_type == RTA_GATEWAY) ||
+             (rta->rta_type == RTA_VIA)   || (rta->rta_type == RTA_MULTIPATH) ) {
+            rtattr* copy = NLMSG_TAIL(header);
+            assure( addattr(header, clone.size(), rta->rta_type,
+                            RTA_DATA(rta), RTA_PAYLOAD(rta)) == 0 );
+            if(rta->rta_type == RTA_MULTIPATH) {
+               int legsLength = RTA_PAYLOAD(copy);
+               for(rtnexthop* rtnh = (rtnexthop*)RTA_DATA(copy); RTNH_OK(rtnh, legsLength);
+                   legsLength -= NLMSG_ALIGN(rtnh->rtnh_len), rtnh = RTNH_NEXT(rtnh)) {
+                  rtnh->rtnh_flags &= ~(RTNH_F_DEAD | RTNH_F_LINKDOWN);
+               }
+            }
+         }
+      }
+   }
+}
 
-      updateMessage->nlmsg_type  = RTM_DELRULE;
-      updateMessage->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
-      updateMessage->nlmsg_seq   = ++SeqNumber;
 
-      RequestQueue.push(std::pair<const nlmsghdr*, size_t>(
-         updateMessage, messageLength));
-      DMHS_LOG(trace) << "Request seqnum " << SeqNumber;
+// ###### Get the interface of a nexthop object #############################
+/* For a group, all members have to use the same interface. Otherwise, the
+ * nexthop object does not belong to a single custom table. */
+static int getNexthopOIF(const uint32_t id)
+{
+   const auto found = Nexthops.find(id);
+   if(found == Nexthops.end()) {
+      return -1;
+   }
+   if(found->second.Members.empty()) {
+      return found->second.OIF;
+   }
+   int oif = -1;
+   for(const uint32_t member : found->second.Members) {
+      const auto memberNexthop = Nexthops.find(member);
+      if( (memberNexthop == Nexthops.end()) ||
+          (memberNexthop->second.OIF < 0) ||
+          ( (oif >= 0) && (memberNexthop->second.OIF != oif) ) ) {
+         return -1;
+      }
+      oif = memberNexthop->second.OIF;
    }
+   return oif;
 }
 
 
-// ###### Send simple Netlink request #######################################
-static void queueSimpleNetlinkRequest(const int type)
+// ###### Get the nexthop object ID of a route ##############################
+static uint32_t getRouteNexthopID(const nlmsghdr* message)
 {
-   struct _request {
-      nlmsghdr header;
-      rtgenmsg msg;
-   };
-   _request* request = (_request*)new char[sizeof(*request)];
-   assure(request != nullptr);
-   memset(request, 0, sizeof(*request));
+   const rtmsg* rtm    = (const rtmsg*)NLMSG_DATA(message);
+   int          length = message->nlmsg_len - NLMSG_LENGTH(sizeof(*rtm));
+   for(const rtattr* rta = RTM_RTA(rtm); RTA_OK(rta, length); rta = RTA_NEXT(rta, length)) {
+      if(rta->rta_type == RTA_NH_ID) {
+         return *(const uint32_t*)RTA_DATA(rta);
+      }
+   }
+   return 0;
+}
 
-   request->header.nlmsg_len   = NLMSG_LENGTH(sizeof(request->msg));
-   request->header.nlmsg_type  = type;
-   request->header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP | NLM_F_ACK;
-   request->header.nlmsg_pid   = 0;  // This field is opaque to netlink.
-   request->header.nlmsg_seq   = ++SeqNumber;
-   request->msg.rtgen_family   = AF_UNSPEC;
 
-   RequestQueue.push(std::pair<const nlmsghdr*, size_t>(
-      &request->header, request->header.nlmsg_len));
-   DMHS_LOG(trace) << "Request seqnum " << SeqNumber;
+// ###### Get the key of an owned nexthop object ############################
+static std::string getNexthopKey(const uint8_t                                    family,
+                                 const int                                        oif,
+                                 const uint8_t*                                   gateway,
+                                 const std::vector<std::pair<uint32_t, uint8_t>>& members)
+{
+   // A group has no family of its own (as reported by the kernel)
+   const uint8_t keyFamily = (members.empty()) ? family : AF_UNSPEC;
+   std::string   key;
+   appendToKey(key, &keyFamily, sizeof(keyFamily));
+   if(members.empty()) {
+      appendToKey(key, &oif, sizeof(oif));
+      appendToKey(key, gateway, getAddressLength(family));
+   }
+   for(const std::pair<uint32_t, uint8_t>& member : members) {
+      appendToKey(key, &member.first, sizeof(member.first));
+      appendToKey(key, &member.second, sizeof(member.second));
+   }
+   return key;
 }
 
 
-// ###### Send queued Netlink requests ######################################
-static bool sendQueuedRequests(const int sd)
+// ###### Get the outgoing interface of a route #############################
+/* A multipath route, or a route referencing a nexthop object, has an
+ * outgoing interface if all of its next hops use the same interface. */
+static int getRouteOIF(const nlmsghdr* message)
 {
-   while(!RequestQueue.empty()) {
-      // ------ Send queued Netlink request ---------------------------------
-      std::pair<const nlmsghdr*, size_t>& command = RequestQueue.front();
-      const nlmsghdr* message       = command.first;
-      const size_t    messageLength = command.second;
-      sockaddr_nl sa { };
-      sa.nl_family = AF_NETLINK;
-      const iovec  iov { (void*)message, messageLength };
-      const msghdr msg { .msg_name       = &sa,
-                         .msg_namelen    = sizeof(sa),
-                         .msg_iov        = (iovec*)&iov,
+   const rtmsg* rtm     = (const rtmsg*)NLMSG_DATA(message);
+   int          oif     = -1;
+   uint32_t     nexthop = 0;
+   int          length  = message->nlmsg_len - NLMSG_LENGTH(sizeof(*rtm));
+   for(const rtattr* rta = RTM_RTA(rtm); RTA_OK(rta, length); rta = RTA_NEXT(rta, length)) {
+      switch(rta->rta_type) {
+         case RTA_OIF:
+            oif = *(const int*)RTA_DATA(rta);
+          break;
+         case RTA_NH_ID:
+            nexthop = *(const uint32_t*)RTA_DATA(rta);
+          break;
+         case RTA_MULTIPATH:
+            for(const MultipathLeg& leg : getMultipathLegs(rta)) {
+               oif = ( (oif < 0) || (oif == leg.OIF) ) ? leg.OIF : 0;
+            }
+          break;
+      }
+   }
+   if(nexthop != 0) {
+      // The interface of a nexthop object is only reported in compat mode
+      const int nexthopOIF = getNexthopOIF(nexthop);
+      if(nexthopOIF > 0) {
+         oif = nexthopOIF;
+      }
+   }
+   return oif;
+}
+
+
+// ###### Check whether a route uses an interface ###########################
+static bool routeUsesInterface(const nlmsghdr* message, const int ifIndex)
+{
+   const int oif = getRouteOIF(message);
+   if(oif != 0) {
+      return (oif == ifIndex);
+   }
+   const rtmsg* rtm    = (const rtmsg*)NLMSG_DATA(message);
+   int          length = message->nlmsg_len - NLMSG_LENGTH(sizeof(*rtm));
+   for(const rtattr* rta = RTM_RTA(rtm); RTA_OK(rta, length); rta = RTA_NEXT(rta, length)) {
+      if(rta->rta_type == RTA_MULTIPATH) {
+         for(const MultipathLeg& leg : getMultipathLegs(rta)) {
+            if(leg.OIF == ifIndex) {
+               return true;
+            }
+         }
+      }
+   }
+   return false;
+}
+
+
+// ###### Allocate an ID for an owned nexthop object ########################
+static uint32_t allocateNexthopID()
+{
+   for(uint32_t i = 0; i <= NEXTHOP_ID_LAST - NEXTHOP_ID_BASE; i++) {
+      const uint32_t id = NextNexthopID;
+      NextNexthopID = (NextNexthopID < NEXTHOP_ID_LAST) ? NextNexthopID + 1 : NEXTHOP_ID_BASE;
+      if( (Nexthops.find(id) == Nexthops.end()) &&
+          (OwnedNexthopKeys.find(id) == OwnedNexthopKeys.end()) ) {
+         return id;
+      }
+   }
+   return 0;
+}
+
+
+// ###### Acquire an owned nexthop object ###################################
+/* Without members, the nexthop object is the gateway on the interface.
+ * Otherwise, it is a group of the member nexthop objects. A new group
+ * takes over the references of the caller to its members. */
+static uint32_t acquireNexthop(const uint8_t                                    family,
+                               const int                                        oif,
+                               const uint8_t*                                   gateway,
+                               const std::vector<std::pair<uint32_t, uint8_t>>& members)
+{
+   // ====== Look for an existing nexthop object ============================
+   const std::string key   = getNexthopKey(family, oif, gateway, members);
+   auto              found = OwnedNexthops.find(key);
+   if(found != OwnedNexthops.end()) {
+      found->second.References++;
+      return found->second.ID;
+   }
+   const uint32_t id = allocateNexthopID();
+   if(id == 0) {
+      DMHS_LOG(error) << "No free nexthop ID";
+      return 0;
+   }
+
+   // ====== Build RTM_NEWNEXTHOP request ===================================
+   struct _request {
+      nlmsghdr header;
+      nhmsg    nhm;
+      char     buffer[1024];
+   } request;
+   memset(&request, 0, sizeof(request));
+   request.header.nlmsg_len  = NLMSG_LENGTH(sizeof(request.nhm));
+   request.header.nlmsg_type = RTM_NEWNEXTHOP;
+   request.nhm.nh_family     = (members.empty()) ? family : AF_UNSPEC;
+   request.nhm.nh_protocol   = Protocol;
+   assure( addattr(&request.header, sizeof(request), NHA_ID,
+                   &id, sizeof(uint32_t)) == 0 );
+   if(members.empty()) {
+      assure( addattr(&request.header, sizeof(request), NHA_OIF,
+                      &oif, sizeof(uint32_t)) == 0 );
+      assure( addattr(&request.header, sizeof(request), NHA_GATEWAY,
+                      gateway, getAddressLength(family)) == 0 );
+   }
+   else {
+      std::vector<nexthop_grp> group;
+      for(const std::pair<uint32_t, uint8_t>& member : members) {
+         nexthop_grp entry;
+         memset(&entry, 0, sizeof(entry));
+         entry.id     = member.first;
+         entry.weight = member.second;
+         group.push_back(entry);
+      }
+      assure( addattr(&request.header, sizeof(request), NHA_GROUP,
+                      group.data(), group.size() * sizeof(nexthop_grp)) == 0 );
+   }
+   queueMessage(&request.header, RTM_NEWNEXTHOP,
+                NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE | NLM_F_REPLACE);
+
+   OwnedNexthop& nexthop = OwnedNexthops[key];
+   nexthop.ID         = id;
+   nexthop.References = 1;
+   nexthop.Members    = members;
+   OwnedNexthopKeys[id] = key;
+   DMHS_LOG(debug) << "Adding nexthop " << id << " ...";
+   return id;
+}
+
+
+// ###### Release an owned nexthop object ###################################
+static void releaseNexthop(const uint32_t id)
+{
+   const auto key = OwnedNexthopKeys.find(id);
+   if(key == OwnedNexthopKeys.end()) {
+      return;
+   }
+   auto found = OwnedNexthops.find(key->second);
+   assure(found != OwnedNexthops.end());
+   if( (found->second.References > 0) && (--found->second.References > 0) ) {
+      return;
+   }
+
+   // ====== Remove the nexthop object, then release the group members ======
+   /* The routes referencing the nexthop object have been withdrawn before,
+    * i.e. their removal is queued before this request. */
+   DMHS_LOG(debug) << "Removing nexthop " << id << " ...";
+   struct _request {
+      nlmsghdr header;
+      nhmsg    nhm;
+      char     buffer[64];
+   } request;
+   memset(&request, 0, sizeof(request));
+   request.header.nlmsg_len = NLMSG_LENGTH(sizeof(request.nhm));
+   assure( addattr(&request.header, sizeof(request), NHA_ID,
+                   &id, sizeof(uint32_t)) == 0 );
+   queueMessage(&request.header, RTM_DELNEXTHOP, NLM_F_REQUEST | NLM_F_ACK);
+
+   const std::vector<std::pair<uint32_t, uint8_t>> members = found->second.Members;
+   OwnedNexthops.erase(found);
+   OwnedNexthopKeys.erase(key);
+   for(const std::pair<uint32_t, uint8_t>& member : members) {
+      releaseNexthop(member.first);
+   }
+}
+
+
+// ###### Acquire an owned nexthop object for a route #######################
+/* Returns 0, if the route is not a gateway route (or a multipath route
+ * over gateways), or if it already references a nexthop object. */
+static uint32_t acquireRouteNexthop(const nlmsghdr* message)
+{
+   const rtmsg*   rtm       = (const rtmsg*)NLMSG_DATA(message);
+   const uint8_t* gateway   = nullptr;
+   const rtattr*  multipath = nullptr;
+   int            oif       = -1;
+   int            length    = message->nlmsg_len - NLMSG_LENGTH(sizeof(*rtm));
+   for(const rtattr* rta = RTM_RTA(rtm); RTA_OK(rta, length); rta = RTA_NEXT(rta, length)) {
+      switch(rta->rta_type) {
+         case RTA_NH_ID:
+            return 0;
+         case RTA_GATEWAY:
+            gateway = (const uint8_t*)RTA_DATA(rta);
+          break;
+         case RTA_OIF:
+            oif = *(const int*)RTA_DATA(rta);
+          break;
+         case RTA_MULTIPATH:
+            multipath = rta;
+          break;
+      }
+   }
+
+   // ====== Single gateway =================================================
+   if( (gateway != nullptr) && (oif > 0) ) {
+      return acquireNexthop(rtm->rtm_family, oif, gateway,
+                            std::vector<std::pair<uint32_t, uint8_t>>());
+   }
+
+   // ====== Group of gateways ==============================================
+   if(multipath != nullptr) {
+      std::vector<std::pair<uint32_t, uint8_t>> members;
+      for(const MultipathLeg& leg : getMultipathLegs(multipath)) {
+         const uint32_t member = (leg.Gateway != nullptr) ?
+            acquireNexthop(rtm->rtm_family, leg.OIF, leg.Gateway,
+                           std::vector<std::pair<uint32_t, uint8_t>>()) : 0;
+         if(member == 0) {
+            for(const std::pair<uint32_t, uint8_t>& acquired : members) {
+               releaseNexthop(acquired.first);
+            }
+            return 0;
+         }
+         members.push_back(std::pair<uint32_t, uint8_t>(member, leg.Weight));
+      }
+      if(members.empty()) {
+         return 0;
+      }
+      const size_t   created = OwnedNexthops.size();
+      const uint32_t id      = acquireNexthop(rtm->rtm_family, -1, nullptr, members);
+      if( (id == 0) || (OwnedNexthops.size() == created) ) {
+         // The group already exists, and holds its own member references.
+         for(const std::pair<uint32_t, uint8_t>& member : members) {
+            releaseNexthop(member.first);
+         }
+      }
+      return id;
+   }
+   return 0;
+}
+
+
+// ###### Get the signature of a route, i.e. all but its destination ########
+static uint64_t getRouteSignature(const nlmsghdr* message)
+{
+   const rtmsg* rtm       = (const rtmsg*)NLMSG_DATA(message);
+   rtmsg        header    = *rtm;
+   header.rtm_dst_len     = 0;
+   uint64_t     signature = computeHash(&header, sizeof(header));
+   int          length    = message->nlmsg_len - NLMSG_LENGTH(sizeof(*rtm));
+   for(const rtattr* rta = RTM_RTA(rtm); RTA_OK(rta, length); rta = RTA_NEXT(rta, length)) {
+      if(rta->rta_type != RTA_DST) {
+         signature = computeHash(rta, rta->rta_len, signature);
+      }
+   }
+   return signature;
+}
+
+
+// ###### Update the state of an aggregation node ###########################
+/* Returns true, if the state has changed. */
+static bool updateAggregationNode(AggregationTrie& trie, const uint32_t index)
+{
+   AggregationNode& node      = trie.Nodes[index];
+   const bool       opaque    = node.Opaque;
+   const bool       effective = node.Effective;
+   const bool       merged    = node.Merged;
+   const uint64_t   signature = node.Signature;
+
+   node.Opaque    = false;
+   node.Effective = false;
+   node.Merged    = false;
+   if( (node.Routes.size() == 1) && (node.Routes.begin()->second.Aggregatable) ) {
+      node.Effective = true;
+      node.Signature = node.Routes.begin()->second.Signature;
+   }
+   else if(!node.Routes.empty()) {
+      node.Opaque = true;
+   }
+   else if( (node.Child[0] != 0) && (node.Child[1] != 0) ) {
+      const AggregationNode& child0 = trie.Nodes[node.Child[0]];
+      const AggregationNode& child1 = trie.Nodes[node.Child[1]];
+      if( (child0.Effective) && (child1.Effective) &&
+          (child0.Signature == child1.Signature) ) {
+         node.Effective = true;
+         node.Merged    = true;
+         node.Signature = child0.Signature;
+      }
+   }
+   return (node.Opaque != opaque) || (node.Effective != effective) ||
+          (node.Merged != merged) ||
+          ( (node.Effective) && (node.Signature != signature) );
+}
+
+
+// ###### Build the route of a merged aggregation node ######################
+/* The route is a copy of a route below, with the prefix of the node. */
+static void buildAggregateRoute(const AggregationTrie& trie,
+                                const uint32_t         index,
+                                std::vector<char>&     route)
+{
+   uint32_t representative = index;
+   while(trie.Nodes[representative].Merged) {
+      representative = trie.Nodes[representative].Child[0];
+   }
+   const nlmsghdr* source =
+      (const nlmsghdr*)trie.Nodes[representative].Routes.begin()->second.Message.data();
+   const rtmsg*    sourceRTM = (const rtmsg*)NLMSG_DATA(source);
+   const AggregationNode& node = trie.Nodes[index];
+
+   route.assign(NLMSG_ALIGN(source->nlmsg_len) + RTA_SPACE(16), 0);
+   nlmsghdr* header = (nlmsghdr*)route.data();
+   memcpy(header, source, NLMSG_LENGTH(sizeof(*sourceRTM)));
+   header->nlmsg_len = NLMSG_LENGTH(sizeof(*sourceRTM));
+   ((rtmsg*)NLMSG_DATA(header))->rtm_dst_len = node.Length;
+   int length = source->nlmsg_len - NLMSG_LENGTH(sizeof(*sourceRTM));
+   for(const rtattr* rta = RTM_RTA(sourceRTM); RTA_OK(rta, length); rta = RTA_NEXT(rta, length)) {
+      if(rta->rta_type != RTA_DST) {
+         assure( addattr(header, route.size(), rta->rta_type,
+                         RTA_DATA(rta), RTA_PAYLOAD(rta)) == 0 );
+      }
+   }
+   if(node.Length > 0) {
+      assure( addattr(header, route.size(), RTA_DST,
+                      node.Prefix, getAddressLength(sourceRTM->rtm_family)) == 0 );
+   }
+}
+
+
+// ###### Install the routes of an aggregation subtree ######################
+/* inherited is the signature of the nearest covering route, if covered is
+ * set. Below an opaque node, no route is left out. */
+static void emitAggregation(const uint8_t      family,
+                            const unsigned int table,
+                            AggregationTrie&   trie,
+                            const uint32_t     index,
+                            bool               covered,
+                            uint64_t           inherited)
+{
+   ObjectSet&               routeSet = RouteSets[std::pair<uint8_t, unsigned int>(family, table)];
+   std::vector<std::string> output;
+   AggregationNode&         node     = trie.Nodes[index];
+
+   // ====== Find the routes of this node ===================================
+   std::vector<const nlmsghdr*> routes;
+   std::vector<char>            aggregate;
+   if(node.Opaque) {
+      for(auto iterator = node.Routes.begin(); iterator != node.Routes.end(); iterator++) {
+         routes.push_back((const nlmsghdr*)iterator->second.Message.data());
+      }
+      covered = false;
+   }
+   else if(node.Effective) {
+      if( (!covered) || (inherited != node.Signature) ) {
+         if(node.Merged) {
+            buildAggregateRoute(trie, index, aggregate);
+            routes.push_back((const nlmsghdr*)aggregate.data());
+         }
+         else {
+            routes.push_back((const nlmsghdr*)node.Routes.begin()->second.Message.data());
+         }
+      }
+      covered   = true;
+      inherited = node.Signature;
+   }
+   std::vector<ObjectIdentity> identities(routes.size());
+   for(unsigned int i = 0; i < routes.size(); i++) {
+      assure(getRouteIdentity(routes[i], identities[i]));
+      output.push_back(identities[i].Key);
+   }
+
+   // ====== Withdraw the routes that are not necessary any more ============
+   /* This has to precede the installation, see updateSourceRoute(). */
+   for(const std::string& key : node.Output) {
+      if(std::find(output.begin(), output.end(), key) == output.end()) {
+         withdrawObject(routeSet, key, RTM_DELROUTE);
+      }
+   }
+   node.Output.swap(output);
+
+   // ====== Install the routes of this node ================================
+   for(unsigned int i = 0; i < routes.size(); i++) {
+      installObject(routeSet, identities[i], routes[i], RTM_NEWROUTE);
+   }
+
+   // ====== Handle the subtree =============================================
+   for(unsigned int i = 0; i < 2; i++) {
+      const uint32_t child = trie.Nodes[index].Child[i];
+      if(child != 0) {
+         emitAggregation(family, table, trie, child, covered, inherited);
+      }
+   }
+}
+
+
+// ###### Prune an empty aggregation branch #################################
+/* Frees the node and its ancestors, as long as they have neither routes
+ * nor children. Their installed routes have been withdrawn already by
+ * emitAggregation(). Returns the number of freed nodes. */
+static unsigned int pruneAggregationBranch(AggregationTrie& trie, uint32_t index)
+{
+   unsigned int pruned = 0;
+   while( (index != 0) && (!trie.Nodes[index].Free) ) {
+      AggregationNode& node = trie.Nodes[index];
+      if( (!node.Routes.empty()) || (!node.Output.empty()) ||
+          (node.Child[0] != 0) || (node.Child[1] != 0) ) {
+         break;
+      }
+      AggregationNode& parent = trie.Nodes[node.Parent];
+      parent.Child[(parent.Child[0] == index) ? 0 : 1] = 0;
+      std::vector<std::string>().swap(node.Output);
+      node.Free = true;
+      trie.FreeNodes.push_back(index);
+      pruned++;
+      index = node.Parent;
+   }
+   return pruned;
+}
+
+
+// ###### Update the routes of the changed aggregation tries ################
+static void updateAggregation()
+{
+   for(auto iterator = AggregationTries.begin(); iterator != AggregationTries.end(); iterator++) {
+      AggregationTrie& trie = iterator->second;
+      if(trie.DirtyNodes.empty()) {
+         continue;
+      }
+
+      // ====== Update the states, find the highest changed nodes ===========
+      std::set<uint32_t> roots;
+      for(const uint32_t dirty : trie.DirtyNodes) {
+         uint32_t root  = dirty;
+         uint32_t index = dirty;
+         bool     changed = updateAggregationNode(trie, index);
+         while( (changed) && (index != 0) ) {
+            index   = trie.Nodes[index].Parent;
+            changed = updateAggregationNode(trie, index);
+            if(changed) {
+               root = index;
+            }
+         }
+         roots.insert(root);
+      }
+      std::set<uint32_t> dirtyNodes;
+      dirtyNodes.swap(trie.DirtyNodes);
+
+      // ====== Install the routes below the changed nodes ==================
+      for(const uint32_t root : roots) {
+         bool     nested    = false;
+         bool     found     = false;
+         bool     covered   = false;
+         uint64_t inherited = 0;
+         for(uint32_t index = root; index != 0; ) {
+            index = trie.Nodes[index].Parent;
+            if(roots.find(index) != roots.end()) {
+               nested = true;   // Handled with the enclosing subtree
+               break;
+            }
+            const AggregationNode& ancestor = trie.Nodes[index];
+            if( (!found) && ( (ancestor.Opaque) || (ancestor.Effective) ) ) {
+               found     = true;   // Nearest covering route
+               covered   = ancestor.Effective;
+               inherited = ancestor.Signature;
+            }
+         }
+         if(!nested) {
+            emitAggregation(iterator->first.first, iterator->first.second,
+                            trie, root, covered, inherited);
+         }
+      }
+
+      // ====== Prune the branches without routes ===========================
+      unsigned int pruned = 0;
+      for(const uint32_t dirty : dirtyNodes) {
+         pruned += pruneAggregationBranch(trie, dirty);
+      }
+      if(pruned > 0) {
+         DMHS_LOG(debug) << boost::format("Aggregation trie of table %u (IPv%u): "
+                                          "pruned %u nodes, %u of %u nodes in use")
+                               % iterator->first.second
+                               % ((iterator->first.first == AF_INET) ? 4 : 6) % pruned
+                               % (trie.Nodes.size() - trie.FreeNodes.size())
+                               % trie.Nodes.size();
+      }
+   }
+
+   // ====== Release the nexthop objects of withdrawn clones ================
+   /* The routes referencing them are withdrawn now. */
+   for(const uint32_t nexthop : PendingNexthopReleases) {
+      releaseNexthop(nexthop);
+   }
+   PendingNexthopReleases.clear();
+}
+
+
+// ###### Install the clone of a main table route ###########################
+/* Returns true, if the clone has changed. */
+static bool installClone(const uint8_t         family,
+                         const unsigned int    table,
+                         const ObjectIdentity& identity,
+                         const nlmsghdr*       message)
+{
+   if(!Aggregate) {
+      return installObject(RouteSets[std::pair<uint8_t, unsigned int>(family, table)],
+                           identity, message, RTM_NEWROUTE);
+   }
+
+   // ====== Find or create the node of the prefix ==========================
+   const rtmsg*     rtm  = (const rtmsg*)NLMSG_DATA(message);
+   AggregationTrie& trie = AggregationTries[std::pair<uint8_t, unsigned int>(family, table)];
+   if(trie.Nodes.empty()) {
+      trie.Nodes.resize(1);   // Root
+      memset(trie.Nodes[0].Child, 0, sizeof(trie.Nodes[0].Child));
+      memset(trie.Nodes[0].Prefix, 0, sizeof(trie.Nodes[0].Prefix));
+      trie.Nodes[0].Parent    = 0;
+      trie.Nodes[0].Length    = 0;
+      trie.Nodes[0].Opaque    = false;
+      trie.Nodes[0].Effective = false;
+      trie.Nodes[0].Merged    = false;
+      trie.Nodes[0].Signature = 0;
+      trie.Nodes[0].Free      = false;
+   }
+   static const uint8_t zero[16] = { };
+   const uint8_t*       dst      = zero;
+   int                  length   = message->nlmsg_len - NLMSG_LENGTH(sizeof(*rtm));
+   for(const rtattr* rta = RTM_RTA(rtm); RTA_OK(rta, length); rta = RTA_NEXT(rta, length)) {
+      if(rta->rta_type == RTA_DST) {
+         dst = (const uint8_t*)RTA_DATA(rta);
+      }
+   }
+   uint32_t index = 0;
+   for(unsigned int i = 0; i < rtm->rtm_dst_len; i++) {
+      const unsigned int bit = (dst[i / 8] >> (7 - (i % 8))) & 1;
+      if(trie.Nodes[index].Child[bit] == 0) {
+         uint32_t childIndex;
+         if(!trie.FreeNodes.empty()) {
+            childIndex = trie.FreeNodes.back();   // Reuse a pruned node
+            trie.FreeNodes.pop_back();
+         }
+         else {
+            childIndex = trie.Nodes.size();
+            trie.Nodes.resize(childIndex + 1);
+         }
+         AggregationNode& child = trie.Nodes[childIndex];
+         memset(child.Child, 0, sizeof(child.Child));
+         memcpy(child.Prefix, trie.Nodes[index].Prefix, sizeof(child.Prefix));
+         child.Prefix[i / 8] |= (uint8_t)(bit << (7 - (i % 8)));
+         child.Parent    = index;
+         child.Length    = i + 1;
+         child.Opaque    = false;
+         child.Effective = false;
+         child.Merged    = false;
+         child.Signature = 0;
+         child.Free      = false;
+         trie.Nodes[index].Child[bit] = childIndex;
+      }
+      index = trie.Nodes[index].Child[bit];
+   }
+
+   // ====== Update the candidate ===========================================
+   AggregationRoute& route = trie.Nodes[index].Routes[identity.Key];
+   const bool changed = (route.Message.size() != message->nlmsg_len) ||
+                        (memcmp(route.Message.data(), message, message->nlmsg_len) != 0);
+   if(changed) {
+      route.Message.assign((const char*)message, (const char*)message + message->nlmsg_len);
+      route.Signature    = getRouteSignature(message);
+      route.Aggregatable = (rtm->rtm_type == RTN_UNICAST) &&
+                           (rtm->rtm_src_len == 0) && (rtm->rtm_tos == 0);
+      trie.CandidateNodes[identity.Key] = index;
+      trie.DirtyNodes.insert(index);
+   }
+   return changed;
+}
+
+
+// ###### Withdraw the clone of a main table route ##########################
+/* Returns true, if the clone has been removed. */
+static bool withdrawClone(const uint8_t      family,
+                          const unsigned int table,
+                          const std::string& key)
+{
+   if(!Aggregate) {
+      return withdrawObject(RouteSets[std::pair<uint8_t, unsigned int>(family, table)],
+                            key, RTM_DELROUTE);
+   }
+   AggregationTrie& trie  = AggregationTries[std::pair<uint8_t, unsigned int>(family, table)];
+   const auto       found = trie.CandidateNodes.find(key);
+   if(found == trie.CandidateNodes.end()) {
+      return false;
+   }
+   trie.Nodes[found->second].Routes.erase(key);
+   trie.DirtyNodes.insert(found->second);
+   trie.CandidateNodes.erase(found);
+   return true;
+}
+
+
+// ###### Release the nexthop object of withdrawn clones ####################
+static void releaseCloneNexthop(const uint32_t nexthop)
+{
+   if(Aggregate) {
+      // The clones are withdrawn by updateAggregation()
+      PendingNexthopReleases.push_back(nexthop);
+   }
+   else {
+      releaseNexthop(nexthop);
+   }
+}
+
+
+// ###### Get the message of an installed clone #############################
+static const std::vector<char>* getCloneMessage(const uint8_t      family,
+                                                const unsigned int table,
+                                                const std::string& key)
+{
+   if(!Aggregate) {
+      const ObjectSet& routeSet = RouteSets[std::pair<uint8_t, unsigned int>(family, table)];
+      const auto       found    = routeSet.Objects.find(key);
+      return (found != routeSet.Objects.end()) ? &found->second.Message : nullptr;
+   }
+   const AggregationTrie& trie  = AggregationTries[std::pair<uint8_t, unsigned int>(family, table)];
+   const auto             found = trie.CandidateNodes.find(key);
+   if(found == trie.CandidateNodes.end()) {
+      return nullptr;
+   }
+   const auto route = trie.Nodes[found->second].Routes.find(key);
+   return (route != trie.Nodes[found->second].Routes.end()) ? &route->second.Message : nullptr;
+}
+
+
+// ###### Install the clone of a source route ###############################
+/* Returns true, if the clone has changed. */
+static bool acquireClone(const std::string&    sourceKey,
+                         const uint8_t         family,
+                         const unsigned int    table,
+                         const ObjectIdentity& identity,
+                         const nlmsghdr*       message)
+{
+   const auto found = CloneReferences.find(identity.Key);
+   if(found == CloneReferences.end()) {
+      CloneReferences[identity.Key].Owner = sourceKey;
+   }
+   else if( (found->second.Owner != sourceKey) || (!found->second.Shared.empty()) ) {
+      CloneUsers& users = found->second;
+      if(users.Shared.empty()) {
+         const std::vector<char>* installed = getCloneMessage(family, table, identity.Key);
+         assure(installed != nullptr);
+         users.Shared[users.Owner] = *installed;
+         DMHS_LOG(debug) << "Route in table " << table
+                         << " is shared by routes of several source tables";
+      }
+      users.Shared[sourceKey].assign((const char*)message,
+                                     (const char*)message + message->nlmsg_len);
+      users.Owner = sourceKey;
+   }
+   return installClone(family, table, identity, message);
+}
+
+
+// ###### Withdraw the clone of a source route ##############################
+/* A shared clone stays, with the clone of a remaining source route.
+ * Returns true, if the clone has been removed. */
+static bool releaseClone(const std::string& sourceKey,
+                         const uint8_t      family,
+                         const unsigned int table,
+                         const std::string& key)
+{
+   const auto found = CloneReferences.find(key);
+   if(found != CloneReferences.end()) {
+      CloneUsers& users = found->second;
+      if(!users.Shared.empty()) {
+         users.Shared.erase(sourceKey);
+         if(users.Owner == sourceKey) {
+            users.Owner = users.Shared.begin()->first;
+            const nlmsghdr* clone = (const nlmsghdr*)users.Shared.begin()->second.data();
+            ObjectIdentity  identity;
+            assure(getRouteIdentity(clone, identity));
+            installClone(family, table, identity, clone);
+         }
+         if(users.Shared.size() == 1) {
+            users.Shared.clear();   // Not shared any more
+         }
+         return false;
+      }
+      if(users.Owner != sourceKey) {
+         return false;   // Not a user of this clone
+      }
+      CloneReferences.erase(found);
+   }
+   return withdrawClone(family, table, key);
+}
+
+
+// ###### Build the route of the legs on one interface ######################
+/* A single leg becomes a plain route over its interface. Several legs on
+ * the same interface stay a multipath route, with their weights. */
+static void buildLegRoute(const nlmsghdr*                  message,
+                          const std::vector<MultipathLeg>& legs,
+                          std::vector<char>&               route)
+{
+   const rtmsg* source = (const rtmsg*)NLMSG_DATA(message);
+   size_t       space  = 0;
+   for(const MultipathLeg& leg : legs) {
+      space += RTA_ALIGN(leg.Nexthop->rtnh_len) + RTA_SPACE(sizeof(uint32_t));
+   }
+   route.assign(NLMSG_ALIGN(message->nlmsg_len) + RTA_SPACE(space), 0);
+   nlmsghdr* header = (nlmsghdr*)route.data();
+   memcpy(header, message, NLMSG_LENGTH(sizeof(*source)));
+   header->nlmsg_len = NLMSG_LENGTH(sizeof(*source));
+
+   int length = message->nlmsg_len - NLMSG_LENGTH(sizeof(*source));
+   for(const rtattr* rta = RTM_RTA(source); RTA_OK(rta, length); rta = RTA_NEXT(rta, length)) {
+      if( (rta->rta_type != RTA_MULTIPATH) && (rta->rta_type != RTA_NH_ID) &&
+          (rta->rta_type != RTA_OIF)       && (rta->rta_type != RTA_GATEWAY) &&
+          (rta->rta_type != RTA_VIA) ) {
+         assure( addattr(header, route.size(), rta->rta_type,
+                         RTA_DATA(rta), RTA_PAYLOAD(rta)) == 0 );
+      }
+   }
+
+   if(legs.size() == 1) {
+      // ====== Single leg: interface and the attributes of the leg =========
+      const rtnexthop* rtnh = legs.front().Nexthop;
+      ((rtmsg*)NLMSG_DATA(header))->rtm_flags |= (rtnh->rtnh_flags & RTNH_F_ONLINK);
+      assure( addattr(header, route.size(), RTA_OIF,
+                      &rtnh->rtnh_ifindex, sizeof(uint32_t)) == 0 );
+      int attributesLength = rtnh->rtnh_len - sizeof(*rtnh);
+      for(const rtattr* rta = RTNH_DATA(rtnh); RTA_OK(rta, attributesLength);
+          rta = RTA_NEXT(rta, attributesLength)) {
+         assure( addattr(header, route.size(), rta->rta_type,
+                         RTA_DATA(rta), RTA_PAYLOAD(rta)) == 0 );
+      }
+   }
+   else {
+      // ====== Several legs: multipath route of these legs =================
+      std::vector<char> multipath;
+      for(const MultipathLeg& leg : legs) {
+         multipath.insert(multipath.end(), (const char*)leg.Nexthop,
+                          (const char*)leg.Nexthop + leg.Nexthop->rtnh_len);
+         multipath.resize(RTA_ALIGN(multipath.size()), 0);
+      }
+      assure( addattr(header, route.size(), RTA_MULTIPATH,
+                      multipath.data(), multipath.size()) == 0 );
+   }
+}
+
+
+// ###### Update the clones of a source table route #########################
+/* A route over one interface is cloned into the custom table of this
+ * interface, if the route's table is a source table of its network. The
+ * legs of a multipath route over several interfaces are split up: the legs
+ * over each interface are cloned into the custom table of this interface. */
+static void updateSourceRoute(const nlmsghdr*       message,
+                              const ObjectIdentity& source)
+{
+   std::vector<SourceClone>       clones;
+   std::vector<std::vector<char>> cloneMessages;
+
+   // ====== Find the interfaces of the route ===============================
+   std::map<int, std::vector<MultipathLeg>> interfaceLegs;
+   const int oif = getRouteOIF(message);
+   if(oif == 0) {
+      const rtmsg* rtm    = (const rtmsg*)NLMSG_DATA(message);
+      int          length = message->nlmsg_len - NLMSG_LENGTH(sizeof(*rtm));
+      for(const rtattr* rta = RTM_RTA(rtm); RTA_OK(rta, length); rta = RTA_NEXT(rta, length)) {
+         if(rta->rta_type == RTA_MULTIPATH) {
+            for(const MultipathLeg& leg : getMultipathLegs(rta)) {
+               interfaceLegs[leg.OIF].push_back(leg);
+            }
+         }
+      }
+   }
+   else if(oif > 0) {
+      interfaceLegs[oif];   // The route itself
+   }
+
+   // ====== Clone the route into the custom table of each interface ========
+   for(auto iterator = interfaceLegs.begin(); iterator != interfaceLegs.end(); iterator++) {
+      char        oifNameBuffer[IF_NAMESIZE];
+      const char* oifName = if_indextoname(iterator->first, (char*)&oifNameBuffer);
+      const auto  found   = (oifName != nullptr) ? InterfaceMap.find(oifName) : InterfaceMap.end();
+      if( (found == InterfaceMap.end()) ||
+          (!isSourceTable(found->second, source.Table)) ||
+          (!matchesClonePolicy(found->second, message)) ) {
+         continue;
+      }
+      std::vector<char> legRoute;
+      const nlmsghdr*   route = message;
+      if(!iterator->second.empty()) {
+         buildLegRoute(message, iterator->second, legRoute);
+         route = (const nlmsghdr*)legRoute.data();
+      }
+
+      const unsigned int customTable = found->second.Table;
+      uint32_t           nexthop     = 0;
+      if(OwnNexthops) {
+         nexthop = acquireRouteNexthop(route);
+      }
+      cloneMessages.push_back(std::vector<char>());
+      cloneRoute(route, customTable, cloneMessages.back(), nexthop);
+      if(nexthop == 0) {
+         nexthop = getRouteNexthopID(route);   // Shared with the main table route
+      }
+      ObjectIdentity identity;
+      assure(getRouteIdentity((const nlmsghdr*)cloneMessages.back().data(), identity));
+      clones.push_back(SourceClone { customTable, identity.Key, nexthop });
+   }
+
+   // ====== Withdraw clones that are not necessary any more ================
+   /* This has to precede the installation: a clone with a different key
+    * (e.g. with or without RTA_OIF) may still be the same kernel route. */
+   auto sourceRoute = SourceRoutes.find(source.Key);
+   std::vector<SourceClone> oldClones;
+   if(sourceRoute != SourceRoutes.end()) {
+      for(const SourceClone& oldClone : sourceRoute->second.Clones) {
+         if(std::find_if(clones.begin(), clones.end(), [&](const SourceClone& clone) {
+               return (clone.Table == oldClone.Table) && (clone.Key == oldClone.Key);
+            }) == clones.end()) {
+            releaseClone(source.Key, source.Family, oldClone.Table, oldClone.Key);
+         }
+      }
+      oldClones.swap(sourceRoute->second.Clones);
+   }
+
+   // ====== Install the clones =============================================
+   for(unsigned int i = 0; i < clones.size(); i++) {
+      const nlmsghdr* clone = (const nlmsghdr*)cloneMessages[i].data();
+      ObjectIdentity  identity;
+      assure(getRouteIdentity(clone, identity));
+      if(acquireClone(source.Key, source.Family, clones[i].Table, identity, clone)) {
+         DMHS_LOG(debug) << "Update of route in table " << clones[i].Table << " is necessary ...";
+      }
+   }
+
+   // ====== Remember the source route ======================================
+   if(!clones.empty()) {
+      SourceRoute& entry = SourceRoutes[source.Key];
+      entry.Digest  = source.Digest;
+      entry.Family  = source.Family;
+      entry.Clones.swap(clones);
+   }
+   else if(sourceRoute != SourceRoutes.end()) {
+      SourceRoutes.erase(sourceRoute);
+      LifetimeWheel.cancel(getLifetimeKey(LT_Route, source.Key));
+   }
+
+   /* The previous nexthop objects are released after the new ones have been
+    * acquired, so that an unchanged nexthop object is kept. */
+   for(const SourceClone& oldClone : oldClones) {
+      if(oldClone.Nexthop != 0) {
+         releaseCloneNexthop(oldClone.Nexthop);
+      }
+   }
+}
+
+
+// ###### Remove the clones of a source table route #########################
+static void removeSourceRoute(const std::string& sourceKey)
+{
+   LifetimeWheel.cancel(getLifetimeKey(LT_Route, sourceKey));
+   auto sourceRoute = SourceRoutes.find(sourceKey);
+   if(sourceRoute != SourceRoutes.end()) {
+      for(const SourceClone& clone : sourceRoute->second.Clones) {
+         if(releaseClone(sourceKey, sourceRoute->second.Family, clone.Table, clone.Key)) {
+            DMHS_LOG(debug) << "Removal of route in table " << clone.Table << " is necessary ...";
+         }
+      }
+      const std::vector<SourceClone> clones = sourceRoute->second.Clones;
+      SourceRoutes.erase(sourceRoute);
+      for(const SourceClone& clone : clones) {
+         if(clone.Nexthop != 0) {
+            releaseCloneNexthop(clone.Nexthop);
+         }
+      }
+   }
+}
+
+
+// ###### Get name of the VRF device of a custom table ######################
+static std::string getVRFName(const unsigned int table)
+{
+   return VRF_NAME_PREFIX + std::to_string(table);
+}
+
+
+// ###### Make an interface a member of the VRF of its custom table #########
+/* The kernel moves the connected and local routes of a member interface
+ * into the VRF table, and the single l3mdev rule selects the VRF table for
+ * the traffic of the member interfaces. So, no per-address rules are
+ * necessary. The interface is moved by moveIntoVRFDevices(), which keeps
+ * its routes. */
+static void ensureVRFMembership(const int          ifIndex,
+                                const char*        ifName,
+                                const unsigned int table)
+{
+   const auto vrf = VRFDevices.find(table);
+   if(vrf == VRFDevices.end()) {
+      return;
+   }
+   const auto master = LinkMasters.find(ifIndex);
+   if( (master != LinkMasters.end()) && (master->second == vrf->second) ) {
+      return;
+   }
+   // The link event of the kernel will confirm the new master.
+   LinkMasters[ifIndex] = vrf->second;
+
+   DMHS_LOG(info) << boost::format("Adding interface %s to VRF %s")
+                        % ifName % getVRFName(table);
+   PendingVRFMembers[ifIndex] = table;
+}
+
+
+// ###### Begin a rule ######################################################
+static fib_rule_hdr* beginRule(nlmsghdr*     message,
+                               const size_t  maxlen,
+                               const uint8_t family)
+{
+   memset(message, 0, maxlen);
+   fib_rule_hdr* frh = (fib_rule_hdr*)NLMSG_DATA(message);
+   message->nlmsg_len  = NLMSG_LENGTH(sizeof(*frh));
+   message->nlmsg_type = RTM_NEWRULE;
+   frh->family         = family;
+   frh->action         = FR_ACT_TO_TBL;
+   frh->table          = RT_TABLE_UNSPEC;
+   return frh;
+}
+
+
+// ###### Finish a rule pointing to a custom table ##########################
+static void finishRule(nlmsghdr*          message,
+                       const size_t       maxlen,
+                       const unsigned int customTable,
+                       const uint32_t     priority)
+{
+   // ------ "priority" parameter -------------------------------------------
+   assure( addattr(message, maxlen, FRA_PRIORITY,
+                   &priority, sizeof(uint32_t)) == 0 );
+
+   // ------ "lookup" parameter ---------------------------------------------
+   assure( addattr(message, maxlen, FRA_TABLE,
+                   &customTable, sizeof(uint32_t)) == 0 );
+
+   // ------ "protocol" parameter -------------------------------------------
+   if(Protocol != RTPROT_UNSPEC) {
+      const uint8_t protocol = Protocol;
+      assure( addattr(message, maxlen, FRA_PROTOCOL,
+                      &protocol, sizeof(uint8_t)) == 0 );
+   }
+}
+
+
+// ###### Build a rule from a source prefix to a custom table ###############
+/* A rule for a prefix is restricted to "iif lo", i.e. to the packets sent
+ * by the host itself. Otherwise, it would also match the packets that other
+ * hosts of the on-link prefix send through this router. */
+static void buildSourceRule(nlmsghdr*          message,
+                            const size_t       maxlen,
+                            const uint8_t      family,
+                            const uint8_t*     prefix,
+                            const uint8_t      prefixLength,
+                            const unsigned int customTable,
+                            const uint32_t     priority)
+{
+   fib_rule_hdr* frh = beginRule(message, maxlen, family);
+
+   // ------ "from" parameter: address/prefix -------------------------------
+   assure( addattr(message, maxlen, FRA_SRC,
+                   prefix, getAddressLength(family)) == 0 );
+   frh->src_len = prefixLength;
+
+   // ------ "iif" parameter: lo for a prefix -------------------------------
+   if(prefixLength < 8 * getAddressLength(family)) {
+      assure( addattr(message, maxlen, FRA_IIFNAME, "lo", 3) == 0 );
+   }
+
+   finishRule(message, maxlen, customTable, priority);
+}
+
+
+// ###### Build a rule from a fwmark to a custom table ######################
+static void buildFwMarkRule(nlmsghdr*          message,
+                            const size_t       maxlen,
+                            const uint8_t      family,
+                            const uint32_t     fwMark,
+                            const uint32_t     fwMarkMask,
+                            const unsigned int customTable,
+                            const uint32_t     priority)
+{
+   beginRule(message, maxlen, family);
+
+   // ------ "fwmark" parameter: mark/mask ----------------------------------
+   assure( addattr(message, maxlen, FRA_FWMARK,
+                   &fwMark, sizeof(uint32_t)) == 0 );
+   assure( addattr(message, maxlen, FRA_FWMASK,
+                   &fwMarkMask, sizeof(uint32_t)) == 0 );
+
+   finishRule(message, maxlen, customTable, priority);
+}
+
+
+// ###### Build a rule from a UID range to a custom table ###################
+static void buildUIDRangeRule(nlmsghdr*                            message,
+                              const size_t                         maxlen,
+                              const uint8_t                        family,
+                              const std::pair<uint32_t, uint32_t>& uidRange,
+                              const unsigned int                   customTable,
+                              const uint32_t                       priority)
+{
+   beginRule(message, maxlen, family);
+
+   // ------ "uidrange" parameter: start-end --------------------------------
+   const fib_rule_uid_range range = { uidRange.first, uidRange.second };
+   assure( addattr(message, maxlen, FRA_UID_RANGE,
+                   &range, sizeof(range)) == 0 );
+
+   finishRule(message, maxlen, customTable, priority);
+}
+
+
+// ###### Check the layout of the rules of the network configurations #######
+/* The priority ranges of the networks must not collide, and the uidrange
+ * and fwmark rules of different networks must not overlap, since their
+ * order would decide about the table. */
+static bool checkRuleLayout()
+{
+   for(auto n1 = InterfaceMap.begin(); n1 != InterfaceMap.end(); n1++) {
+      const NetworkConfig& c1 = n1->second;
+      for(auto n2 = std::next(n1); n2 != InterfaceMap.end(); n2++) {
+         const NetworkConfig& c2 = n2->second;
+         if(c1.Table == c2.Table) {
+            continue;
+         }
+
+         // ====== Check the priority ranges ================================
+         if( (c1.PriorityBase <= getRulePriority(c2, (RulePriorityClass)(RPC_Classes - 1))) &&
+             (c2.PriorityBase <= getRulePriority(c1, (RulePriorityClass)(RPC_Classes - 1))) ) {
+            std::cerr << "ERROR: Rule priorities of " << n1->first << " and "
+                      << n2->first << " collide!\n";
+            return false;
+         }
+
+         // ====== Check the uidranges ======================================
+         for(const std::pair<uint32_t, uint32_t>& r1 : c1.UIDRanges) {
+            for(const std::pair<uint32_t, uint32_t>& r2 : c2.UIDRanges) {
+               if( (r1.first <= r2.second) && (r2.first <= r1.second) ) {
+                  std::cerr << boost::format("ERROR: uidrange %u-%u of %s overlaps with uidrange %u-%u of %s!\n")
+                                  % r1.first % r1.second % n1->first
+                                  % r2.first % r2.second % n2->first;
+                  return false;
+               }
+            }
+         }
+
+         // ====== Check the fwmarks ========================================
+         const uint32_t mask = c1.FwMarkMask & c2.FwMarkMask;
+         if( (c1.FwMarkMask != 0) && (c2.FwMarkMask != 0) &&
+             ( ((c1.FwMark ^ c2.FwMark) & mask) == 0 ) ) {
+            std::cerr << "ERROR: fwmarks of " << n1->first << " and "
+                      << n2->first << " overlap!\n";
+            return false;
+         }
+      }
+   }
+   return true;
+}
+
+
+// ###### Remove redundant uidranges ########################################
+/* A uidrange within another uidrange of the same network is redundant, and
+ * gets no rule. */
+static void removeRedundantUIDRanges()
+{
+   for(auto n1 = InterfaceMap.begin(); n1 != InterfaceMap.end(); n1++) {
+      NetworkConfig& c1 = n1->second;
+      for(unsigned int i = 0; i < c1.UIDRanges.size(); ) {
+         bool redundant = false;
+         for(unsigned int j = 0; j < c1.UIDRanges.size(); j++) {
+            if( (i != j) &&
+                (c1.UIDRanges[j].first <= c1.UIDRanges[i].first) &&
+                (c1.UIDRanges[j].second >= c1.UIDRanges[i].second) &&
+                ( (c1.UIDRanges[j] != c1.UIDRanges[i]) || (j < i) ) ) {
+               redundant = true;
+               break;
+            }
+         }
+         if(redundant) {
+            DMHS_LOG(warning) << boost::format("uidrange %u-%u of %s is redundant")
+                                    % c1.UIDRanges[i].first % c1.UIDRanges[i].second
+                                    % n1->first;
+            c1.UIDRanges.erase(c1.UIDRanges.begin() + i);
+         }
+         else {
+            i++;
+         }
+      }
+   }
+}
+
+
+// ###### Update the rules of the network configurations ####################
+/* Unlike the address rules, these rules only depend on the configuration.
+ * So, their number stays constant, regardless of address changes. The
+ * rules of a suspended network are withdrawn. */
+static void updateNetworkRules()
+{
+   static const uint8_t families[] = { AF_INET, AF_INET6 };
+   struct _request {
+      nlmsghdr     header;
+      fib_rule_hdr frh;
+      char         buffer[256];
+   } request;
+   std::map<uint8_t, std::set<std::string>> ruleKeys;
+   for(auto iterator = InterfaceMap.begin(); iterator != InterfaceMap.end(); iterator++) {
+      const NetworkConfig& networkConfig = iterator->second;
+      if(isSuspended(networkConfig.Table)) {
+         continue;
+      }
+      for(const uint8_t family : families) {
+         if(networkConfig.FwMarkMask != 0) {
+            buildFwMarkRule(&request.header, sizeof(request), family,
+                            networkConfig.FwMark, networkConfig.FwMarkMask,
+                            networkConfig.Table,
+                            getRulePriority(networkConfig, RPC_FwMark));
+            ObjectIdentity identity;
+            assure(getRuleIdentity(&request.header, identity));
+            ruleKeys[family].insert(identity.Key);
+            if(installObject(RuleSets[family], identity, &request.header, RTM_NEWRULE)) {
+               DMHS_LOG(debug) << "Update of fwmark rule for table " << networkConfig.Table
+                               << " is necessary ...";
+            }
+         }
+         for(const std::pair<uint32_t, uint32_t>& uidRange : networkConfig.UIDRanges) {
+            buildUIDRangeRule(&request.header, sizeof(request), family,
+                              uidRange, networkConfig.Table,
+                              getRulePriority(networkConfig, RPC_UIDRange));
+            ObjectIdentity identity;
+            assure(getRuleIdentity(&request.header, identity));
+            ruleKeys[family].insert(identity.Key);
+            if(installObject(RuleSets[family], identity, &request.header, RTM_NEWRULE)) {
+               DMHS_LOG(debug) << "Update of uidrange rule for table " << networkConfig.Table
+                               << " is necessary ...";
+            }
+         }
+      }
+   }
+
+   // ====== Withdraw the rules that are not necessary any more =============
+   for(const uint8_t family : families) {
+      for(const std::string& key : NetworkRuleKeys[family]) {
+         if(ruleKeys[family].find(key) == ruleKeys[family].end()) {
+            if(withdrawObject(RuleSets[family], key, RTM_DELRULE)) {
+               DMHS_LOG(debug) << "Removal of rule is necessary ...";
+            }
+         }
+      }
+      NetworkRuleKeys[family].swap(ruleKeys[family]);
+   }
+}
+
+
+// ###### Publish the fwmarks of the networks ###############################
+/* Applications can set the mark of a network with SO_MARK, nftables can
+ * include the defines, e.g.:
+ * include "/run/dynmhs/fwmarks.nft"
+ * meta skuid 1001 meta mark set $DYNMHS_FWMARK_eth1 */
+static void publishFwMarks()
+{
+   std::error_code ec;
+   std::filesystem::create_directories(RUNTIME_DIRECTORY, ec);
+   std::ofstream marksFile(FWMARKS_FILE);
+   std::ofstream nftFile(FWMARKS_NFT_FILE);
+   marksFile << "# Interface Table FwMark/Mask\n";
+   nftFile   << "# DynMHS fwmarks of the networks\n";
+   for(auto iterator = InterfaceMap.begin(); iterator != InterfaceMap.end(); iterator++) {
+      const NetworkConfig& networkConfig = iterator->second;
+      if(networkConfig.FwMarkMask != 0) {
+         std::string name = iterator->first;
+         for(char& c : name) {
+            if(!isalnum(c)) {
+               c = '_';
+            }
+         }
+         marksFile << boost::format("%s %u 0x%x/0x%x\n")
+                         % iterator->first % networkConfig.Table
+                         % networkConfig.FwMark % networkConfig.FwMarkMask;
+         nftFile   << boost::format("define DYNMHS_FWMARK_%s = 0x%x\n")
+                         % name % networkConfig.FwMark;
+      }
+   }
+   if( (!marksFile.good()) || (!nftFile.good()) ) {
+      DMHS_LOG(warning) << "Unable to publish the fwmarks in " << RUNTIME_DIRECTORY;
+   }
+}
+
+
+// ###### Attach the socket hooks to the cgroups of the networks ############
+/* The hooks mark the sockets of a cgroup with the fwmark of its network,
+ * so that the fwmark rule steers them into the custom table. */
+static void attachCGroupHooks()
+{
+   for(auto iterator = InterfaceMap.begin(); iterator != InterfaceMap.end(); iterator++) {
+      const NetworkConfig& networkConfig = iterator->second;
+      for(const std::string& cgroup : networkConfig.CGroups) {
+         CGroupHook* hook = new CGroupHook;
+         if(hook->attach(cgroup, networkConfig.FwMark)) {
+            DMHS_LOG(info) << boost::format("Marking sockets of cgroup %s with fwmark 0x%x")
+                                 % cgroup % networkConfig.FwMark;
+            CGroupHooks.push_back(hook);
+         }
+         else {
+            delete hook;
+         }
+      }
+   }
+}
+
+
+// ###### Detach the socket hooks from the cgroups ##########################
+static void detachCGroupHooks()
+{
+   for(CGroupHook* hook : CGroupHooks) {
+      delete hook;
+   }
+   CGroupHooks.clear();
+}
+
+
+// ###### Check whether a prefix contains an address ########################
+static bool prefixContains(const uint8_t* prefix,
+                           const uint8_t  prefixLength,
+                           const uint8_t* address)
+{
+   const unsigned int bytes = prefixLength / 8;
+   const unsigned int bits  = prefixLength % 8;
+   if(memcmp(prefix, address, bytes) != 0) {
+      return false;
+   }
+   if(bits > 0) {
+      const uint8_t mask = (uint8_t)(0xff << (8 - bits));
+      return ((prefix[bytes] & mask) == (address[bytes] & mask));
+   }
+   return true;
+}
+
+
+// ###### Update the rules derived from the managed addresses ###############
+/* Without prefix rules, each address gets its own rule. With prefix rules,
+ * the addresses of an on-link prefix share one rule, which is kept as long
+ * as at least one of them exists. If prefixes of different custom tables
+ * overlap, a prefix rule would also catch addresses of the other table.
+ * Then, the addresses of the overlapping prefixes get their own rules.
+ * A prefix within a shorter prefix of the same table is redundant, and
+ * gets no rule. The addresses of a suspended network get no rules. The
+ * temporary IPv6 addresses may share the rule of their prefix, so that
+ * their rotation does not change any rule. Overlapping and redundant
+ * prefixes are found in one walk over the sorted prefixes, so that an
+ * update takes O(P log P) time for P prefixes. The ObjectSet only installs
+ * or withdraws the rules that have changed. */
+static void updateAddressRules(const uint8_t family)
+{
+   struct SourcePrefix {
+      uint8_t                         PrefixLength;
+      unsigned int                    Table;
+      uint8_t                         Prefix[16];
+      std::vector<const uint8_t*>     Addresses;
+      bool                            Overlapping;
+      bool                            Redundant;
+   };
+   const unsigned int addressLength = getAddressLength(family);
+
+   // ====== Group the addresses by prefix ==================================
+   std::map<std::string, SourcePrefix> prefixes;
+   for(auto iterator = ManagedAddresses.begin(); iterator != ManagedAddresses.end(); iterator++) {
+      const ManagedAddress& address = iterator->second;
+      if( (address.Family != family) || (address.Expired) ||
+          (isSuspended(address.Table)) ) {
+         continue;
+      }
+      const bool    aggregate    = (PrefixRules) ||
+                                   ( (TemporaryAddresses == TA_Aggregate) &&
+                                     (address.Flags & IFA_F_TEMPORARY) );
+      const uint8_t prefixLength = (aggregate) ? address.PrefixLength : 8 * addressLength;
+      uint8_t       prefix[16];
+      memset(&prefix, 0, sizeof(prefix));
+      memcpy(&prefix, address.Address, prefixLength / 8);
+      if(prefixLength % 8) {
+         prefix[prefixLength / 8] = address.Address[prefixLength / 8] &
+                                       (uint8_t)(0xff << (8 - (prefixLength % 8)));
+      }
+      std::string key;
+      appendToKey(key, &prefix, addressLength);
+      appendToKey(key, &prefixLength, sizeof(prefixLength));
+      appendToKey(key, &address.Table, sizeof(address.Table));
+      SourcePrefix& sourcePrefix = prefixes[key];
+      sourcePrefix.PrefixLength = prefixLength;
+      sourcePrefix.Table        = address.Table;
+      sourcePrefix.Overlapping  = false;
+      sourcePrefix.Redundant    = false;
+      memcpy(&sourcePrefix.Prefix, &prefix, sizeof(prefix));
+      sourcePrefix.Addresses.push_back(address.Address);
+   }
+
+   // ====== Detect overlapping prefixes of different tables ================
+   // The keys start with the prefix, followed by the prefix length. So, the
+   // map is ordered like a depth-first walk of the prefix tree: a prefix
+   // precedes all prefixes within it. The stack holds the prefixes that
+   // contain the current one.
+   std::vector<std::map<std::string, SourcePrefix>::iterator> stack;
+   for(auto p1 = prefixes.begin(); p1 != prefixes.end(); p1++) {
+      while( (!stack.empty()) &&
+             (!prefixContains(stack.back()->second.Prefix,
+                              stack.back()->second.PrefixLength,
+                              p1->second.Prefix)) ) {
+         stack.pop_back();
+      }
+      for(auto p2 : stack) {
+         if(p2->second.Table != p1->second.Table) {
+            p1->second.Overlapping = true;
+            p2->second.Overlapping = true;
+         }
+      }
+      stack.push_back(p1);
+   }
+   std::set<std::string> overlapping;
+   for(auto p1 = prefixes.begin(); p1 != prefixes.end(); p1++) {
+      if(p1->second.Overlapping) {
+         overlapping.insert(p1->first);
+         if(OverlappingPrefixes[family].find(p1->first) == OverlappingPrefixes[family].end()) {
+            char buffer[INET6_ADDRSTRLEN];
+            DMHS_LOG(warning) << boost::format("Prefix %s/%u of table %u overlaps with a prefix of another table, using per-address rules")
+                                    % inet_ntop(family, p1->second.Prefix, buffer, sizeof(buffer))
+                                    % (unsigned int)p1->second.PrefixLength
+                                    % p1->second.Table;
+         }
+      }
+   }
+   OverlappingPrefixes[family].swap(overlapping);
+
+   // ====== Detect redundant prefixes of the same table ====================
+   stack.clear();
+   for(auto p1 = prefixes.begin(); p1 != prefixes.end(); p1++) {
+      while( (!stack.empty()) &&
+             (!prefixContains(stack.back()->second.Prefix,
+                              stack.back()->second.PrefixLength,
+                              p1->second.Prefix)) ) {
+         stack.pop_back();
+      }
+      if(!p1->second.Overlapping) {
+         for(auto p2 : stack) {
+            if( (p2->second.Table == p1->second.Table) &&
+                (!p2->second.Overlapping) &&
+                (p2->second.PrefixLength < p1->second.PrefixLength) ) {
+               p1->second.Redundant = true;
+               break;
+            }
+         }
+      }
+      stack.push_back(p1);
+   }
+
+   // ====== Install the rules ==============================================
+   std::set<std::string> ruleKeys;
+   struct _request {
+      nlmsghdr     header;
+      fib_rule_hdr frh;
+      char         buffer[256];
+   } request;
+   for(auto iterator = prefixes.begin(); iterator != prefixes.end(); iterator++) {
+      const SourcePrefix&  sourcePrefix  = iterator->second;
+      const NetworkConfig* networkConfig = getNetworkConfig(sourcePrefix.Table);
+      if( (sourcePrefix.Redundant) || (networkConfig == nullptr) ) {
+         continue;
+      }
+      std::vector<std::pair<const uint8_t*, uint8_t>> sources;
+      if(sourcePrefix.Overlapping) {
+         for(const uint8_t* address : sourcePrefix.Addresses) {
+            sources.push_back(std::pair<const uint8_t*, uint8_t>(address, 8 * addressLength));
+         }
+      }
+      else {
+         sources.push_back(std::pair<const uint8_t*, uint8_t>(sourcePrefix.Prefix,
+                                                              sourcePrefix.PrefixLength));
+      }
+      for(const std::pair<const uint8_t*, uint8_t>& source : sources) {
+         buildSourceRule(&request.header, sizeof(request), family,
+                         source.first, source.second, sourcePrefix.Table,
+                         getRulePriority(*networkConfig,
+                                         (source.second == 8 * addressLength) ? RPC_Address :
+                                                                                RPC_Prefix));
+         ObjectIdentity identity;
+         assure(getRuleIdentity(&request.header, identity));
+         ruleKeys.insert(identity.Key);
+         if(installObject(RuleSets[family], identity, &request.header, RTM_NEWRULE)) {
+            DMHS_LOG(debug) << boost::format("Update of rule for table %u is necessary (%u addresses) ...")
+                                  % sourcePrefix.Table % sourcePrefix.Addresses.size();
+         }
+      }
+   }
+
+   // ====== Withdraw the rules that are not necessary any more =============
+   for(const std::string& key : AddressRuleKeys[family]) {
+      if(ruleKeys.find(key) == ruleKeys.end()) {
+         if(withdrawObject(RuleSets[family], key, RTM_DELRULE)) {
+            DMHS_LOG(debug) << "Removal of rule is necessary ...";
+         }
+      }
+   }
+   AddressRuleKeys[family].swap(ruleKeys);
+}
+
+
+// ###### Update the multipath default route of an address family ###########
+/* The multipath default route in the main table has one leg per network
+ * with a default gateway, unless the network is suspended or down. A
+ * configured weight is kept, otherwise the weight is 100 for the network
+ * with the lowest RTT, and lower for the others in proportion to their
+ * RTTs. The weight is reduced by the loss rate and by the utilisation. */
+static void updateMultipathRoute(const uint8_t family)
+{
+   if(MultipathMetric == 0) {
+      return;
+   }
+
+   // ====== Find the gateways of the networks ==============================
+   struct Leg {
+      unsigned int          Table;
+      const UplinkGateway*  Gateway;
+      const Prober::Health* Health;
+      double                Weight;
+   };
+   std::vector<Leg> legs;
+   double           minRTT = 0.0;
+   for(auto iterator = InterfaceMap.begin(); iterator != InterfaceMap.end(); iterator++) {
+      const unsigned int    table  = iterator->second.Table;
+      const Prober::Health* health = HealthProber.getHealth(table);
+      const auto            link   = LinkIndices.find(iterator->first);
+      if( (isSuspended(table)) || (link == LinkIndices.end()) ||
+          ( (health != nullptr) && (health->State == Prober::Down) ) ) {
+         continue;
+      }
+      const UplinkGateway* uplinkGateway = nullptr;
+      for(auto route = MainDefaultRoutes.begin();
+          (route != MainDefaultRoutes.end()) && (uplinkGateway == nullptr); route++) {
+         if(route->second.Family == family) {
+            for(const UplinkGateway& gateway : route->second.Gateways) {
+               if(gateway.OIF == link->second) {
+                  uplinkGateway = &gateway;
+                  break;
+               }
+            }
+         }
+      }
+      if(uplinkGateway != nullptr) {
+         legs.push_back({ table, uplinkGateway, health, 0.0 });
+         if( (health != nullptr) && (health->RTT > 0.0) ) {
+            const double rtt = std::max(health->RTT, MULTIPATH_MIN_RTT);
+            minRTT = (minRTT > 0.0) ? std::min(minRTT, rtt) : rtt;
+         }
+      }
+   }
+
+   // ====== Compute the weights ============================================
+   std::map<unsigned int, unsigned int> weights;
+   for(Leg& leg : legs) {
+      const NetworkConfig* networkConfig = getNetworkConfig(leg.Table);
+      if(networkConfig->Weight != 0) {
+         leg.Weight = networkConfig->Weight;
+      }
+      else if( (leg.Health != nullptr) && (leg.Health->RTT > 0.0) ) {
+         leg.Weight = 100.0 * minRTT / std::max(leg.Health->RTT, MULTIPATH_MIN_RTT);
+      }
+      else {
+         leg.Weight = 100.0;
+      }
+      if(leg.Health != nullptr) {
+         leg.Weight *= (1.0 - leg.Health->Loss);
+      }
+      const auto statistics = NetworkStatistics.find(leg.Table);
+      if(statistics != NetworkStatistics.end()) {
+         leg.Weight *= (1.0 - statistics->second.Utilisation);
+      }
+      leg.Weight = std::min(256.0, std::max(1.0, round(leg.Weight)));
+      weights[leg.Table] = (unsigned int)leg.Weight;
+   }
+   std::string nexthops;
+   for(const Leg& leg : legs) {
+      appendToKey(nexthops, &leg.Gateway->OIF, sizeof(leg.Gateway->OIF));
+      appendToKey(nexthops, &leg.Gateway->Gateway, getAddressLength(family));
+   }
+
+   // ====== Damp weight changes ============================================
+   /* A change of the set of networks, or of the interface or gateway of a
+    * leg, is applied at once. A weight change is only applied if it is
+    * significant, and after the hold time. */
+   MultipathRoute& multipathRoute = MultipathRoutes[family];
+   const std::chrono::time_point<std::chrono::steady_clock> now =
+      std::chrono::steady_clock::now();
+   bool sameNetworks = (weights.size() == multipathRoute.Weights.size()) &&
+                       (nexthops == multipathRoute.Nexthops);
+   bool significant  = false;
+   for(auto iterator = weights.begin(); (iterator != weights.end()) && (sameNetworks); iterator++) {
+      const auto found = multipathRoute.Weights.find(iterator->first);
+      if(found == multipathRoute.Weights.end()) {
+         sameNetworks = false;
+      }
+      else if(fabs((double)iterator->second - (double)found->second) >=
+                 MULTIPATH_MIN_CHANGE * found->second) {
+         significant = true;
+      }
+   }
+   if( (sameNetworks) &&
+       ( (!significant) ||
+         (now - multipathRoute.LastChange < std::chrono::seconds(MULTIPATH_HOLD_TIME)) ) ) {
+      return;
+   }
+   multipathRoute.Weights    = weights;
+   multipathRoute.Nexthops   = nexthops;
+   multipathRoute.LastChange = now;
+
+   ObjectSet& routeSet = RouteSets[std::pair<uint8_t, unsigned int>(family, RT_TABLE_MAIN)];
+   if(legs.empty()) {
+      if(multipathRoute.Key != "") {
+         DMHS_LOG(info) << boost::format("Multipath default route (IPv%u): no networks")
+                              % ((family == AF_INET) ? 4 : 6);
+         withdrawObject(routeSet, multipathRoute.Key, RTM_DELROUTE);
+         multipathRoute.Key.clear();
+      }
+      return;
+   }
+
+   // ====== Build the route ================================================
+   const unsigned int addressLength = getAddressLength(family);
+   const unsigned int mainTable     = RT_TABLE_MAIN;
+   std::vector<char>  route(NLMSG_SPACE(sizeof(rtmsg)) + 4 * RTA_SPACE(sizeof(uint32_t)) +
+                            legs.size() * (sizeof(rtnexthop) + RTA_SPACE(addressLength)), 0);
+   nlmsghdr* header = (nlmsghdr*)route.data();
+   rtmsg*    rtm    = (rtmsg*)NLMSG_DATA(header);
+   header->nlmsg_len = NLMSG_LENGTH(sizeof(rtmsg));
+   rtm->rtm_family   = family;
+   rtm->rtm_table    = RT_TABLE_MAIN;
+   rtm->rtm_protocol = Protocol;
+   rtm->rtm_scope    = RT_SCOPE_UNIVERSE;
+   rtm->rtm_type     = RTN_UNICAST;
+   assure( addattr(header, route.size(), RTA_TABLE,
+                   &mainTable, sizeof(uint32_t)) == 0 );
+   assure( addattr(header, route.size(), RTA_PRIORITY,
+                   &MultipathMetric, sizeof(uint32_t)) == 0 );
+   std::string description;
+   if(legs.size() == 1) {
+      assure( addattr(header, route.size(), RTA_GATEWAY,
+                      &legs.front().Gateway->Gateway, addressLength) == 0 );
+      assure( addattr(header, route.size(), RTA_OIF,
+                      &legs.front().Gateway->OIF, sizeof(uint32_t)) == 0 );
+   }
+   else {
+      rtattr* multipath = addattr_nest(header, route.size(), RTA_MULTIPATH);
+      for(const Leg& leg : legs) {
+         rtnexthop* rtnh = (rtnexthop*)NLMSG_TAIL(header);
+         assure(NLMSG_ALIGN(header->nlmsg_len) + sizeof(rtnexthop) <= route.size());
+         rtnh->rtnh_flags   = 0;
+         rtnh->rtnh_hops    = (uint8_t)(leg.Weight - 1);
+         rtnh->rtnh_ifindex = leg.Gateway->OIF;
+         header->nlmsg_len  = NLMSG_ALIGN(header->nlmsg_len) + sizeof(rtnexthop);
+         assure( addattr(header, route.size(), RTA_GATEWAY,
+                         &leg.Gateway->Gateway, addressLength) == 0 );
+         rtnh->rtnh_len = (long)NLMSG_TAIL(header) - (long)rtnh;
+      }
+      addattr_nest_end(header, multipath);
+   }
+   for(const Leg& leg : legs) {
+      description += str(boost::format(" %u:%u") % leg.Table % (unsigned int)leg.Weight);
+   }
+
+   // ====== Install the route ==============================================
+   /* A single leg has its interface in the key, so that the key changes
+    * between single leg and multipath route. */
+   ObjectIdentity identity;
+   assure(getRouteIdentity(header, identity));
+   if( (multipathRoute.Key != "") && (multipathRoute.Key != identity.Key) ) {
+      withdrawObject(routeSet, multipathRoute.Key, RTM_DELROUTE);
+   }
+   multipathRoute.Key = identity.Key;
+   if(installObject(routeSet, identity, header, RTM_NEWROUTE)) {
+      DMHS_LOG(info) << boost::format("Multipath default route (IPv%u), table:weight:%s")
+                           % ((family == AF_INET) ? 4 : 6) % description;
+   }
+}
+
+
+// ###### Update the gateways from a default route of the main table ########
+static void updateDefaultRoute(const nlmsghdr* message)
+{
+   const rtmsg*   rtm = (const rtmsg*)NLMSG_DATA(message);
+   ObjectIdentity identity;
+   if(!getRouteIdentity(message, identity)) {
+      return;
+   }
+   if(message->nlmsg_type == RTM_DELROUTE) {
+      if(MainDefaultRoutes.erase(identity.Key) == 0) {
+         return;
+      }
+   }
+   else {
+      // ====== Get the gateways ============================================
+      /* Routes referencing a nexthop object are not used, since the cache
+       * of the nexthop objects has no gateways. */
+      DefaultRoute  defaultRoute;
+      UplinkGateway gateway;
+      bool          hasGateway = false;
+      defaultRoute.Family = rtm->rtm_family;
+      gateway.OIF         = -1;
+      int length = message->nlmsg_len - NLMSG_LENGTH(sizeof(*rtm));
+      for(const rtattr* rta = RTM_RTA(rtm); RTA_OK(rta, length); rta = RTA_NEXT(rta, length)) {
+         if(rta->rta_type == RTA_OIF) {
+            gateway.OIF = *(const int*)RTA_DATA(rta);
+         }
+         else if(rta->rta_type == RTA_GATEWAY) {
+            memcpy(&gateway.Gateway, RTA_DATA(rta), getAddressLength(rtm->rtm_family));
+            hasGateway = true;
+         }
+         else if(rta->rta_type == RTA_MULTIPATH) {
+            for(const MultipathLeg& leg : getMultipathLegs(rta)) {
+               if(leg.Gateway != nullptr) {
+                  UplinkGateway legGateway;
+                  legGateway.OIF = leg.OIF;
+                  memcpy(&legGateway.Gateway, leg.Gateway, getAddressLength(rtm->rtm_family));
+                  defaultRoute.Gateways.push_back(legGateway);
+               }
+            }
+         }
+      }
+      if( (hasGateway) && (gateway.OIF > 0) ) {
+         defaultRoute.Gateways.push_back(gateway);
+      }
+      if(defaultRoute.Gateways.empty()) {
+         return;
+      }
+      MainDefaultRoutes[identity.Key] = defaultRoute;
+   }
+   updateMultipathRoute(rtm->rtm_family);
+}
+
+
+// ###### Schedule the clean-up of the sockets and flows of an address ######
+/* If the address is still present (i.e. the network is only suspended),
+ * only the connected sockets are destroyed. */
+static void withdrawAddress(const uint8_t family, const void* address,
+                            const bool removed)
+{
+   if( (AddressSocketDestroyer.isOpen()) || (AddressConntrackFlusher.isOpen()) ) {
+      SocketDestroyer::Address withdrawnAddress;
+      withdrawnAddress.Family        = family;
+      withdrawnAddress.ConnectedOnly = !removed;
+      memset(&withdrawnAddress.Address, 0, sizeof(withdrawnAddress.Address));
+      memcpy(&withdrawnAddress.Address, address, getAddressLength(family));
+      WithdrawnAddresses.push_back(withdrawnAddress);
+   }
+}
+
+
+// ###### Clean up the sockets and flows of withdrawn addresses #############
+/* The addresses withdrawn while handling a batch of events are handled by
+ * one walk over the sockets and one walk over the conntrack entries. */
+static void cleanUpWithdrawnAddresses()
+{
+   if(!WithdrawnAddresses.empty()) {
+      const unsigned int destroyed = AddressSocketDestroyer.destroy(WithdrawnAddresses);
+      if(destroyed > 0) {
+         DMHS_LOG(info) << boost::format("Destroyed %u socket(s) bound to %u withdrawn address(es)")
+                              % destroyed % WithdrawnAddresses.size();
+      }
+      const unsigned int flushed = AddressConntrackFlusher.flush(WithdrawnAddresses);
+      if(flushed > 0) {
+         DMHS_LOG(info) << boost::format("Flushed %u conntrack entries of %u withdrawn address(es)")
+                              % flushed % WithdrawnAddresses.size();
+      }
+      WithdrawnAddresses.clear();
+   }
+}
+
+
+// ###### Set or clear a reason for suspending the rules of a network #######
+/* The rules of a network stay suspended as long as there is any reason,
+ * e.g. a link with carrier but unreachable targets. */
+static void setSuspended(const unsigned int table,
+                         const unsigned int reason,
+                         const bool         suspend)
+{
+   const bool   wasSuspended = isSuspended(table);
+   unsigned int reasons      = (wasSuspended) ? SuspendedTables[table] : 0;
+   reasons = (suspend) ? (reasons | reason) : (reasons & ~reason);
+   if(reasons != 0) {
+      SuspendedTables[table] = reasons;
+   }
+   else {
+      SuspendedTables.erase(table);
+   }
+
+   if(wasSuspended != (reasons != 0)) {
+      if(reasons != 0) {
+         DMHS_LOG(warning) << "Suspending rules for table " << table;
+         for(auto iterator = ManagedAddresses.begin(); iterator != ManagedAddresses.end(); iterator++) {
+            if(iterator->second.Table == table) {
+               withdrawAddress(iterator->second.Family, &iterator->second.Address, false);
+            }
+         }
+      }
+      else {
+         DMHS_LOG(info) << "Restoring rules for table " << table;
+      }
+      MPTCPEndpointsChanged = true;
+      updateNetworkRules();
+      updateAddressRules(AF_INET);
+      updateAddressRules(AF_INET6);
+      updateMultipathRoute(AF_INET);
+      updateMultipathRoute(AF_INET6);
+   }
+}
+
+
+// ###### Update the source addresses of the prober #########################
+static void updateProbeSources()
+{
+   std::map<unsigned int, std::vector<Prober::Address>> sources;
+   for(auto iterator = ManagedAddresses.begin(); iterator != ManagedAddresses.end(); iterator++) {
+      const ManagedAddress& address = iterator->second;
+      Prober::Address       source;
+      if(address.Expired) {
+         continue;
+      }
+      source.Family  = address.Family;
+      source.IfIndex = address.IfIndex;
+      memcpy(&source.Address, &address.Address, sizeof(source.Address));
+      sources[address.Table].push_back(source);
+   }
+   for(auto iterator = InterfaceMap.begin(); iterator != InterfaceMap.end(); iterator++) {
+      HealthProber.setSources(iterator->second.Table, sources[iterator->second.Table]);
+   }
+}
+
+
+// ###### Update the MPTCP endpoints of the managed addresses ###############
+/* Each address of a network with MPTCP flags gets an endpoint, unless the
+ * rules of the network are suspended. Then, the removal of the endpoint
+ * makes the kernel close the subflows over the network. All changes are
+ * made in one batch. */
+static void updateMPTCPEndpoints(const bool removeAll = false)
+{
+   std::vector<MPTCPPathManager::Endpoint> endpoints;
+   for(auto iterator = InterfaceMap.begin(); iterator != InterfaceMap.end(); iterator++) {
+      const auto link = LinkIndices.find(iterator->first);
+      if( (iterator->second.MPTCPFlags != 0) && (link != LinkIndices.end()) ) {
+         MPTCPInterfaces.insert(link->second);
+      }
+   }
+   if(!removeAll) {
+      for(auto iterator = ManagedAddresses.begin(); iterator != ManagedAddresses.end(); iterator++) {
+         const ManagedAddress& address       = iterator->second;
+         const NetworkConfig*  networkConfig = getNetworkConfig(address.Table);
+         if( (networkConfig != nullptr) && (networkConfig->MPTCPFlags != 0) &&
+             (!address.Expired) && (!isSuspended(address.Table)) ) {
+            MPTCPPathManager::Endpoint endpoint;
+            endpoint.Family  = address.Family;
+            endpoint.IfIndex = address.IfIndex;
+            endpoint.Flags   = networkConfig->MPTCPFlags;
+            memset(&endpoint.Address, 0, sizeof(endpoint.Address));
+            memcpy(&endpoint.Address, &address.Address, getAddressLength(address.Family));
+            endpoints.push_back(endpoint);
+            MPTCPInterfaces.insert(address.IfIndex);
+         }
+      }
+   }
+   EndpointManager.update(endpoints, MPTCPInterfaces);
+   MPTCPEndpointsChanged = false;
+}
+
+
+// ###### Handle the expired lifetimes ######################################
+/* All lifetimes expired at the same time are handled in one batch: the
+ * clones of the expired routes are withdrawn together, and the rules are
+ * updated once per family. */
+static void handleLifetimeExpiry()
+{
+   std::vector<std::string> expired;
+   std::set<uint8_t>        families;
+   unsigned int             expiredRoutes = 0;
+   LifetimeWheel.expire(expired);
+   for(const std::string& timerKey : expired) {
+      const std::string key = timerKey.substr(1);
+
+      // ====== Route: withdraw its clones ==================================
+      if(timerKey[0] == LT_Route) {
+         if(SourceRoutes.find(key) != SourceRoutes.end()) {
+            removeSourceRoute(key);
+            expiredRoutes++;
+         }
+         continue;
+      }
+
+      // ====== Address: withdraw its rule ==================================
+      auto found = ManagedAddresses.find(key);
+      if(found == ManagedAddresses.end()) {
+         continue;
+      }
+      ManagedAddress& address = found->second;
+      char            buffer[INET6_ADDRSTRLEN];
+      const char*     addressString = inet_ntop(address.Family, &address.Address,
+                                                buffer, sizeof(buffer));
+      if(timerKey[0] == LT_Valid) {
+         DMHS_LOG(info) << boost::format("Valid lifetime of address %s is over") % addressString;
+         families.insert(address.Family);
+         withdrawAddress(address.Family, &address.Address, true);
+         LifetimeWheel.cancel(getLifetimeKey(LT_Deprecated, key));
+         ManagedAddresses.erase(found);
+      }
+      else if( (timerKey[0] == LT_Deprecated) && (!address.Expired) ) {
+         DMHS_LOG(info) << boost::format("Grace period of deprecated address %s is over") % addressString;
+         families.insert(address.Family);
+         address.Expired = true;
+      }
+   }
+
+   if(expiredRoutes > 0) {
+      DMHS_LOG(info) << boost::format("Withdrawing the clones of %u expired route(s)") % expiredRoutes;
+      updateAggregation();
+   }
+   for(const uint8_t family : families) {
+      updateAddressRules(family);
+   }
+   if(!families.empty()) {
+      MPTCPEndpointsChanged = true;
+      if(HealthProber.isOpen()) {
+         updateProbeSources();
+      }
+   }
+}
+
+
+// ###### Publish the health of the networks ################################
+/* The file is replaced atomically, so that readers never see a partial
+ * update. */
+static void publishHealth()
+{
+   const std::string  newFileName  = std::string(HEALTH_FILE) + ".new";
+   std::ofstream      healthFile(newFileName);
+   healthFile << "# Interface Table State Loss RTT/ms Utilisation\n";
+   for(auto iterator = InterfaceMap.begin(); iterator != InterfaceMap.end(); iterator++) {
+      const Prober::Health* health = HealthProber.getHealth(iterator->second.Table);
+      if(health != nullptr) {
+         const auto statistics = NetworkStatistics.find(iterator->second.Table);
+         healthFile << boost::format("%s %u %s %1.3f %1.3f %1.3f\n")
+                          % iterator->first % iterator->second.Table
+                          % Prober::getStateName(health->State) % health->Loss % health->RTT
+                          % ((statistics != NetworkStatistics.end()) ?
+                                statistics->second.Utilisation : 0.0);
+      }
+   }
+   healthFile.close();
+   if( (!healthFile.good()) ||
+       (rename(newFileName.c_str(), HEALTH_FILE) != 0) ) {
+      DMHS_LOG(warning) << "Unable to publish the health in " << HEALTH_FILE;
+   }
+}
+
+
+// ###### Evaluate the last probe round, and start the next one #############
+/* A network whose targets are down gets its rules suspended, like a
+ * network without carrier. */
+static void handleProbeRound()
+{
+   std::vector<unsigned int> changedNetworks;
+   HealthProber.probe(changedNetworks);
+   for(const unsigned int table : changedNetworks) {
+      const Prober::Health* health = HealthProber.getHealth(table);
+      assure(health != nullptr);
+      const std::string status = str(boost::format("Health of table %u: %s (loss %1.0f%%, RTT %1.3f ms)")
+                                        % table % Prober::getStateName(health->State)
+                                        % (100.0 * health->Loss) % health->RTT);
+      if(health->State == Prober::Down) {
+         DMHS_LOG(warning) << status;
+      }
+      else {
+         DMHS_LOG(info) << status;
+      }
+      if(ProbeWithdraw) {
+         setSuspended(table, SR_Health, (health->State == Prober::Down));
+      }
+   }
+   updateMultipathRoute(AF_INET);
+   updateMultipathRoute(AF_INET6);
+   publishHealth();
+}
+
+
+// ###### Handle error ######################################################
+static void handleError(const nlmsghdr* message)
+{
+   const nlmsgerr* errormsg = (const nlmsgerr*)NLMSG_DATA(message);
+   if(errormsg != nullptr) {
+      // ====== Acknowledgement =============================================
+      if(errormsg->error == 0) {
+        DMHS_LOG(trace) << boost::format("ack for seqnum %u")
+                              % errormsg->msg.nlmsg_seq;
+      }
+      // ====== Error =======================================================
+      else {
+        DMHS_LOG(trace) << boost::format("Netlink error %d (%s) for seqnum %u")
+                              % errormsg->error
+                              % strerror(-errormsg->error)
+                              % errormsg->msg.nlmsg_seq;
+      }
+   }
+}
+
+
+// ###### Handle link change event ##########################################
+static void handleLinkEvent(const nlmsghdr* message)
+{
+   // ====== Initialise =====================================================
+   const ifinfomsg* ifinfo = (const ifinfomsg*)NLMSG_DATA(message);
+   unsigned int     length = message->nlmsg_len - NLMSG_LENGTH(sizeof(*ifinfo));
+   const char*      eventName;
+   if(message->nlmsg_type == RTM_NEWLINK) {
+      eventName = "RTM_NEWLINK";
+   }
+   else if(message->nlmsg_type == RTM_DELLINK) {
+      eventName = "RTM_DELLINK";
+   }
+   else {
+      return;
+   }
+
+   // ====== Parse attributes ===============================================
+   const char* ifName    = nullptr;
+   int         master    = 0;
+   uint8_t     operState = IF_OPER_UNKNOWN;
+   for(const rtattr* rta = IFLA_RTA(ifinfo); RTA_OK(rta, length); rta = RTA_NEXT(rta, length)) {
+      if(rta->rta_type == IFLA_IFNAME) {
+         ifName = (const char*)RTA_DATA(rta);
+      }
+      else if(rta->rta_type == IFLA_MASTER) {
+         master = *((const int*)RTA_DATA(rta));
+      }
+      else if(rta->rta_type == IFLA_OPERSTATE) {
+         operState = *((const uint8_t*)RTA_DATA(rta));
+      }
+   }
+   /* Drivers without operstate support report IF_OPER_UNKNOWN. Then, the
+    * carrier flag decides. */
+   const bool carrier = (message->nlmsg_type == RTM_NEWLINK) &&
+                        (ifinfo->ifi_flags & IFF_UP) && (ifinfo->ifi_flags & IFF_LOWER_UP) &&
+                        ( (operState == IF_OPER_UP) || (operState == IF_OPER_UNKNOWN) );
+
+   // ====== Show status ====================================================
+   DMHS_LOG(debug) << boost::format("Link event: event=%s ifindex=%d ifname=%s master=%d carrier=%s")
+                         % eventName
+                         % ifinfo->ifi_index
+                         % ((ifName != nullptr) ? ifName : "UNKNOWN?!")
+                         % master
+                         % ((carrier) ? "yes" : "no");
+
+   // ====== Keep the VRF membership of the interfaces ======================
+   if(message->nlmsg_type == RTM_DELLINK) {
+      LinkMasters.erase(ifinfo->ifi_index);
+      if(ifName != nullptr) {
+         LinkIndices.erase(ifName);
+      }
+   }
+   else {
+      LinkMasters[ifinfo->ifi_index] = master;
+      if(ifName != nullptr) {
+         LinkIndices[ifName] = ifinfo->ifi_index;
+      }
+      if( (VRFMode) && (Mode == Operational) && (ifName != nullptr) ) {
+         const auto found = InterfaceMap.find(ifName);
+         if(found != InterfaceMap.end()) {
+            ensureVRFMembership(ifinfo->ifi_index, ifName, found->second.Table);
+         }
+      }
+   }
+
+   // ====== Suspend or restore the rules of the network ====================
+   /* Without carrier, the rules of the network are withdrawn, so that the
+    * traffic falls back to the main table at once, instead of waiting for
+    * the removal of the routes. The rules are restored in one batch, when
+    * the carrier is back. */
+   if( (Failover) && (Mode == Operational) && (ifName != nullptr) ) {
+      const auto found = InterfaceMap.find(ifName);
+      if(found != InterfaceMap.end()) {
+         const unsigned int customTable = found->second.Table;
+         const auto         suspended   = SuspendedTables.find(customTable);
+         if(carrier == ( (suspended != SuspendedTables.end()) &&
+                         (suspended->second & SR_Carrier) )) {
+            if(carrier) {
+               DMHS_LOG(info) << "Carrier of " << ifName << " is back";
+            }
+            else {
+               DMHS_LOG(warning) << "Carrier of " << ifName << " is lost";
+            }
+            setSuspended(customTable, SR_Carrier, !carrier);
+         }
+      }
+   }
+}
+
+
+// ###### Get the key of a managed address ##################################
+static std::string getAddressKey(const unsigned int ifIndex,
+                                 const uint8_t      family,
+                                 const void*        address)
+{
+   std::string key;
+   appendToKey(key, &ifIndex, sizeof(ifIndex));
+   appendToKey(key, &family, sizeof(family));
+   appendToKey(key, address, getAddressLength(family));
+   return key;
+}
+
+
+// ###### Handle address change event ##########################################
+static void handleAddressEvent(const nlmsghdr* message)
+{
+   // ====== Initialise =====================================================
+   const ifaddrmsg*   ifa       = (const ifaddrmsg*)NLMSG_DATA(message);
+   const unsigned int ifalength = message->nlmsg_len;
+   const char*        eventName;
+   if(message->nlmsg_type == RTM_NEWADDR) {
+      eventName = "RTM_NEWADDR";
+   }
+   else if(message->nlmsg_type == RTM_DELADDR) {
+      eventName = "RTM_DELADDR";
+   }
+   else {
+      return;
+   }
+
+   // ====== Parse attributes ===============================================
+   const unsigned int       ifIndex = ifa->ifa_index;
+   char                     ifNameBuffer[IF_NAMESIZE];
+   const char*              ifName;
+   boost::asio::ip::address address;
+   const char*              addressPtr  = nullptr;
+   bool                     isLinkLocal = false;
+   const unsigned int       prefixLength  = ifa->ifa_prefixlen;
+   uint32_t                 flags         = ifa->ifa_flags;
+   uint32_t                 validLifetime = INFINITE_LIFETIME;
+   unsigned int             length = ifalength - NLMSG_LENGTH(sizeof(*ifa));
+   for(const rtattr* rta = IFA_RTA(ifa); RTA_OK(rta, length); rta = RTA_NEXT(rta, length)) {
+      switch(rta->rta_type) {
+         case IFA_FLAGS:
+            flags = *((const uint32_t*)RTA_DATA(rta));   // All flags, not only 8 bits
+          break;
+         case IFA_CACHEINFO:
+            validLifetime = ((const ifa_cacheinfo*)RTA_DATA(rta))->ifa_valid;
+          break;
+         case IFA_ADDRESS:
+            if(ifa->ifa_family == AF_INET) {
+               address    = boost::asio::ip::make_address_v4(*((boost::asio::ip::address_v4::bytes_type*)RTA_DATA(rta)));
+               addressPtr = (const char*)RTA_DATA(rta);
+            }
+            else if(ifa->ifa_family == AF_INET6) {
+               const boost::asio::ip::address_v6 a =
+                  boost::asio::ip::make_address_v6(*((boost::asio::ip::address_v6::bytes_type*)RTA_DATA(rta)));
+               if(a.is_link_local()) {
+                  isLinkLocal = true;
+               }
+               address    = a;
+               addressPtr = (const char*)RTA_DATA(rta);
+            }
+          break;
+      }
+   }
+   ifName = if_indextoname(ifIndex, (char*)&ifNameBuffer);
+   if(ifName == nullptr) {
+      ifName = "UNKNOWN";
+   }
+
+
+   // ====== Show status ====================================================
+   DMHS_LOG(trace) << boost::format("Address event: event=%s if=%s (%d) address=%s/%d flags=0x%x")
+                         % eventName
+                         % ifName
+                         % ifIndex
+                         % address.to_string()
+                         % prefixLength
+                         % flags;
+
+
+   // ====== Check whether an update in the custom table is necessary =======
+   /* In Operational mode:
+    * If there is an address change on an interface with custom table:
+    * Update the rule pointing from the address to the custom table
+    * In VRF mode, make sure that the interface is member of the VRF of the
+    * custom table instead.
+    * */
+   if( (Mode == Operational)   &&
+       (addressPtr != nullptr) &&
+       (!isLinkLocal) ) {
+
+      // ------ Check whether interface has a custom table ------------------
+      const auto found = InterfaceMap.find(ifName);
+      if( (found != InterfaceMap.end()) && (VRFMode) ) {
+         // ------ VRF mode: VRF membership instead of a rule ---------------
+         if(message->nlmsg_type == RTM_NEWADDR) {
+            ensureVRFMembership(ifIndex, ifName, found->second.Table);
+         }
+      }
+      else if(found != InterfaceMap.end()) {
+         // ------ Update the managed addresses and the derived rules -------
+         /* An address is only usable after DAD, unless it is optimistic.
+          * For IPv4, the flag of temporary addresses means secondary. */
+         if(ifa->ifa_family == AF_INET) {
+            flags &= ~IFA_F_SECONDARY;
+         }
+         const bool usable = ( (!(flags & IFA_F_TENTATIVE)) || (flags & IFA_F_OPTIMISTIC) ) &&
+                             (!(flags & IFA_F_DADFAILED)) &&
+                             ( (!(flags & IFA_F_TEMPORARY)) || (TemporaryAddresses != TA_Exclude) );
+         const std::string key = getAddressKey(ifIndex, ifa->ifa_family, addressPtr);
+         bool changed = false;
+         if( (message->nlmsg_type == RTM_NEWADDR) && (usable) ) {
+            const bool      isNew          = (ManagedAddresses.find(key) == ManagedAddresses.end());
+            ManagedAddress& managedAddress = ManagedAddresses[key];
+            const uint8_t   newLength      = std::min(prefixLength, 8 * getAddressLength(ifa->ifa_family));
+            const uint32_t  stateFlags     = IFA_F_DEPRECATED | IFA_F_TEMPORARY;
+            if( (isNew) || (managedAddress.PrefixLength != newLength) ||
+                ((managedAddress.Flags & stateFlags) != (flags & stateFlags)) ) {
+               changed = true;
+               managedAddress.Family       = ifa->ifa_family;
+               managedAddress.PrefixLength = newLength;
+               managedAddress.Table        = found->second.Table;
+               managedAddress.IfIndex      = ifIndex;
+               managedAddress.Flags        = flags;
+               managedAddress.Expired      = false;
+               memcpy(&managedAddress.Address, addressPtr, getAddressLength(ifa->ifa_family));
+               if( (flags & IFA_F_DEPRECATED) && (DeprecatedGrace > 0) ) {
+                  DMHS_LOG(debug) << boost::format("Address %s is deprecated, keeping its rule for %u s")
+                                        % address.to_string() % DeprecatedGrace;
+                  LifetimeWheel.schedule(getLifetimeKey(LT_Deprecated, key),
+                                         std::chrono::steady_clock::now() +
+                                            std::chrono::seconds(DeprecatedGrace));
+               }
+               else {
+                  LifetimeWheel.cancel(getLifetimeKey(LT_Deprecated, key));
+               }
+            }
+            if(validLifetime != INFINITE_LIFETIME) {
+               LifetimeWheel.schedule(getLifetimeKey(LT_Valid, key),
+                                      std::chrono::steady_clock::now() +
+                                         std::chrono::seconds(validLifetime));
+            }
+            else {
+               LifetimeWheel.cancel(getLifetimeKey(LT_Valid, key));
+            }
+         }
+         else {
+            changed = (ManagedAddresses.erase(key) > 0);
+            LifetimeWheel.cancel(getLifetimeKey(LT_Deprecated, key));
+            LifetimeWheel.cancel(getLifetimeKey(LT_Valid, key));
+            if(message->nlmsg_type == RTM_DELADDR) {
+               withdrawAddress(ifa->ifa_family, addressPtr, true);
+            }
+            else if(changed) {
+               DMHS_LOG(debug) << boost::format("Address %s is not usable (flags 0x%x)")
+                                     % address.to_string() % flags;
+            }
+         }
+         if(changed) {
+            MPTCPEndpointsChanged = true;
+            updateAddressRules(ifa->ifa_family);
+            if(HealthProber.isOpen()) {
+               updateProbeSources();
+            }
+         }
+      }
+   }
+}
+
+
+// ###### Handle route change event #########################################
+static void handleRouteEvent(const nlmsghdr* message)
+{
+   // ====== Initialise =====================================================
+   const rtmsg*       rtm           = (const rtmsg*)NLMSG_DATA(message);
+   const unsigned int rtmLength     = message->nlmsg_len;
+   const char*        eventName;
+   if(message->nlmsg_type == RTM_NEWROUTE) {
+      eventName = "RTM_NEWROUTE";
+   }
+   else if(message->nlmsg_type == RTM_DELROUTE) {
+      eventName = "RTM_DELROUTE";
+   }
+   else {
+      return;
+   }
+
+   // ====== Parse attributes ===============================================
+   boost::asio::ip::address destination =
+      (rtm->rtm_family == AF_INET) ?
+         boost::asio::ip::address(boost::asio::ip::address_v4()) :
+         boost::asio::ip::address(boost::asio::ip::address_v6());
+   const unsigned int       destinationPrefixLength = rtm->rtm_dst_len;
+   boost::asio::ip::address gateway;
+   bool                     hasGateway = false;
+   unsigned int*            tablePtr   = nullptr;
+   int                      metric     = -1;
+   const int                oifIndex   = getRouteOIF(message);
+   bool                     hasNexthop = false;
+   char                     oifNameBuffer[IF_NAMESIZE];
+   const char*              oifName    = nullptr;
+   int                      length = rtmLength - NLMSG_LENGTH(sizeof(*rtm));
+   for(const rtattr* rta = RTM_RTA(rtm); RTA_OK(rta, length); rta = RTA_NEXT(rta, length)) {
+      switch(rta->rta_type) {
+         case RTA_DST:
+            if(rtm->rtm_family == AF_INET) {
+               destination = boost::asio::ip::make_address_v4(*((boost::asio::ip::address_v4::bytes_type*)RTA_DATA(rta)));
+            }
+            else if(rtm->rtm_family == AF_INET6) {
+               destination = boost::asio::ip::make_address_v6(*((boost::asio::ip::address_v6::bytes_type*)RTA_DATA(rta)));
+            }
+          break;
+         case RTA_GATEWAY:
+            if(rtm->rtm_family == AF_INET) {
+               gateway = boost::asio::ip::make_address_v4(*((boost::asio::ip::address_v4::bytes_type*)RTA_DATA(rta)));
+            }
+            else if(rtm->rtm_family == AF_INET6) {
+               gateway = boost::asio::ip::make_address_v6(*((boost::asio::ip::address_v6::bytes_type*)RTA_DATA(rta)));
+            }
+          break;
+         case RTA_TABLE:
+            tablePtr = (unsigned int*)RTA_DATA(rta);
+          break;
+         case RTA_METRICS:
+            metric = *(int*)RTA_DATA(rta);
+          break;
+         case RTA_NH_ID:
+            hasNexthop = true;
+          break;
+      }
+   }
+   assure(tablePtr != nullptr);
+   if(oifIndex > 0) {
+      oifName = if_indextoname(oifIndex, (char*)&oifNameBuffer);
+      if(oifName == nullptr) {
+         oifName = "UNKNOWN";
+      }
+   }
+
+
+   // ====== Show status =================================================
+   const char* scopeName;
+   switch(rtm->rtm_scope) {
+      case RT_SCOPE_UNIVERSE:
+         scopeName = "universe";
+       break;
+      case RT_SCOPE_LINK:
+         scopeName = "link";
+       break;
+       default:
+         scopeName = "UNKNOWN";
+       break;
+   }
+   DMHS_LOG(trace) << boost::format("Route event: event=%s: table=%d destination=%s scope=%s %s if=%s (%d) %s")
+                         % eventName
+                         % *tablePtr
+                         % (destination.to_string() + "/" +
+                              std::to_string(destinationPrefixLength))
+                         % scopeName
+                         % ((hasGateway == true) ? ("G=" + gateway.to_string()) : "G=---")
+                         % ((oifName != nullptr) ? oifName : "---")
+                         % oifIndex
+                         % ((metric >= 0) ? std::to_string(metric) : "");
+
+
+   // ====== Check whether an update in the custom table is necessary =======
+   if( (Protocol != RTPROT_UNSPEC) && (rtm->rtm_protocol == Protocol) ) {
+      // This is the echo of a route installed by DynMHS itself.
+      return;
+   }
+   if( (MultipathMetric > 0) && (Mode == Operational) &&
+       (*tablePtr == RT_TABLE_MAIN) && (rtm->rtm_dst_len == 0) &&
+       (rtm->rtm_type == RTN_UNICAST) ) {
+      updateDefaultRoute(message);
+   }
+   if( (Mode == Operational) &&
+       (isSourceTable(*tablePtr)) ) {
+      /* In Operational mode, synchronise a routing change from a source table
+       * (by default: the main table) into the custom table. Only changes in
+       * the source tables are of interest here! */
+      if(message->nlmsg_type == RTM_NEWROUTE) {
+         const auto network = (oifName != nullptr) ? InterfaceMap.find(oifName) :
+                                                     InterfaceMap.end();
+         if( (network != InterfaceMap.end()) &&
+             (isSourceTable(network->second, *tablePtr)) &&
+             (!matchesClonePolicy(network->second, message)) ) {
+            /* A clone of a route with the same key only exists, if the
+             * route has lost its gateway, or if its nexthop object has
+             * moved to this interface. */
+            ObjectIdentity source;
+            if( ( (network->second.CloneFlags & CP_Connected) || (hasNexthop) ) &&
+                (getRouteIdentity(message, source)) ) {
+               removeSourceRoute(source.Key);
+            }
+            return;
+         }
+      }
+      ObjectIdentity source;
+      if(getRouteIdentity(message, source)) {
+         /* A route with lifetime gets a timer, which withdraws its clones
+          * when the route expires. A refresh of the lifetime (e.g. by a
+          * router advertisement) just reschedules the timer. */
+         const long long lifetime = getRouteLifetime(message);
+         if( (message->nlmsg_type == RTM_NEWROUTE) && (lifetime >= 0) ) {
+            updateSourceRoute(message, source);
+            if( (lifetime > 0) && (SourceRoutes.find(source.Key) != SourceRoutes.end()) ) {
+               LifetimeWheel.schedule(getLifetimeKey(LT_Route, source.Key),
+                                      std::chrono::steady_clock::now() +
+                                         std::chrono::milliseconds(lifetime));
+            }
+            else {
+               LifetimeWheel.cancel(getLifetimeKey(LT_Route, source.Key));
+            }
+         }
+         else {
+            removeSourceRoute(source.Key);
+         }
+      }
+   }
+   else if( (Mode == Reset) &&
+            (!isSourceTable(*tablePtr)) ) {
+      /* In Reset mode, delete all routing table entries in the custom tables.
+       * Here, only the custom tables are of interest! */
+      // ------ Check if entry belongs to custom table in the InterfaceMap --
+      for(auto iterator = InterfaceMap.begin(); iterator != InterfaceMap.end(); iterator++) {
+         const unsigned int customTable = iterator->second.Table;
+         if(*tablePtr == customTable) {
+            DMHS_LOG(trace) << "Removing route from table " << customTable << " ...";
+            queueMessage(message, RTM_DELROUTE, NLM_F_REQUEST | NLM_F_ACK);
+            break;
+         }
+      }
+   }
+}
+
+
+// ###### Handle rule change event ##########################################
+static void handleRuleEvent(const nlmsghdr* message)
+{
+   // ====== Initialise =====================================================
+   const fib_rule_hdr* frh           = (const fib_rule_hdr*)NLMSG_DATA(message);
+   const unsigned int  frhLength     = message->nlmsg_len;
+   const char*         eventName;
+   if(message->nlmsg_type == RTM_NEWRULE) {
+      eventName = "RTM_NEWRULE";
+   }
+   else if(message->nlmsg_type == RTM_DELRULE) {
+      eventName = "RTM_DELRULE";
+   }
+   else {
+      return;
+   }
+
+   // ====== Parse attributes ===============================================
+   unsigned int* tablePtr   = nullptr;
+   unsigned int  priority   = 0;
+   uint8_t       protocol   = RTPROT_UNSPEC;
+   unsigned int  length     = frhLength - NLMSG_LENGTH(sizeof(*frh));
+   for(const rtattr* rta = (const rtattr*)((char*)frh + NLMSG_ALIGN(sizeof(fib_rule_hdr)));
+       RTA_OK(rta, length); rta = RTA_NEXT(rta, length)) {
+      switch(rta->rta_type) {
+         case FRA_TABLE:
+            tablePtr = (unsigned int*)RTA_DATA(rta);
+          break;
+         case FRA_PRIORITY:
+            priority = *(unsigned int*)RTA_DATA(rta);
+          break;
+         case FRA_PROTOCOL:
+            protocol = *(uint8_t*)RTA_DATA(rta);
+          break;
+      }
+   }
+   assure(tablePtr != nullptr);
+
+
+   // ====== Show status ====================================================
+   DMHS_LOG(trace) << boost::format("Rule event: event=%s: table=%u priority=%u")
+                         % eventName
+                         % *tablePtr
+                         % priority;
+
+
+   // ====== Check whether a removal of the rule is necessary ===============
+   if( (Protocol != RTPROT_UNSPEC) && (protocol == Protocol) ) {
+      // This is the echo of a rule installed by DynMHS itself.
+      return;
+   }
+   bool removalNecessary = false;
+   if( (Mode == Reset) && (tablePtr != nullptr) ) {
+      // ------ Check if entry belongs to custom table in the InterfaceMap --
+      for(auto iterator = InterfaceMap.begin(); iterator != InterfaceMap.end(); iterator++) {
+         const unsigned int customTable = iterator->second.Table;
+         if(*tablePtr == customTable) {
+            DMHS_LOG(info) << "Removing rule for table " << customTable << " ...";
+            removalNecessary = true;
+            break;
+         }
+      }
+   }
+
+   // ====== Apply removal ==================================================
+   if(removalNecessary) {
+      queueMessage(message, RTM_DELRULE, NLM_F_REQUEST | NLM_F_ACK);
+   }
+}
+
+
+// ###### Parse a nexthop object ############################################
+static bool parseNexthop(const nlmsghdr*                            message,
+                         uint32_t&                                  id,
+                         NexthopInfo&                               info,
+                         const uint8_t*&                            gateway,
+                         std::vector<std::pair<uint32_t, uint8_t>>& members)
+{
+   const nhmsg* nhm    = (const nhmsg*)NLMSG_DATA(message);
+   int          length = message->nlmsg_len - NLMSG_LENGTH(sizeof(*nhm));
+   id          = 0;
+   info.Family = nhm->nh_family;
+   info.OIF    = -1;
+   info.Members.clear();
+   gateway     = nullptr;
+   members.clear();
+   for(const rtattr* rta = (const rtattr*)((const char*)nhm + NLMSG_ALIGN(sizeof(*nhm)));
+       RTA_OK(rta, length); rta = RTA_NEXT(rta, length)) {
+      switch(rta->rta_type) {
+         case NHA_ID:
+            id = *(const uint32_t*)RTA_DATA(rta);
+          break;
+         case NHA_OIF:
+            info.OIF = *(const int*)RTA_DATA(rta);
+          break;
+         case NHA_GATEWAY:
+            gateway = (const uint8_t*)RTA_DATA(rta);
+          break;
+         case NHA_GROUP:
+            for(unsigned int i = 0; i < RTA_PAYLOAD(rta) / sizeof(nexthop_grp); i++) {
+               const nexthop_grp* entry = &((const nexthop_grp*)RTA_DATA(rta))[i];
+               info.Members.push_back(entry->id);
+               members.push_back(std::pair<uint32_t, uint8_t>(entry->id, entry->weight));
+            }
+          break;
+      }
+   }
+   return (id != 0);
+}
+
+
+// ###### Handle nexthop object change event ################################
+static void handleNexthopEvent(const nlmsghdr* message)
+{
+   uint32_t                                  id;
+   NexthopInfo                               info;
+   const uint8_t*                            gateway;
+   std::vector<std::pair<uint32_t, uint8_t>> members;
+   if(!parseNexthop(message, id, info, gateway, members)) {
+      return;
+   }
+   DMHS_LOG(trace) << boost::format("Nexthop event: event=%s: id=%u if=%d members=%u")
+                         % ((message->nlmsg_type == RTM_NEWNEXTHOP) ? "RTM_NEWNEXTHOP" : "RTM_DELNEXTHOP")
+                         % id % info.OIF % info.Members.size();
+
+   if(message->nlmsg_type == RTM_NEWNEXTHOP) {
+      Nexthops[id] = info;
+   }
+   else {
+      Nexthops.erase(id);
+
+      // ====== Forget the routes referencing a removed nexthop object ======
+      /* The kernel removes the routes referencing the nexthop object,
+       * including their clones, without notification. The records of the
+       * clones are dropped first, so that removeSourceRoute() does not
+       * send deletes for routes that are gone already. */
+      if( (Mode == Operational) &&
+          (OwnedNexthopKeys.find(id) == OwnedNexthopKeys.end()) ) {
+         for(auto routeSet = RouteSets.begin(); routeSet != RouteSets.end(); routeSet++) {
+            std::vector<std::string> keys;
+            for(auto object = routeSet->second.Objects.begin();
+                object != routeSet->second.Objects.end(); object++) {
+               if(getRouteNexthopID((const nlmsghdr*)object->second.Message.data()) == id) {
+                  keys.push_back(object->first);
+               }
+            }
+            for(const std::string& key : keys) {
+               forgetObject(routeSet->second, key, RTM_DELROUTE);
+            }
+         }
+         std::vector<std::string> sourceKeys;
+         for(auto iterator = SourceRoutes.begin(); iterator != SourceRoutes.end(); iterator++) {
+            if(std::find_if(iterator->second.Clones.begin(), iterator->second.Clones.end(),
+                            [&](const SourceClone& clone) { return clone.Nexthop == id; }) !=
+                  iterator->second.Clones.end()) {
+               sourceKeys.push_back(iterator->first);
+            }
+         }
+         for(const std::string& sourceKey : sourceKeys) {
+            removeSourceRoute(sourceKey);
+         }
+      }
+   }
+}
+
+
+// ###### Send simple Netlink request #######################################
+static void queueSimpleNetlinkRequest(const int     type,
+                                      const uint8_t family = AF_UNSPEC)
+{
+   /* Nexthop object dumps require the complete nhmsg header. Its first
+    * field is the family, as in rtgenmsg. */
+   struct _request {
+      nlmsghdr header;
+      union {
+         rtgenmsg msg;
+         nhmsg    nhm;
+      };
+   };
+   _request* request = (_request*)new char[sizeof(*request)];
+   assure(request != nullptr);
+   memset(request, 0, sizeof(*request));
+
+   request->header.nlmsg_len   = NLMSG_LENGTH((type == RTM_GETNEXTHOP) ?
+                                                 sizeof(request->nhm) : sizeof(request->msg));
+   request->header.nlmsg_type  = type;
+   request->header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP | NLM_F_ACK;
+   request->header.nlmsg_pid   = 0;  // This field is opaque to netlink.
+   request->header.nlmsg_seq   = ++SeqNumber;
+   request->msg.rtgen_family   = family;
+
+   RequestQueue.push(std::pair<const nlmsghdr*, size_t>(
+      &request->header, request->header.nlmsg_len));
+   DMHS_LOG(trace) << "Request seqnum " << SeqNumber;
+}
+
+
+// ###### Send queued Netlink requests ######################################
+static bool sendQueuedRequests(const int sd)
+{
+   static char batch[NETLINK_BATCH_SIZE];
+   while(!RequestQueue.empty()) {
+      // ------ Collect a batch of queued Netlink requests ------------------
+      /* The kernel processes all messages of one sendmsg() call in
+       * sequence, and acknowledges each of them. So, a batch saves one
+       * system call per request. */
+      size_t batchLength = 0;
+      while(!RequestQueue.empty()) {
+         std::pair<const nlmsghdr*, size_t>& command = RequestQueue.front();
+         const nlmsghdr* message       = command.first;
+         const size_t    messageLength = command.second;
+         assure(NLMSG_ALIGN(messageLength) <= sizeof(batch));
+         if(batchLength + NLMSG_ALIGN(messageLength) > sizeof(batch)) {
+            break;
+         }
+         memcpy(&batch[batchLength], message, messageLength);
+         memset(&batch[batchLength + messageLength], 0,
+                NLMSG_ALIGN(messageLength) - messageLength);
+         batchLength += NLMSG_ALIGN(messageLength);
+
+         // ------ Remove Netlink request from queue ------------------------
+         delete [] message;
+         RequestQueue.pop();
+      }
+
+      // ------ Send batch of queued Netlink requests -----------------------
+      sockaddr_nl sa { };
+      sa.nl_family = AF_NETLINK;
+      const iovec  iov { (void*)batch, batchLength };
+      const msghdr msg { .msg_name       = &sa,
+                         .msg_namelen    = sizeof(sa),
+                         .msg_iov        = (iovec*)&iov,
                          .msg_iovlen     = 1,
                          .msg_control    = nullptr,
                          .msg_controllen = 0,
@@ -551,173 +3797,1805 @@ static bool sendQueuedRequests(const int sd)
          DMHS_LOG(error) << "sendmsg() failed: " << strerror(errno);
          return false;
       }
+   }
+   return true;
+}
+
+
+// ###### Get the class of an event #########################################
+static int getEventClass(const nlmsghdr* header)
+{
+   switch(header->nlmsg_type) {
+      case RTM_NEWLINK:
+      case RTM_DELLINK:
+         if(header->nlmsg_len >= NLMSG_LENGTH(sizeof(ifinfomsg))) {
+            return EC_Link;
+         }
+       break;
+      case RTM_NEWADDR:
+      case RTM_DELADDR:
+         if(header->nlmsg_len >= NLMSG_LENGTH(sizeof(ifaddrmsg))) {
+            return EC_Address;
+         }
+       break;
+      case RTM_NEWRULE:
+      case RTM_DELRULE:
+         if(header->nlmsg_len >= NLMSG_LENGTH(sizeof(rtmsg))) {
+            return EC_Rule;
+         }
+       break;
+      case RTM_NEWNEXTHOP:
+      case RTM_DELNEXTHOP:
+         if(header->nlmsg_len >= NLMSG_LENGTH(sizeof(nhmsg))) {
+            return EC_Nexthop;
+         }
+       break;
+      case RTM_NEWROUTE:
+      case RTM_DELROUTE:
+         if(header->nlmsg_len >= NLMSG_LENGTH(sizeof(rtmsg))) {
+            return EC_Route;
+         }
+       break;
+      default:
+         DMHS_LOG(warning) << "Received unexpected header type "
+                           << (int)header->nlmsg_type;
+       break;
+   }
+   return -1;
+}
+
+
+// ###### Check whether an event is a sequence point ########################
+/* A delete must not overtake the queued events of the lower classes that
+ * arrived before it: e.g. an RTM_DELNEXTHOP also removes the routes using
+ * the nexthop object, so that an earlier RTM_NEWROUTE handled after it
+ * would record a route that no longer exists. Therefore, the queued events
+ * are handled before queuing such a delete. */
+static bool isSequencePoint(const int eventClass, const nlmsghdr* header)
+{
+   switch(header->nlmsg_type) {
+      case RTM_DELLINK:
+      case RTM_DELADDR:
+      case RTM_DELRULE:
+      case RTM_DELNEXTHOP:
+         for(unsigned int lowerClass = eventClass + 1; lowerClass < EC_Classes; lowerClass++) {
+            if(!EventQueues[lowerClass].empty()) {
+               return true;
+            }
+         }
+       break;
+   }
+   return false;
+}
+
+
+// ###### Handle the queued events ##########################################
+/* The events of a batch are handled by class, and in the order of their
+ * arrival within a class. So, a carrier loss is handled before the
+ * thousands of route events of a storm that arrived before it. Since a
+ * batch is limited, the lower classes are handled after each batch. A
+ * delete is a sequence point (see isSequencePoint()), so that only adds
+ * and changes are moved ahead of earlier events. With sendUrgent, the
+ * requests caused by the link events (i.e. the failover) are sent before
+ * handling the other classes. */
+static void handleQueuedEvents(const int sd, const bool sendUrgent)
+{
+   for(unsigned int eventClass = 0; eventClass < EC_Classes; eventClass++) {
+      std::vector<char>& queue = EventQueues[eventClass];
+      for(size_t offset = 0; offset < queue.size(); ) {
+         const nlmsghdr* header = (const nlmsghdr*)&queue[offset];
+         switch(eventClass) {
+            case EC_Link:
+               handleLinkEvent(header);
+             break;
+            case EC_Address:
+               handleAddressEvent(header);
+             break;
+            case EC_Rule:
+               handleRuleEvent(header);
+             break;
+            case EC_Nexthop:
+               handleNexthopEvent(header);
+             break;
+            case EC_Route:
+               handleRouteEvent(header);
+             break;
+         }
+         offset += NLMSG_ALIGN(header->nlmsg_len);
+      }
+      queue.clear();
+      if( (eventClass == EC_Link) && (sendUrgent) && (!RequestQueue.empty()) ) {
+         sendQueuedRequests(sd);
+      }
+   }
+}
+
+
+// ###### Read Netlink message ##############################################
+static bool receiveNetlinkMessages(const int  sd,
+                                   const bool nonBlocking = false,
+                                   const bool sendUrgent  = false)
+{
+   // ====== Initialise structures for recvmsg() ============================
+   nlmsghdr    buffer[65536 / sizeof(nlmsghdr)];
+   iovec       iov { buffer, sizeof(buffer) };
+   sockaddr_nl sa;
+   msghdr      msg { .msg_name       = &sa,
+                     .msg_namelen    = sizeof(sa),
+                     .msg_iov        = (iovec*)&iov,
+                     .msg_iovlen     = 1,
+                     .msg_control    = nullptr,
+                     .msg_controllen = 0,
+                     .msg_flags      = 0 };
+   const int    flags = (nonBlocking == true) ? MSG_DONTWAIT : 0;
+   int          length;
+   unsigned int events = 0;
+
+   // ====== Reception loop =================================================
+   while( (length = recvmsg(sd, &msg, flags)) > 0) {
+      for(const nlmsghdr* header = (const nlmsghdr*)buffer;
+          NLMSG_OK(header, length); header = NLMSG_NEXT(header, length)) {
+
+         // ====== Check whether this acknowledgement was waited ============
+         /* A dump is acknowledged by its NLMSG_DONE, not by its first part. */
+         if((WaitingForAcknowlegement) &&
+            (header->nlmsg_seq == AwaitedSeqNumber) &&
+            ( (header->nlmsg_type == NLMSG_DONE) ||
+              (header->nlmsg_type == NLMSG_ERROR) )) {
+            if( (header->nlmsg_type == NLMSG_ERROR) &&
+                (header->nlmsg_len >= NLMSG_LENGTH(sizeof(nlmsgerr))) ) {
+               const nlmsgerr* errormsg = (const nlmsgerr*)NLMSG_DATA(header);
+               LastError = errormsg->error;
+            }
+            else {
+               LastError = 0;   // success
+            }
+            DMHS_LOG(trace) << boost::format("Got awaited ack for seqnum %u: error %d (%s)")
+                                  % header->nlmsg_seq
+                                  % LastError
+                                  % strerror(-LastError);
+            WaitingForAcknowlegement = false;
+         }
+
+         // ====== Check whether a dump has been interrupted ================
+         /* All rtnetlink messages start with the address family. It tells
+          * which family has to be dumped again. */
+         if(header->nlmsg_flags & NLM_F_DUMP_INTR) {
+            DumpInterrupted = true;
+            if( (header->nlmsg_type != NLMSG_DONE) &&
+                (header->nlmsg_type != NLMSG_ERROR) &&
+                (header->nlmsg_len >= NLMSG_LENGTH(sizeof(rtgenmsg))) ) {
+               InterruptedFamilies.insert(((const rtgenmsg*)NLMSG_DATA(header))->rtgen_family);
+            }
+         }
+
+         // ====== Handle the different message types =======================
+         if(header->nlmsg_type == NLMSG_DONE) {
+            // The end of a multipart message
+            if(!nonBlocking) {
+               handleQueuedEvents(sd, sendUrgent);
+               return true;
+            }
+         }
+         else if(header->nlmsg_type == NLMSG_ERROR) {
+            if(header->nlmsg_len >= NLMSG_LENGTH(sizeof(nlmsgerr))) {
+               handleError(header);
+            }
+         }
+         else {
+            // ------ Queue the event by its class -------------------------
+            const int eventClass = getEventClass(header);
+            if(eventClass >= 0) {
+               if(isSequencePoint(eventClass, header)) {
+                  handleQueuedEvents(sd, sendUrgent);
+                  events = 0;
+               }
+               EventQueues[eventClass].insert(EventQueues[eventClass].end(),
+                                              (const char*)header,
+                                              (const char*)header + header->nlmsg_len);
+               EventQueues[eventClass].resize(NLMSG_ALIGN(EventQueues[eventClass].size()), 0);
+               events++;
+            }
+         }
+      }
+
+      // ====== Handle the events of a full batch ===========================
+      if(events >= NETLINK_EVENT_BATCH) {
+         handleQueuedEvents(sd, sendUrgent);
+         if(nonBlocking) {
+            return true;   // The caller polls again for the remaining ones
+         }
+         events = 0;
+      }
+   }
+   const int error = errno;   // The event handlers may change errno
+   handleQueuedEvents(sd, sendUrgent);
+
+   if( (length < 0) && (error == EWOULDBLOCK) ) {
+     return true;
+   }
+   if( (length < 0) && (error == ENOBUFS) ) {
+      // Messages have been lost: a running dump is repeated, and the main
+      // loop resynchronises with the kernel (see resynchroniseDynMHS()).
+      DMHS_LOG(warning) << "Netlink receive buffer overrun, messages have been lost";
+      DumpInterrupted = true;
+      ResyncNecessary = true;
+      return true;
+   }
+   errno = error;
+   return false;
+}
+
+
+// ###### Wait for Netlink acknowledgement ##################################
+static bool waitForAcknowledgement(const int          sd,
+                                   const unsigned int seqNumber,
+                                   const unsigned int timeout)
+{
+   WaitingForAcknowlegement = true;
+   AwaitedSeqNumber         = seqNumber;
+
+   // ====== Reception loop =================================================
+   const std::chrono::time_point<std::chrono::steady_clock> t1 =
+      std::chrono::steady_clock::now();
+   std::chrono::time_point<std::chrono::steady_clock> t2;
+   while(WaitingForAcknowlegement) {
+      t2 = std::chrono::steady_clock::now();
+      const int ms = timeout - std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
+      if(ms < 1) {
+         break;
+      }
+      pollfd pfd[1];
+      pfd[0].fd     = sd;
+      pfd[0].events = POLLIN;
+      const int events = poll((pollfd*)&pfd, 1, ms);
+      if(events > 0) {
+         receiveNetlinkMessages(sd, true);
+      }
+   }
+
+   return (WaitingForAcknowlegement == false);
+}
+
+
+// ###### Back off, but keep handling events ################################
+/* The backoff is the poll timeout of the event socket, so that the events
+ * are still handled in the meantime. */
+static void backOff(const int sd, const unsigned int backoff)
+{
+   const std::chrono::time_point<std::chrono::steady_clock> end =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(backoff);
+   int ms;
+   while( (ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                   end - std::chrono::steady_clock::now()).count()) > 0 ) {
+      pollfd pfd[1];
+      pfd[0].fd     = sd;   // Ignored by poll(), if negative
+      pfd[0].events = POLLIN;
+      if( (poll((pollfd*)&pfd, 1, ms) > 0) && (pfd[0].revents & POLLIN) ) {
+         receiveNetlinkMessages(sd, true);
+      }
+   }
+}
+
+
+// ###### Request a dump, repeating it if interrupted #######################
+/* The dumped objects are handled like events. If the kernel marks the dump
+ * with NLM_F_DUMP_INTR, objects may be missing, so only the affected
+ * families are dumped again. Since dump parts and events are received in
+ * order on the same socket, and the handlers are idempotent, events
+ * received in the meantime are merged correctly. After the last retry, a
+ * remaining inconsistency is left to the audit. */
+struct SimpleRequest {
+   int         RequestType;
+   const char* RequestName;
+};
+static bool requestDump(const int sd, const SimpleRequest& request)
+{
+   std::set<uint8_t> families = { AF_UNSPEC };
+   for(unsigned int attempt = 0; ; attempt++) {
+      DumpInterrupted = false;
+      InterruptedFamilies.clear();
+      for(const uint8_t family : families) {
+         DMHS_LOG(debug) << "Making " << request.RequestName << " request for family "
+                         << (unsigned int)family << " ...";
+         queueSimpleNetlinkRequest(request.RequestType, family);
+         sendQueuedRequests(sd);
+         if(!waitForAcknowledgement(sd, SeqNumber, NETLINK_TIMEOUT)) {
+            DMHS_LOG(error) << "No response to " << request.RequestName << " request";
+            return false;
+         }
+      }
+      if(!DumpInterrupted) {
+         return true;
+      }
+      if(attempt >= NETLINK_DUMP_RETRIES) {
+         DMHS_LOG(warning) << request.RequestName << " dump is still inconsistent after "
+                           << NETLINK_DUMP_RETRIES << " retries";
+         return true;
+      }
+
+      // ====== Back off, but keep handling events ==========================
+      if(!InterruptedFamilies.empty()) {
+         families = InterruptedFamilies;
+      }
+      const unsigned int backoff = NETLINK_DUMP_BACKOFF << attempt;
+      DMHS_LOG(debug) << boost::format("%s dump was interrupted, retry %u/%u in %u ms")
+                            % request.RequestName % (attempt + 1) % NETLINK_DUMP_RETRIES
+                            % backoff;
+      backOff(sd, backoff);
+   }
+}
+
+
+// ###### Dump kernel objects synchronously #################################
+/* The kernel marks a dump with NLM_F_DUMP_INTR, if the dumped objects have
+ * changed during the dump. Then, objects may be missing or duplicated. So,
+ * the messages are only handed to the callback after a consistent dump,
+ * and an interrupted dump of this family and object type is repeated. If
+ * the dump is still inconsistent after the last retry (e.g. on a router
+ * with permanent churn), the last one is used: the callers verify and
+ * reconcile it anyway. The events are handled during the backoff. */
+static bool dumpKernelObjects(const int                                    sd,
+                              nlmsghdr*                                    request,
+                              const std::function<void(const nlmsghdr*)>& callback)
+{
+   std::vector<std::string> messages;
+   for(unsigned int attempt = 0; attempt <= NETLINK_DUMP_RETRIES; attempt++) {
+      if(attempt > 0) {
+         // ------ Back off, to let the changes settle ----------------------
+         DMHS_LOG(debug) << boost::format("Dump of type %u, family %u was interrupted, retry %u/%u")
+                               % request->nlmsg_type
+                               % (unsigned int)((const rtgenmsg*)NLMSG_DATA(request))->rtgen_family
+                               % attempt % NETLINK_DUMP_RETRIES;
+         backOff(EventSD, NETLINK_DUMP_BACKOFF << (attempt - 1));
+      }
+
+      request->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+      request->nlmsg_pid   = 0;  // This field is opaque to netlink.
+      request->nlmsg_seq   = ++SeqNumber;
+      if(send(sd, request, request->nlmsg_len, 0) < 0) {
+         DMHS_LOG(error) << "send() failed: " << strerror(errno);
+         return false;
+      }
+
+      // ====== Reception loop ==============================================
+      nlmsghdr buffer[NETLINK_BUFFER / sizeof(nlmsghdr)];
+      const std::chrono::time_point<std::chrono::steady_clock> t1 =
+         std::chrono::steady_clock::now();
+      bool done        = false;
+      bool interrupted = false;
+      messages.clear();
+      while(!done) {
+         const int ms = NETLINK_TIMEOUT -
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now() - t1).count();
+         pollfd pfd[1];
+         pfd[0].fd     = sd;
+         pfd[0].events = POLLIN;
+         if( (ms < 1) || (poll((pollfd*)&pfd, 1, ms) < 1) ) {
+            DMHS_LOG(error) << "Timeout waiting for dump";
+            return false;
+         }
+         int length = recv(sd, buffer, sizeof(buffer), 0);
+         if(length < 0) {
+            DMHS_LOG(error) << "recv() failed: " << strerror(errno);
+            return false;
+         }
+         for(const nlmsghdr* header = (const nlmsghdr*)buffer;
+             NLMSG_OK(header, length); header = NLMSG_NEXT(header, length)) {
+            if(header->nlmsg_seq != request->nlmsg_seq) {
+               continue;
+            }
+            if(header->nlmsg_flags & NLM_F_DUMP_INTR) {
+               interrupted = true;
+            }
+            if(header->nlmsg_type == NLMSG_DONE) {
+               done = true;
+               break;
+            }
+            else if(header->nlmsg_type == NLMSG_ERROR) {
+               const nlmsgerr* errormsg = (const nlmsgerr*)NLMSG_DATA(header);
+               if( (header->nlmsg_len >= NLMSG_LENGTH(sizeof(nlmsgerr))) &&
+                   (errormsg->error == -ENOENT) ) {
+                  return true;   // The table does not exist (yet), i.e. it is empty
+               }
+               DMHS_LOG(error) << "Dump failed: " << strerror(-errormsg->error);
+               return false;
+            }
+            messages.push_back(std::string((const char*)header, header->nlmsg_len));
+         }
+      }
+
+      if(!interrupted) {
+         break;
+      }
+      if(attempt == NETLINK_DUMP_RETRIES) {
+         DMHS_LOG(warning) << boost::format("Dump of type %u is still inconsistent after %u retries, using the last one")
+                                 % request->nlmsg_type % NETLINK_DUMP_RETRIES;
+      }
+   }
+
+   // ====== Hand the messages to the callback ==============================
+   for(const std::string& message : messages) {
+      callback((const nlmsghdr*)message.data());
+   }
+   return true;
+}
+
+
+// ###### Add object to a snapshot of the kernel state ######################
+static void addToSnapshot(ObjectSet&            snapshot,
+                          const ObjectIdentity& identity,
+                          const nlmsghdr*       message)
+{
+   KernelObject& object = snapshot.Objects[identity.Key];
+   object.Message.assign((const char*)message, (const char*)message + message->nlmsg_len);
+   object.Digest     = identity.Digest;
+   snapshot.Digest  ^= identity.Digest;
+}
+
+
+// ###### Dump the routes of a table ########################################
+static bool dumpTableRoutes(const int          auditSD,
+                            const uint8_t      family,
+                            const unsigned int table,
+                            ObjectSet&         snapshot)
+{
+   struct _request {
+      nlmsghdr header;
+      rtmsg    rtm;
+      char     buffer[64];
+   } request;
+   memset(&request, 0, sizeof(request));
+   request.header.nlmsg_len  = NLMSG_LENGTH(sizeof(request.rtm));
+   request.header.nlmsg_type = RTM_GETROUTE;
+   request.rtm.rtm_family    = family;
+   request.rtm.rtm_table     = (table < 256) ? table : RT_TABLE_UNSPEC;
+   assure( addattr(&request.header, sizeof(request), RTA_TABLE,
+                   &table, sizeof(uint32_t)) == 0 );
+   /* In VRF mode, the kernel maintains the connected and local routes of
+    * the member interfaces in the VRF table. They are not owned by DynMHS. */
+   return dumpKernelObjects(auditSD, &request.header, [&](const nlmsghdr* message) {
+      ObjectIdentity identity;
+      if( (message->nlmsg_type == RTM_NEWROUTE) &&
+          (getRouteIdentity(message, identity)) &&
+          (identity.Table == table) &&
+          ( (!VRFMode) || (identity.Protocol != RTPROT_KERNEL) ) ) {
+         addToSnapshot(snapshot, identity, message);
+      }
+   });
+}
+
+
+// ###### Dump the routes over an interface in a table ######################
+/* The routes of the kernel (e.g. the connected routes) and the routes of
+ * DynMHS itself are skipped. */
+static bool dumpInterfaceRoutes(const int                       auditSD,
+                                const uint8_t                   family,
+                                const unsigned int              table,
+                                const int                       ifIndex,
+                                std::vector<std::vector<char>>& routes)
+{
+   struct _request {
+      nlmsghdr header;
+      rtmsg    rtm;
+      char     buffer[64];
+   } request;
+   memset(&request, 0, sizeof(request));
+   request.header.nlmsg_len  = NLMSG_LENGTH(sizeof(request.rtm));
+   request.header.nlmsg_type = RTM_GETROUTE;
+   request.rtm.rtm_family    = family;
+   request.rtm.rtm_table     = (table < 256) ? table : RT_TABLE_COMPAT;
+   assure( addattr(&request.header, sizeof(request), RTA_TABLE,
+                   &table, sizeof(uint32_t)) == 0 );
+   assure( addattr(&request.header, sizeof(request), RTA_OIF,
+                   &ifIndex, sizeof(uint32_t)) == 0 );
+   return dumpKernelObjects(auditSD, &request.header, [&](const nlmsghdr* message) {
+      ObjectIdentity identity;
+      if( (message->nlmsg_type == RTM_NEWROUTE) &&
+          (getRouteIdentity(message, identity)) &&
+          (identity.Table == table) &&
+          (identity.Protocol != RTPROT_KERNEL) &&
+          ( (Protocol == RTPROT_UNSPEC) || (identity.Protocol != Protocol) ) &&
+          (routeUsesInterface(message, ifIndex)) ) {
+         routes.push_back(std::vector<char>((const char*)message,
+                                            (const char*)message + message->nlmsg_len));
+      }
+   });
+}
+
+
+// ###### Dump the routes owned by DynMHS in all tables #####################
+/* With the strict checking of the audit socket, the kernel only returns the
+ * routes tagged with the DynMHS protocol ID (of the given table, if it is
+ * set). */
+static bool dumpOwnedRoutes(const int                          auditSD,
+                            const uint8_t                      family,
+                            std::map<unsigned int, ObjectSet>& snapshots,
+                            const unsigned int                 table = RT_TABLE_UNSPEC)
+{
+   struct _request {
+      nlmsghdr header;
+      rtmsg    rtm;
+      char     buffer[64];
+   } request;
+   memset(&request, 0, sizeof(request));
+   request.header.nlmsg_len  = NLMSG_LENGTH(sizeof(request.rtm));
+   request.header.nlmsg_type = RTM_GETROUTE;
+   request.rtm.rtm_family    = family;
+   request.rtm.rtm_protocol  = Protocol;
+   if(table != RT_TABLE_UNSPEC) {
+      request.rtm.rtm_table = (table < 256) ? table : RT_TABLE_UNSPEC;
+      assure( addattr(&request.header, sizeof(request), RTA_TABLE,
+                      &table, sizeof(uint32_t)) == 0 );
+   }
+   return dumpKernelObjects(auditSD, &request.header, [&](const nlmsghdr* message) {
+      ObjectIdentity identity;
+      if( (message->nlmsg_type == RTM_NEWROUTE) &&
+          (getRouteIdentity(message, identity)) &&
+          (identity.Protocol == Protocol) ) {
+         if( (table == RT_TABLE_UNSPEC) || (identity.Table == table) ) {
+            addToSnapshot(snapshots[identity.Table], identity, message);
+         }
+      }
+   });
+}
+
+
+// ###### Dump the rules pointing to a set of tables ########################
+/* Rule dumps cannot be filtered by the kernel. Rules are selected by their
+ * table, or by the DynMHS protocol ID if ownedOnly is set. */
+static bool dumpRules(const int                          auditSD,
+                      const uint8_t                      family,
+                      const std::set<unsigned int>&      tables,
+                      const bool                         ownedOnly,
+                      std::map<unsigned int, ObjectSet>& snapshots)
+{
+   struct _request {
+      nlmsghdr     header;
+      fib_rule_hdr frh;
+   } request;
+   memset(&request, 0, sizeof(request));
+   request.header.nlmsg_len  = NLMSG_LENGTH(sizeof(request.frh));
+   request.header.nlmsg_type = RTM_GETRULE;
+   request.frh.family        = family;
+   return dumpKernelObjects(auditSD, &request.header, [&](const nlmsghdr* message) {
+      ObjectIdentity identity;
+      if( (message->nlmsg_type == RTM_NEWRULE) &&
+          (getRuleIdentity(message, identity)) &&
+          ( (tables.find(identity.Table) != tables.end()) ||
+            ( (Protocol != RTPROT_UNSPEC) && (identity.Protocol == Protocol) ) ) &&
+          ( (!ownedOnly) || (identity.Protocol == Protocol) ) ) {
+         addToSnapshot(snapshots[identity.Table], identity, message);
+      }
+   });
+}
+
+
+// ###### Dump the nexthop objects owned by DynMHS ##########################
+/* Nexthop dumps cannot be filtered by protocol. Groups are handed to the
+ * callback after their members. */
+static bool dumpOwnedNexthops(const int                                    auditSD,
+                              const std::function<void(const nlmsghdr*)>& callback)
+{
+   struct _request {
+      nlmsghdr header;
+      nhmsg    nhm;
+   } request;
+   memset(&request, 0, sizeof(request));
+   request.header.nlmsg_len  = NLMSG_LENGTH(sizeof(request.nhm));
+   request.header.nlmsg_type = RTM_GETNEXTHOP;
+   std::vector<std::string> groups;
+   const bool success = dumpKernelObjects(auditSD, &request.header, [&](const nlmsghdr* message) {
+      const nhmsg* nhm = (const nhmsg*)NLMSG_DATA(message);
+      if( (message->nlmsg_type == RTM_NEWNEXTHOP) &&
+          (message->nlmsg_len >= NLMSG_LENGTH(sizeof(*nhm))) &&
+          (nhm->nh_protocol == Protocol) ) {
+         if(nhm->nh_family == AF_UNSPEC) {
+            groups.push_back(std::string((const char*)message, message->nlmsg_len));
+         }
+         else {
+            callback(message);
+         }
+      }
+   });
+   for(const std::string& group : groups) {
+      callback((const nlmsghdr*)group.data());
+   }
+   return success;
+}
+
+
+// ###### Load the nexthop objects owned by DynMHS ##########################
+/* The owned nexthop objects left in place by a warm restart become
+ * reusable, so that the adopted routes referencing them stay unchanged.
+ * A group takes references to its members. */
+static bool loadOwnedNexthops(const int auditSD)
+{
+   return dumpOwnedNexthops(auditSD, [&](const nlmsghdr* message) {
+      uint32_t                                  id;
+      NexthopInfo                               info;
+      const uint8_t*                            gateway;
+      std::vector<std::pair<uint32_t, uint8_t>> members;
+      if( (!parseNexthop(message, id, info, gateway, members)) ||
+          ( (members.empty()) && (gateway == nullptr) ) ) {
+         return;
+      }
+      for(const std::pair<uint32_t, uint8_t>& member : members) {
+         const auto key = OwnedNexthopKeys.find(member.first);
+         if(key == OwnedNexthopKeys.end()) {
+            return;   // Not a group of owned nexthop objects
+         }
+      }
+      const std::string key = getNexthopKey(info.Family, info.OIF, gateway, members);
+      if(OwnedNexthops.find(key) != OwnedNexthops.end()) {
+         return;   // Duplicate
+      }
+      for(const std::pair<uint32_t, uint8_t>& member : members) {
+         OwnedNexthops[OwnedNexthopKeys[member.first]].References++;
+      }
+      OwnedNexthop& nexthop = OwnedNexthops[key];
+      nexthop.ID         = id;
+      nexthop.References = 0;
+      nexthop.Members    = members;
+      OwnedNexthopKeys[id] = key;
+      DMHS_LOG(debug) << "Adopted nexthop " << id;
+   });
+}
+
+
+// ###### Remove the owned nexthop objects not used any more ################
+static void removeUnusedNexthops()
+{
+   // ====== Groups first, since they hold references to their members ======
+   for(unsigned int pass = 0; pass < 2; pass++) {
+      std::vector<uint32_t> unused;
+      for(auto iterator = OwnedNexthops.begin(); iterator != OwnedNexthops.end(); iterator++) {
+         if( (iterator->second.References == 0) &&
+             (iterator->second.Members.empty() == (pass == 1)) ) {
+            unused.push_back(iterator->second.ID);
+         }
+      }
+      for(const uint32_t id : unused) {
+         releaseNexthop(id);
+      }
+   }
+}
+
+
+// ###### Get the set of custom tables ######################################
+static std::set<unsigned int> getCustomTables()
+{
+   std::set<unsigned int> tables;
+   for(auto iterator = InterfaceMap.begin(); iterator != InterfaceMap.end(); iterator++) {
+      tables.insert(iterator->second.Table);
+   }
+   return tables;
+}
+
+
+// ###### Repair differences between expected and kernel state ##############
+static unsigned int repairObjects(const ObjectSet&   expected,
+                                  const ObjectSet&   kernel,
+                                  const uint16_t     newType,
+                                  const uint16_t     delType,
+                                  const unsigned int budget)
+{
+   if( (expected.Digest == kernel.Digest) &&
+       (expected.Objects.size() == kernel.Objects.size()) ) {
+      return 0;   // Digest matches -> nothing to do
+   }
+
+   // ====== Remove or correct unexpected objects ===========================
+   unsigned int repairs = 0;
+   for(auto iterator = kernel.Objects.begin();
+       (iterator != kernel.Objects.end()) && (repairs < budget); iterator++) {
+      const auto found = expected.Objects.find(iterator->first);
+      if(found == expected.Objects.end()) {
+         queueMessage((const nlmsghdr*)iterator->second.Message.data(), delType,
+                      NLM_F_REQUEST | NLM_F_ACK);
+         repairs++;
+      }
+      else if(found->second.Digest != iterator->second.Digest) {
+         queueMessage((const nlmsghdr*)found->second.Message.data(), newType,
+                      getInstallFlags(newType));
+         repairs++;
+      }
+   }
+
+   // ====== Add missing objects ============================================
+   for(auto iterator = expected.Objects.begin();
+       (iterator != expected.Objects.end()) && (repairs < budget); iterator++) {
+      if(kernel.Objects.find(iterator->first) == kernel.Objects.end()) {
+         queueMessage((const nlmsghdr*)iterator->second.Message.data(), newType,
+                      getInstallFlags(newType));
+         repairs++;
+      }
+   }
+   return repairs;
+}
+
+
+// ###### Audit the routes of a custom table ################################
+static unsigned int auditRoutes(const int          sd,
+                                const int          auditSD,
+                                const uint8_t      family,
+                                const std::string& interface,
+                                const unsigned int customTable,
+                                const unsigned int budget)
+{
+   struct _request {
+      nlmsghdr header;
+      rtmsg    rtm;
+      char     buffer[64];
+   } request;
+   unsigned int repairs = 0;
+
+   // ====== Resynchronise the source table routes of the interface =========
+   /* A missed notification, or routes flushed silently by the kernel, leave
+    * stale source routes. So, first compare them to a filtered dump. */
+   std::set<std::string> seen;
+   const unsigned int    ifIndex = if_nametoindex(interface.c_str());
+   const auto            network = InterfaceMap.find(interface);
+   if( (ifIndex > 0) && (network != InterfaceMap.end()) ) {
+      for(const uint32_t sourceTable : network->second.SourceTables) {
+         memset(&request, 0, sizeof(request));
+         request.header.nlmsg_len  = NLMSG_LENGTH(sizeof(request.rtm));
+         request.header.nlmsg_type = RTM_GETROUTE;
+         request.rtm.rtm_family    = family;
+         request.rtm.rtm_table     = (sourceTable < 256) ? sourceTable : RT_TABLE_COMPAT;
+         assure( addattr(&request.header, sizeof(request), RTA_TABLE,
+                         &sourceTable, sizeof(uint32_t)) == 0 );
+         assure( addattr(&request.header, sizeof(request), RTA_OIF,
+                         &ifIndex, sizeof(uint32_t)) == 0 );
+         if(!dumpKernelObjects(auditSD, &request.header, [&](const nlmsghdr* message) {
+               ObjectIdentity source;
+               if( (message->nlmsg_type == RTM_NEWROUTE) &&
+                   (getRouteIdentity(message, source)) &&
+                   (source.Table == sourceTable) &&
+                   ( (Protocol == RTPROT_UNSPEC) || (source.Protocol != Protocol) ) &&
+                   (routeUsesInterface(message, ifIndex)) &&
+                   (matchesClonePolicy(network->second, message)) ) {
+                  seen.insert(source.Key);
+                  const auto found = SourceRoutes.find(source.Key);
+                  if( ( (found == SourceRoutes.end()) ||
+                        (found->second.Digest != source.Digest) ) &&
+                      (repairs < budget) ) {
+                     updateSourceRoute(message, source);
+                     repairs++;
+                  }
+               }
+            })) {
+            return budget;   // Try again at the next audit
+         }
+      }
+   }
+   std::vector<std::string> staleSourceRoutes;
+   for(auto iterator = SourceRoutes.begin(); iterator != SourceRoutes.end(); iterator++) {
+      if( (iterator->second.Family == family) &&
+          (seen.find(iterator->first) == seen.end()) ) {
+         for(const SourceClone& clone : iterator->second.Clones) {
+            if(clone.Table == customTable) {
+               staleSourceRoutes.push_back(iterator->first);
+               break;
+            }
+         }
+      }
+   }
+   for(const std::string& sourceKey : staleSourceRoutes) {
+      if(repairs < budget) {
+         removeSourceRoute(sourceKey);
+         repairs++;
+      }
+   }
+   updateAggregation();
+   if(!sendQueuedRequests(sd)) {
+      return budget;
+   }
+
+   // ====== Compare the custom table to the expected state =================
+   ObjectSet kernel;
+   if(!dumpTableRoutes(auditSD, family, customTable, kernel)) {
+      return budget;
+   }
+   repairs += repairObjects(RouteSets[std::pair<uint8_t, unsigned int>(family, customTable)],
+                            kernel, RTM_NEWROUTE, RTM_DELROUTE,
+                            (repairs < budget) ? budget - repairs : 0);
+   return repairs;
+}
+
+
+// ###### Audit the rules pointing to custom tables #########################
+/* The multipath default route is audited together with the rules, since
+ * it is the only object of DynMHS in the main table. */
+static unsigned int auditRules(const int          auditSD,
+                               const uint8_t      family,
+                               const unsigned int budget)
+{
+   std::map<unsigned int, ObjectSet> snapshots;
+   if(!dumpRules(auditSD, family, getCustomTables(), false, snapshots)) {
+      return budget;
+   }
+   ObjectSet kernel;
+   for(auto iterator = snapshots.begin(); iterator != snapshots.end(); iterator++) {
+      for(auto object = iterator->second.Objects.begin();
+          object != iterator->second.Objects.end(); object++) {
+         kernel.Objects.insert(*object);
+      }
+      kernel.Digest ^= iterator->second.Digest;
+   }
+   unsigned int repairs = repairObjects(RuleSets[family], kernel,
+                                        RTM_NEWRULE, RTM_DELRULE, budget);
+
+   // ====== Multipath default route in the main table ======================
+   if( (MultipathMetric > 0) && (repairs < budget) ) {
+      std::map<unsigned int, ObjectSet> routeSnapshots;
+      if(!dumpOwnedRoutes(auditSD, family, routeSnapshots, RT_TABLE_MAIN)) {
+         return budget;
+      }
+      repairs += repairObjects(RouteSets[std::pair<uint8_t, unsigned int>(family, RT_TABLE_MAIN)],
+                               routeSnapshots[RT_TABLE_MAIN], RTM_NEWROUTE, RTM_DELROUTE,
+                               budget - repairs);
+   }
+   return repairs;
+}
+
+
+// ###### Audit the next custom table or rule set ###########################
+/* Each audit step only handles one unit, i.e. one custom table or one rule
+ * set of an address family, in order to spread the cost over time. */
+static void auditDynMHS(const int sd, const int auditSD)
+{
+   const unsigned int units  = 2 * (InterfaceMap.size() + 1);
+   const unsigned int unit   = AuditUnit % units;
+   const uint8_t      family = ((unit % 2) == 0) ? AF_INET : AF_INET6;
+   const unsigned int index  = unit / 2;
+
+   unsigned int repairs;
+   std::string  unitName;
+   if(index < InterfaceMap.size()) {
+      auto iterator = InterfaceMap.begin();
+      std::advance(iterator, index);
+      unitName = "table " + std::to_string(iterator->second.Table);
+      repairs  = auditRoutes(sd, auditSD, family, iterator->first, iterator->second.Table,
+                             AuditBudget);
+   }
+   else {
+      unitName = "rules";
+      repairs  = auditRules(auditSD, family, AuditBudget);
+   }
+   sendQueuedRequests(sd);
+
+   if(repairs > 0) {
+      DMHS_LOG(info) << boost::format("Audit of %s (IPv%u): %u repair(s)")
+                           % unitName % ((family == AF_INET) ? 4 : 6) % repairs;
+   }
+   else {
+      DMHS_LOG(debug) << boost::format("Audit of %s (IPv%u): consistent")
+                            % unitName % ((family == AF_INET) ? 4 : 6);
+   }
+   if(repairs < AuditBudget) {
+      AuditUnit++;
+   }
+}
+
+
+// ###### Resynchronise with the kernel after lost events ###################
+/* After a receive buffer overrun, any event may have been lost. So, the
+ * links, addresses, nexthop objects and routes are dumped again, and
+ * handled like events. Links, addresses and default routes of the main
+ * table that are missing in the dumps have been removed in the meantime.
+ * Finally, all custom tables and the rules are audited without budget. */
+static void resynchroniseDynMHS(const int sd, const int auditSD)
+{
+   DMHS_LOG(info) << "Resynchronising with the kernel ...";
+   struct _request {
+      nlmsghdr header;
+      char     buffer[64];
+   } request;
+
+   // ====== Links ==========================================================
+   std::set<int> links;
+   memset(&request, 0, sizeof(request));
+   request.header.nlmsg_len  = NLMSG_LENGTH(sizeof(ifinfomsg));
+   request.header.nlmsg_type = RTM_GETLINK;
+   if(!dumpKernelObjects(auditSD, &request.header, [&](const nlmsghdr* message) {
+         if( (message->nlmsg_type == RTM_NEWLINK) &&
+             (message->nlmsg_len >= NLMSG_LENGTH(sizeof(ifinfomsg))) ) {
+            links.insert(((const ifinfomsg*)NLMSG_DATA(message))->ifi_index);
+            handleLinkEvent(message);
+         }
+      })) {
+      ResyncNecessary = true;   // Try again
+      return;
+   }
+   std::map<std::string, int> removedLinks;
+   for(auto iterator = LinkIndices.begin(); iterator != LinkIndices.end(); iterator++) {
+      if(links.find(iterator->second) == links.end()) {
+         removedLinks.insert(*iterator);
+      }
+   }
+   for(auto iterator = removedLinks.begin(); iterator != removedLinks.end(); iterator++) {
+      struct _link {
+         nlmsghdr  header;
+         ifinfomsg ifi;
+         char      buffer[64];
+      } link;
+      memset(&link, 0, sizeof(link));
+      link.header.nlmsg_len  = NLMSG_LENGTH(sizeof(link.ifi));
+      link.header.nlmsg_type = RTM_DELLINK;
+      link.ifi.ifi_family    = AF_UNSPEC;
+      link.ifi.ifi_index     = iterator->second;
+      assure( addattr(&link.header, sizeof(link), IFLA_IFNAME,
+                      iterator->first.c_str(), iterator->first.size() + 1) == 0 );
+      handleLinkEvent(&link.header);
+   }
+
+   // ====== Addresses ======================================================
+   std::set<std::string> addresses;
+   memset(&request, 0, sizeof(request));
+   request.header.nlmsg_len  = NLMSG_LENGTH(sizeof(ifaddrmsg));
+   request.header.nlmsg_type = RTM_GETADDR;
+   if(!dumpKernelObjects(auditSD, &request.header, [&](const nlmsghdr* message) {
+         if( (message->nlmsg_type != RTM_NEWADDR) ||
+             (message->nlmsg_len < NLMSG_LENGTH(sizeof(ifaddrmsg))) ) {
+            return;
+         }
+         const ifaddrmsg* ifa    = (const ifaddrmsg*)NLMSG_DATA(message);
+         unsigned int     length = message->nlmsg_len - NLMSG_LENGTH(sizeof(*ifa));
+         for(const rtattr* rta = IFA_RTA(ifa); RTA_OK(rta, length); rta = RTA_NEXT(rta, length)) {
+            if(rta->rta_type == IFA_ADDRESS) {
+               addresses.insert(getAddressKey(ifa->ifa_index, ifa->ifa_family, RTA_DATA(rta)));
+            }
+         }
+         handleAddressEvent(message);
+      })) {
+      ResyncNecessary = true;
+      return;
+   }
+   std::set<uint8_t> families;
+   for(auto iterator = ManagedAddresses.begin(); iterator != ManagedAddresses.end(); ) {
+      if(addresses.find(iterator->first) == addresses.end()) {
+         families.insert(iterator->second.Family);
+         withdrawAddress(iterator->second.Family, &iterator->second.Address, true);
+         LifetimeWheel.cancel(getLifetimeKey(LT_Deprecated, iterator->first));
+         LifetimeWheel.cancel(getLifetimeKey(LT_Valid, iterator->first));
+         iterator = ManagedAddresses.erase(iterator);
+      }
+      else {
+         iterator++;
+      }
+   }
+   for(const uint8_t family : families) {
+      updateAddressRules(family);
+   }
+   if(!families.empty()) {
+      MPTCPEndpointsChanged = true;
+      if(HealthProber.isOpen()) {
+         updateProbeSources();
+      }
+   }
+
+   // ====== Nexthop objects and routes =====================================
+   memset(&request, 0, sizeof(request));
+   request.header.nlmsg_len  = NLMSG_LENGTH(sizeof(nhmsg));
+   request.header.nlmsg_type = RTM_GETNEXTHOP;
+   if(!dumpKernelObjects(auditSD, &request.header, [&](const nlmsghdr* message) {
+         if( (message->nlmsg_type == RTM_NEWNEXTHOP) &&
+             (message->nlmsg_len >= NLMSG_LENGTH(sizeof(nhmsg))) ) {
+            handleNexthopEvent(message);
+         }
+      })) {
+      DMHS_LOG(debug) << "No nexthop objects";   // E.g. not supported by the kernel
+   }
+   std::set<std::string> routes;
+   memset(&request, 0, sizeof(request));
+   request.header.nlmsg_len  = NLMSG_LENGTH(sizeof(rtmsg));
+   request.header.nlmsg_type = RTM_GETROUTE;
+   if(!dumpKernelObjects(auditSD, &request.header, [&](const nlmsghdr* message) {
+         ObjectIdentity identity;
+         if( (message->nlmsg_type == RTM_NEWROUTE) &&
+             (message->nlmsg_len >= NLMSG_LENGTH(sizeof(rtmsg))) &&
+             (getRouteIdentity(message, identity)) ) {
+            routes.insert(identity.Key);
+            handleRouteEvent(message);
+         }
+      })) {
+      ResyncNecessary = true;
+      return;
+   }
+   families.clear();
+   for(auto iterator = MainDefaultRoutes.begin(); iterator != MainDefaultRoutes.end(); ) {
+      if(routes.find(iterator->first) == routes.end()) {
+         families.insert(iterator->second.Family);
+         iterator = MainDefaultRoutes.erase(iterator);
+      }
+      else {
+         iterator++;
+      }
+   }
+   for(const uint8_t family : families) {
+      updateMultipathRoute(family);
+   }
+   updateAggregation();
+   sendQueuedRequests(sd);
+
+   // ====== Audit the custom tables and the rules ==========================
+   /* The audit also withdraws the clones of source routes that are missing
+    * in the kernel. */
+   for(const uint8_t family : { AF_INET, AF_INET6 }) {
+      for(auto iterator = InterfaceMap.begin(); iterator != InterfaceMap.end(); iterator++) {
+         auditRoutes(sd, auditSD, family, iterator->first, iterator->second.Table, UINT_MAX);
+      }
+      auditRules(auditSD, family, UINT_MAX);
+   }
+   sendQueuedRequests(sd);
+   DMHS_LOG(info) << "Resynchronised with the kernel";
+}
+
+
+// ###### Sample the interface statistics of the networks ###################
+/* One dump of the 64-bit counters of all interfaces replaces a request per
+ * interface. */
+static void sampleStatistics(const int auditSD)
+{
+   std::map<int, const NetworkConfig*> networks;   // Interface index -> network
+   for(auto iterator = InterfaceMap.begin(); iterator != InterfaceMap.end(); iterator++) {
+      const auto link = LinkIndices.find(iterator->first);
+      if( (iterator->second.Capacity > 0.0) && (link != LinkIndices.end()) ) {
+         networks[link->second] = &iterator->second;
+      }
+   }
+   if(networks.empty()) {
+      return;
+   }
+
+   struct _request {
+      nlmsghdr     header;
+      if_stats_msg ifsm;
+   } request;
+   memset(&request, 0, sizeof(request));
+   request.header.nlmsg_len  = NLMSG_LENGTH(sizeof(request.ifsm));
+   request.header.nlmsg_type = RTM_GETSTATS;
+   request.ifsm.family       = AF_UNSPEC;
+   request.ifsm.filter_mask  = IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64);
+   const std::chrono::time_point<std::chrono::steady_clock> now =
+      std::chrono::steady_clock::now();
+   const bool success = dumpKernelObjects(auditSD, &request.header, [&](const nlmsghdr* message) {
+      const if_stats_msg* ifsm = (const if_stats_msg*)NLMSG_DATA(message);
+      const auto          found = networks.find(ifsm->ifindex);
+      if( (message->nlmsg_type != RTM_NEWSTATS) ||
+          (message->nlmsg_len < NLMSG_LENGTH(sizeof(*ifsm))) || (found == networks.end()) ) {
+         return;
+      }
+      int length = message->nlmsg_len - NLMSG_LENGTH(sizeof(*ifsm));
+      for(const rtattr* rta = (const rtattr*)((const char*)ifsm + NLMSG_ALIGN(sizeof(*ifsm)));
+          RTA_OK(rta, length); rta = RTA_NEXT(rta, length)) {
+         if( (rta->rta_type != IFLA_STATS_LINK_64) ||
+             (RTA_PAYLOAD(rta) < sizeof(rtnl_link_stats64)) ) {
+            continue;
+         }
+         const rtnl_link_stats64* stats = (const rtnl_link_stats64*)RTA_DATA(rta);
+
+         // ====== Update the utilisation ===================================
+         const NetworkConfig* networkConfig = found->second;
+         const auto           previous      = NetworkStatistics.find(networkConfig->Table);
+         if(previous != NetworkStatistics.end()) {
+            LinkStatistics& statistics = previous->second;
+            const double seconds = std::chrono::duration<double>(now - statistics.SampleTime).count();
+            if( (seconds > 0.0) &&
+                (stats->rx_bytes >= statistics.RxBytes) && (stats->tx_bytes >= statistics.TxBytes) ) {
+               const double rate = 8.0 * std::max(stats->rx_bytes - statistics.RxBytes,
+                                                  stats->tx_bytes - statistics.TxBytes) / seconds;
+               const double utilisation = std::min(1.0, rate / (1000000.0 * networkConfig->Capacity));
+               statistics.Utilisation = UTILISATION_SMOOTHING * utilisation +
+                                           (1.0 - UTILISATION_SMOOTHING) * statistics.Utilisation;
+               DMHS_LOG(trace) << boost::format("Utilisation of table %u: %1.1f%%")
+                                     % networkConfig->Table % (100.0 * statistics.Utilisation);
+            }
+            statistics.RxBytes    = stats->rx_bytes;
+            statistics.TxBytes    = stats->tx_bytes;
+            statistics.SampleTime = now;
+         }
+         else {
+            NetworkStatistics[networkConfig->Table] = { stats->rx_bytes, stats->tx_bytes, now, 0.0 };
+         }
+      }
+   });
+   if(!success) {
+      return;   // Try again at the next sample
+   }
+   updateMultipathRoute(AF_INET);
+   updateMultipathRoute(AF_INET6);
+}
+
+
+// ###### Save the set of tables owned by DynMHS ############################
+static void saveOwnedTables()
+{
+   std::error_code ec;
+   std::filesystem::create_directories(RUNTIME_DIRECTORY, ec);
+   std::ofstream ownedTablesStream(OWNED_TABLES_FILE);
+   for(const unsigned int table : getCustomTables()) {
+      ownedTablesStream << table << "\n";
+   }
+   if(!ownedTablesStream.good()) {
+      DMHS_LOG(warning) << "Unable to write " << OWNED_TABLES_FILE;
+   }
+}
+
+
+// ###### Load the set of tables owned by DynMHS ############################
+static std::set<unsigned int> loadOwnedTables()
+{
+   std::set<unsigned int> tables;
+   std::ifstream          ownedTablesStream(OWNED_TABLES_FILE);
+   unsigned int           table;
+   while(ownedTablesStream >> table) {
+      tables.insert(table);
+   }
+   std::error_code ec;
+   std::filesystem::remove(OWNED_TABLES_FILE, ec);
+   return tables;
+}
+
+
+// ###### Adopt rules and routes left in place by a warm restart ############
+/* The rules and routes of the configured custom tables become adoptable:
+ * installObject() takes over an identical object instead of installing
+ * it again. Objects of tables that were owned before, but are not
+ * configured any more, are removed. */
+static bool adoptKernelState(const int sd, const int auditSD)
+{
+   const std::set<unsigned int> customTables = getCustomTables();
+   std::set<unsigned int>       ownedTables  = loadOwnedTables();
+   std::set<unsigned int>       routeTables  = customTables;
+   ownedTables.insert(customTables.begin(), customTables.end());
+   if(MultipathMetric > 0) {
+      routeTables.insert(RT_TABLE_MAIN);   // Only the tagged routes are dumped
+   }
+
+   unsigned int adopted = 0;
+   unsigned int removed = 0;
+   static const uint8_t families[] = { AF_INET, AF_INET6 };
+   for(const uint8_t family : families) {
+      // ====== Rules =======================================================
+      std::map<unsigned int, ObjectSet> ruleSnapshots;
+      if(!dumpRules(auditSD, family, ownedTables, false, ruleSnapshots)) {
+         return false;
+      }
+      for(auto iterator = ruleSnapshots.begin(); iterator != ruleSnapshots.end(); iterator++) {
+         for(auto object = iterator->second.Objects.begin();
+             object != iterator->second.Objects.end(); object++) {
+            if(customTables.find(iterator->first) != customTables.end()) {
+               RuleSets[family].Adoptable.insert(*object);
+               adopted++;
+            }
+            else {
+               queueMessage((const nlmsghdr*)object->second.Message.data(), RTM_DELRULE,
+                            NLM_F_REQUEST | NLM_F_ACK);
+               removed++;
+            }
+         }
+      }
+
+      // ====== Routes ======================================================
+      /* Tagged routes are found in any table, e.g. after a crash with a
+       * different configuration. */
+      std::map<unsigned int, ObjectSet> routeSnapshots;
+      if( (Protocol != RTPROT_UNSPEC) &&
+          (!dumpOwnedRoutes(auditSD, family, routeSnapshots)) ) {
+         return false;
+      }
+      for(const unsigned int table : ownedTables) {
+         if(!dumpTableRoutes(auditSD, family, table, routeSnapshots[table])) {
+            return false;
+         }
+      }
+      for(auto iterator = routeSnapshots.begin(); iterator != routeSnapshots.end(); iterator++) {
+         const unsigned int table = iterator->first;
+         for(auto object = iterator->second.Objects.begin();
+             object != iterator->second.Objects.end(); object++) {
+            if(routeTables.find(table) != routeTables.end()) {
+               RouteSets[std::pair<uint8_t, unsigned int>(family, table)].Adoptable.insert(*object);
+               adopted++;
+            }
+            else {
+               queueMessage((const nlmsghdr*)object->second.Message.data(), RTM_DELROUTE,
+                            NLM_F_REQUEST | NLM_F_ACK);
+               removed++;
+            }
+         }
+      }
+   }
+
+   DMHS_LOG(info) << boost::format("Found %u adoptable rules/routes, removing %u of unconfigured tables")
+                        % adopted % removed;
+   return sendQueuedRequests(sd);
+}
+
+
+// ###### Keep only the adoptable objects that are present in the kernel ####
+/* Returns the number of objects that are missing in the kernel. They are
+ * removed from the journal as well, so that installObject() installs them
+ * again. */
+static unsigned int verifyAdoptable(ObjectSet&                                 objectSet,
+                                    const std::map<std::string, KernelObject>& kernelObjects,
+                                    const uint16_t                             type)
+{
+   unsigned int missing = 0;
+   for(auto object = objectSet.Adoptable.begin(); object != objectSet.Adoptable.end(); ) {
+      const auto found = kernelObjects.find(object->first);
+      if(found == kernelObjects.end()) {
+         OwnershipJournal.remove(getJournalKey(type, object->first));
+         object = objectSet.Adoptable.erase(object);
+         missing++;
+      }
+      else {
+         object->second = found->second;   // The kernel's version is compared
+         object++;
+      }
+   }
+   return missing;
+}
+
+
+// ###### Adopt rules and routes recorded in the journal ####################
+/* After a crash or warm restart, the journal tells exactly which objects
+ * DynMHS owns: objects of configured custom tables become adoptable, all
+ * other objects are removed in one batch. Since an object is recorded when
+ * its request is sent, it may have been rejected by the kernel, or removed
+ * by someone else in the meantime. Therefore, the adoptable objects are
+ * checked against a dump of the configured tables; foreign and owned tables
+ * of other configurations need no dumps. */
+static bool adoptJournalState(const int sd, const int auditSD)
+{
+   const std::set<unsigned int> customTables = getCustomTables();
+   std::set<unsigned int>       routeTables  = customTables;
+   std::vector<std::string>     removedKeys;
+   if(MultipathMetric > 0) {
+      routeTables.insert(RT_TABLE_MAIN);
+   }
+   unsigned int                 adopted = 0;
+   OwnershipJournal.forEach([&](const std::string& key, const void* data, const size_t length) {
+      const nlmsghdr* message = (const nlmsghdr*)data;
+      const bool      isRoute = (key[0] == 'r');
+      ObjectIdentity  identity;
+      if( (length < sizeof(nlmsghdr)) || (message->nlmsg_len != length) ||
+          (!(isRoute ? getRouteIdentity(message, identity) :
+                       getRuleIdentity(message, identity))) ) {
+         removedKeys.push_back(key);   // Invalid record
+         return;
+      }
+      const std::set<unsigned int>& tables = (isRoute) ? routeTables : customTables;
+      if(tables.find(identity.Table) != tables.end()) {
+         ObjectSet& objectSet = (isRoute) ?
+            RouteSets[std::pair<uint8_t, unsigned int>(identity.Family, identity.Table)] :
+            RuleSets[identity.Family];
+         KernelObject& object = objectSet.Adoptable[identity.Key];
+         object.Message.assign((const char*)data, (const char*)data + length);
+         object.Digest = identity.Digest;
+         adopted++;
+      }
+      else {
+         queueMessage(message, (isRoute) ? RTM_DELROUTE : RTM_DELRULE,
+                      NLM_F_REQUEST | NLM_F_ACK);
+         removedKeys.push_back(key);
+      }
+   });
+   for(const std::string& key : removedKeys) {
+      OwnershipJournal.remove(key);
+   }
+
+   // ====== Check the adoptable objects against the kernel =================
+   unsigned int missing = 0;
+   static const uint8_t families[] = { AF_INET, AF_INET6 };
+   for(const uint8_t family : families) {
+      std::map<unsigned int, ObjectSet> ruleSnapshots;
+      if(!dumpRules(auditSD, family, customTables, false, ruleSnapshots)) {
+         return false;
+      }
+      std::map<std::string, KernelObject> rules;
+      for(auto iterator = ruleSnapshots.begin(); iterator != ruleSnapshots.end(); iterator++) {
+         rules.insert(iterator->second.Objects.begin(), iterator->second.Objects.end());
+      }
+      missing += verifyAdoptable(RuleSets[family], rules, RTM_DELRULE);
+
+      for(const unsigned int table : routeTables) {
+         // Only the tagged routes of the main table are owned by DynMHS.
+         std::map<unsigned int, ObjectSet> routeSnapshots;
+         const bool dumped = (table == RT_TABLE_MAIN) ?
+            dumpOwnedRoutes(auditSD, family, routeSnapshots, table) :
+            dumpTableRoutes(auditSD, family, table, routeSnapshots[table]);
+         if(!dumped) {
+            return false;
+         }
+         missing += verifyAdoptable(RouteSets[std::pair<uint8_t, unsigned int>(family, table)],
+                                    routeSnapshots[table].Objects, RTM_DELROUTE);
+      }
+   }
+   adopted -= missing;
+
+   DMHS_LOG(info) << boost::format("Journal: %u adoptable rules/routes, removing %u of unconfigured tables")
+                        % adopted % removedKeys.size();
+   if(missing > 0) {
+      DMHS_LOG(warning) << boost::format("Journal: %u recorded rules/routes are missing in the kernel, installing them again")
+                              % missing;
+   }
+   return sendQueuedRequests(sd);
+}
+
+
+// ###### Remove rules and routes that have not been adopted ################
+static bool reconcileKernelState(const int sd)
+{
+   unsigned int removed = 0;
+   for(auto iterator = RuleSets.begin(); iterator != RuleSets.end(); iterator++) {
+      for(auto object = iterator->second.Adoptable.begin();
+          object != iterator->second.Adoptable.end(); object++) {
+         queueMessage((const nlmsghdr*)object->second.Message.data(), RTM_DELRULE,
+                      NLM_F_REQUEST | NLM_F_ACK);
+         OwnershipJournal.remove(getJournalKey(RTM_DELRULE, object->first));
+         removed++;
+      }
+      iterator->second.Adoptable.clear();
+   }
+   for(auto iterator = RouteSets.begin(); iterator != RouteSets.end(); iterator++) {
+      for(auto object = iterator->second.Adoptable.begin();
+          object != iterator->second.Adoptable.end(); object++) {
+         queueMessage((const nlmsghdr*)object->second.Message.data(), RTM_DELROUTE,
+                      NLM_F_REQUEST | NLM_F_ACK);
+         OwnershipJournal.remove(getJournalKey(RTM_DELROUTE, object->first));
+         removed++;
+      }
+      iterator->second.Adoptable.clear();
+   }
+
+   DMHS_LOG(info) << "Reconciled kernel state, removed " << removed << " stale rules/routes";
+   return sendQueuedRequests(sd);
+}
+
+
+// ###### Dump the VRF devices ##############################################
+struct VRFDevice {
+   int           IfIndex;
+   unsigned int  Table;
+   std::set<int> Members;   // Interface indices of the member interfaces
+};
+static bool dumpVRFDevices(const int auditSD, std::map<std::string, VRFDevice>& devices)
+{
+   struct _request {
+      nlmsghdr  header;
+      ifinfomsg ifi;
+   } request;
+   memset(&request, 0, sizeof(request));
+   request.header.nlmsg_len  = NLMSG_LENGTH(sizeof(request.ifi));
+   request.header.nlmsg_type = RTM_GETLINK;
+   request.ifi.ifi_family    = AF_UNSPEC;
+
+   std::map<int, std::set<int>> members;   // Master -> interfaces
+   const bool success = dumpKernelObjects(auditSD, &request.header, [&](const nlmsghdr* message) {
+      if( (message->nlmsg_type != RTM_NEWLINK) ||
+          (message->nlmsg_len < NLMSG_LENGTH(sizeof(ifinfomsg))) ) {
+         return;
+      }
+      const ifinfomsg* ifinfo = (const ifinfomsg*)NLMSG_DATA(message);
+      unsigned int     length = message->nlmsg_len - NLMSG_LENGTH(sizeof(*ifinfo));
+      const char*      ifName = nullptr;
+      bool             isVRF  = false;
+      unsigned int     table  = 0;
+      for(const rtattr* rta = IFLA_RTA(ifinfo); RTA_OK(rta, length); rta = RTA_NEXT(rta, length)) {
+         if(rta->rta_type == IFLA_IFNAME) {
+            ifName = (const char*)RTA_DATA(rta);
+         }
+         else if(rta->rta_type == IFLA_MASTER) {
+            members[*(const int*)RTA_DATA(rta)].insert(ifinfo->ifi_index);
+         }
+         else if(rta->rta_type == IFLA_LINKINFO) {
+            unsigned int infoLength = RTA_PAYLOAD(rta);
+            for(const rtattr* info = (const rtattr*)RTA_DATA(rta); RTA_OK(info, infoLength);
+                info = RTA_NEXT(info, infoLength)) {
+               if( (info->rta_type == IFLA_INFO_KIND) &&
+                   (strcmp((const char*)RTA_DATA(info), "vrf") == 0) ) {
+                  isVRF = true;
+               }
+               else if(info->rta_type == IFLA_INFO_DATA) {
+                  unsigned int dataLength = RTA_PAYLOAD(info);
+                  for(const rtattr* data = (const rtattr*)RTA_DATA(info); RTA_OK(data, dataLength);
+                      data = RTA_NEXT(data, dataLength)) {
+                     if( (data->rta_type == IFLA_VRF_TABLE) &&
+                         (RTA_PAYLOAD(data) >= sizeof(uint32_t)) ) {
+                        table = *(const uint32_t*)RTA_DATA(data);
+                     }
+                  }
+               }
+            }
+         }
+      }
+      if( (isVRF) && (ifName != nullptr) ) {
+         devices[ifName] = VRFDevice { ifinfo->ifi_index, table, std::set<int>() };
+      }
+   });
+   for(auto iterator = devices.begin(); iterator != devices.end(); iterator++) {
+      iterator->second.Members.swap(members[iterator->second.IfIndex]);
+   }
+   return success;
+}
+
+
+// ###### Install routes again in a table ###################################
+/* The routes keep their protocol, i.e. they are not owned by DynMHS. */
+static void restoreRoutes(const std::vector<std::vector<char>>& routes,
+                          const unsigned int                    table)
+{
+   for(const std::vector<char>& route : routes) {
+      const nlmsghdr*   message = (const nlmsghdr*)route.data();
+      std::vector<char> copy;
+      cloneRoute(message, table, copy);
+      ((rtmsg*)NLMSG_DATA((nlmsghdr*)copy.data()))->rtm_protocol =
+         ((const rtmsg*)NLMSG_DATA(message))->rtm_protocol;
+      queueMessage((const nlmsghdr*)copy.data(), RTM_NEWROUTE,
+                   NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE | NLM_F_REPLACE);
+   }
+}
+
+
+// ###### Remove VRF devices ################################################
+/* Removes the VRF devices of DynMHS, except for the ones of configured
+ * custom tables if keepConfigured is set. Removing a VRF device releases
+ * its member interfaces, which the vrf driver takes down and up. This
+ * flushes their routes. So, the routes over the member interfaces in the
+ * main table and in the VRF table are dumped before, and installed in the
+ * main table afterwards. */
+static bool removeVRFDevices(const int sd, const int auditSD, const bool keepConfigured)
+{
+   const std::set<unsigned int>     customTables = getCustomTables();
+   std::map<std::string, VRFDevice> devices;
+   if(!dumpVRFDevices(auditSD, devices)) {
+      return false;
+   }
+
+   std::vector<int>               removals;
+   std::vector<std::vector<char>> routes;
+   for(auto iterator = devices.begin(); iterator != devices.end(); iterator++) {
+      // ------ Find VRF devices named "dmhs<table>" ------------------------
+      const char*  ifName       = iterator->first.c_str();
+      const size_t prefixLength = strlen(VRF_NAME_PREFIX);
+      if( (strncmp(ifName, VRF_NAME_PREFIX, prefixLength) != 0) ||
+          (ifName[prefixLength] == 0) ||
+          (strspn(&ifName[prefixLength], "0123456789") != strlen(&ifName[prefixLength])) ) {
+         continue;
+      }
+      const unsigned int table = atol(&ifName[prefixLength]);
+      if( (keepConfigured) && (VRFMode) &&
+          (customTables.find(table) != customTables.end()) ) {
+         continue;
+      }
+
+      // ------ Dump the routes over the member interfaces ------------------
+      /* The dumps have to precede the queued removals, since they use up
+       * sequence numbers. */
+      for(const int member : iterator->second.Members) {
+         for(const uint8_t family : { AF_INET, AF_INET6 }) {
+            if( (!dumpInterfaceRoutes(auditSD, family, RT_TABLE_MAIN, member, routes)) ||
+                (!dumpInterfaceRoutes(auditSD, family, iterator->second.Table, member, routes)) ) {
+               return false;
+            }
+         }
+      }
+      DMHS_LOG(info) << "Removing VRF " << ifName << " ...";
+      removals.push_back(iterator->second.IfIndex);
+   }
+
+   // ====== Remove the VRF devices =========================================
+   for(const int ifIndex : removals) {
+      struct _request {
+         nlmsghdr  header;
+         ifinfomsg ifi;
+      } request;
+      memset(&request, 0, sizeof(request));
+      request.header.nlmsg_len = NLMSG_LENGTH(sizeof(request.ifi));
+      request.ifi.ifi_family   = AF_UNSPEC;
+      request.ifi.ifi_index    = ifIndex;
+      queueMessage(&request.header, RTM_DELLINK, NLM_F_REQUEST | NLM_F_ACK);
+   }
+   if(!removals.empty()) {
+      if(!sendQueuedRequests(sd)) {
+         return false;
+      }
+      if(!waitForAcknowledgement(sd, SeqNumber, NETLINK_TIMEOUT)) {
+         DMHS_LOG(error) << "Timeout waiting for acknowledgement";
+      }
+   }
 
-      // ------ Remove Netlink request from queue ---------------------------
-      delete [] message;
-      RequestQueue.pop();
+   // ====== Install the routes of the former members in the main table =====
+   if(!routes.empty()) {
+      DMHS_LOG(info) << boost::format("Installing %u routes of the former VRF members in the main table")
+                           % routes.size();
+      restoreRoutes(routes, RT_TABLE_MAIN);
+      if(!sendQueuedRequests(sd)) {
+         return false;
+      }
+      if(!waitForAcknowledgement(sd, SeqNumber, NETLINK_TIMEOUT)) {
+         DMHS_LOG(error) << "Timeout waiting for acknowledgement";
+      }
    }
+   VRFDevices.clear();
+   PendingVRFMembers.clear();
    return true;
 }
 
 
-// ###### Read Netlink message ##############################################
-static bool receiveNetlinkMessages(const int  sd,
-                                   const bool nonBlocking = false)
+// ###### Create or adopt the VRF devices of the custom tables ##############
+/* If the kernel does not support VRF devices, or a device name is in use
+ * by another device, DynMHS falls back to rules. Then, the VRF devices that
+ * have already been created or adopted are removed again. */
+static bool setupVRFDevices(const int sd, const int auditSD)
 {
-   // ====== Initialise structures for recvmsg() ============================
-   nlmsghdr    buffer[65536 / sizeof(nlmsghdr)];
-   iovec       iov { buffer, sizeof(buffer) };
-   sockaddr_nl sa;
-   msghdr      msg { .msg_name       = &sa,
-                     .msg_namelen    = sizeof(sa),
-                     .msg_iov        = (iovec*)&iov,
-                     .msg_iovlen     = 1,
-                     .msg_control    = nullptr,
-                     .msg_controllen = 0,
-                     .msg_flags      = 0 };
-   const int   flags = (nonBlocking == true) ? MSG_DONTWAIT : 0;
-   int         length;
-
-   // ====== Reception loop =================================================
-   while( (length = recvmsg(sd, &msg, flags)) > 0) {
-      for(const nlmsghdr* header = (const nlmsghdr*)buffer;
-          NLMSG_OK(header, length); header = NLMSG_NEXT(header, length)) {
+   std::map<std::string, VRFDevice> devices;
+   if(!dumpVRFDevices(auditSD, devices)) {
+      return false;
+   }
+   for(const unsigned int table : getCustomTables()) {
+      const std::string name    = getVRFName(table);
+      int               ifIndex = if_nametoindex(name.c_str());
+      if(ifIndex == 0) {
+         // ------ Build RTM_NEWLINK request --------------------------------
+         struct _request {
+            nlmsghdr  header;
+            ifinfomsg ifi;
+            char      buffer[256];
+         } request;
+         memset(&request, 0, sizeof(request));
+         request.header.nlmsg_len  = NLMSG_LENGTH(sizeof(request.ifi));
+         request.header.nlmsg_type = RTM_NEWLINK;
+         request.ifi.ifi_family    = AF_UNSPEC;
+         request.ifi.ifi_flags     = IFF_UP;
+         request.ifi.ifi_change    = IFF_UP;
+         assure( addattr(&request.header, sizeof(request), IFLA_IFNAME,
+                         name.c_str(), name.size() + 1) == 0 );
+         rtattr* linkInfo = addattr_nest(&request.header, sizeof(request), IFLA_LINKINFO);
+         assure( addattr(&request.header, sizeof(request), IFLA_INFO_KIND,
+                         "vrf", 4) == 0 );
+         rtattr* infoData = addattr_nest(&request.header, sizeof(request), IFLA_INFO_DATA);
+         assure( addattr(&request.header, sizeof(request), IFLA_VRF_TABLE,
+                         &table, sizeof(uint32_t)) == 0 );
+         addattr_nest_end(&request.header, infoData);
+         addattr_nest_end(&request.header, linkInfo);
 
-         // ====== Check whether this acknowledgement was waited ============
-         if((WaitingForAcknowlegement) &&
-            (header->nlmsg_seq == AwaitedSeqNumber)) {
-            if( (header->nlmsg_type == NLMSG_ERROR) &&
-                (header->nlmsg_len >= NLMSG_LENGTH(sizeof(nlmsgerr))) ) {
-               const nlmsgerr* errormsg = (const nlmsgerr*)NLMSG_DATA(header);
-               LastError = errormsg->error;
-            }
-            else {
-               LastError = 0;   // success
-            }
-            DMHS_LOG(trace) << boost::format("Got awaited ack for seqnum %u: error %d (%s)")
-                                  % header->nlmsg_seq
-                                  % LastError
-                                  % strerror(-LastError);
-            WaitingForAcknowlegement = false;
+         // ------ Create the VRF device ------------------------------------
+         DMHS_LOG(info) << "Creating VRF " << name << " for table " << table << " ...";
+         queueMessage(&request.header, RTM_NEWLINK,
+                      NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE | NLM_F_EXCL);
+         if(!sendQueuedRequests(sd)) {
+            return false;
          }
-
-         // ====== Handle the different message types =======================
-         switch(header->nlmsg_type) {
-            case NLMSG_DONE:
-               // The end of a multipart message
-               if(nonBlocking) {
-                  continue;
-               }
-               return true;
-             break;
-            case NLMSG_ERROR:
-               if(header->nlmsg_len >= NLMSG_LENGTH(sizeof(nlmsgerr))) {
-                  handleError(header);
-               }
-             break;
-            case RTM_NEWLINK:
-            case RTM_DELLINK:
-               if(header->nlmsg_len >= NLMSG_LENGTH(sizeof(ifinfomsg))) {
-                  handleLinkEvent(header);
-               }
-             break;
-            case RTM_NEWADDR:
-            case RTM_DELADDR:
-               if(header->nlmsg_len >= NLMSG_LENGTH(sizeof(ifaddrmsg))) {
-                  handleAddressEvent(header);
-               }
-             break;
-            case RTM_NEWROUTE:
-            case RTM_DELROUTE:
-               if(header->nlmsg_len >= NLMSG_LENGTH(sizeof(rtmsg))) {
-                  handleRouteEvent(header);
-               }
-             break;
-            case RTM_NEWRULE:
-            case RTM_DELRULE:
-               if(header->nlmsg_len >= NLMSG_LENGTH(sizeof(rtmsg))) {
-                  handleRuleEvent(header);
-               }
-             break;
-            default:
-               DMHS_LOG(warning) << "Received unexpected header type "
-                                 << (int)header->nlmsg_type;
-             break;
+         if( (!waitForAcknowledgement(sd, SeqNumber, NETLINK_TIMEOUT)) ||
+             (LastError != 0) ||
+             ((ifIndex = if_nametoindex(name.c_str())) == 0) ) {
+            DMHS_LOG(error) << "Unable to create VRF " << name
+                            << ", using rules instead of VRFs";
+            VRFMode = false;
+            break;
+         }
+      }
+      else {
+         const auto found = devices.find(name);
+         if( (found == devices.end()) || (found->second.Table != table) ) {
+            DMHS_LOG(error) << "Device " << name << " is not a VRF for table " << table
+                            << ", using rules instead of VRFs";
+            VRFMode = false;
+            break;
          }
+         DMHS_LOG(info) << "Adopting VRF " << name << " for table " << table;
       }
+      VRFDevices[table] = ifIndex;
    }
-
-   if( (length < 0) && (errno == EWOULDBLOCK) ) {
-     return true;
+   if(!VRFMode) {
+      return removeVRFDevices(sd, auditSD, false);
    }
-   return false;
+   return true;
 }
 
 
-// ###### Wait for Netlink acknowledgement ##################################
-static bool waitForAcknowledgement(const int          sd,
-                                   const unsigned int seqNumber,
-                                   const unsigned int timeout)
+// ###### Move the interfaces into their VRF devices ########################
+/* The vrf driver takes an interface down and up when it becomes a member.
+ * This flushes all routes over the interface, in the main table as well as
+ * in the VRF table. So, the routes over the interface in the main table
+ * are dumped before, and installed again afterwards, so that they are still
+ * cloned as usual. The clones in the VRF table are installed again from
+ * the expected state. */
+static bool moveIntoVRFDevices(const int sd, const int auditSD)
 {
-   WaitingForAcknowlegement = true;
-   AwaitedSeqNumber         = seqNumber;
+   while(!PendingVRFMembers.empty()) {
+      const int          ifIndex = PendingVRFMembers.begin()->first;
+      const unsigned int table   = PendingVRFMembers.begin()->second;
+      const auto         vrf     = VRFDevices.find(table);
+      if(vrf == VRFDevices.end()) {
+         PendingVRFMembers.erase(ifIndex);
+         continue;
+      }
 
-   // ====== Reception loop =================================================
-   const std::chrono::time_point<std::chrono::steady_clock> t1 =
-      std::chrono::steady_clock::now();
-   std::chrono::time_point<std::chrono::steady_clock> t2;
-   while(WaitingForAcknowlegement) {
-      t2 = std::chrono::steady_clock::now();
-      int ms = timeout - std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
-      if(ms < 1) {
-         ms = 0;
+      // ====== Dump the routes over the interface ==========================
+      std::vector<std::vector<char>> routes;
+      for(const uint8_t family : { AF_INET, AF_INET6 }) {
+         if(!dumpInterfaceRoutes(auditSD, family, RT_TABLE_MAIN, ifIndex, routes)) {
+            return true;   // Try again after the next events
+         }
       }
-      pollfd pfd[1];
-      pfd[0].fd     = sd;
-      pfd[0].events = POLLIN;
-      const int events = poll((pollfd*)&pfd, 1, ms);
-      if(events > 0) {
-         receiveNetlinkMessages(sd, true);
+      PendingVRFMembers.erase(ifIndex);
+
+      // ====== Add the interface to the VRF device =========================
+      struct _request {
+         nlmsghdr  header;
+         ifinfomsg ifi;
+         char      buffer[64];
+      } request;
+      memset(&request, 0, sizeof(request));
+      request.header.nlmsg_len  = NLMSG_LENGTH(sizeof(request.ifi));
+      request.header.nlmsg_type = RTM_NEWLINK;
+      request.ifi.ifi_family    = AF_UNSPEC;
+      request.ifi.ifi_index     = ifIndex;
+      const uint32_t masterIndex = vrf->second;
+      assure( addattr(&request.header, sizeof(request), IFLA_MASTER,
+                      &masterIndex, sizeof(uint32_t)) == 0 );
+      queueMessage(&request.header, RTM_NEWLINK, NLM_F_REQUEST | NLM_F_ACK);
+      if(!sendQueuedRequests(sd)) {
+         return false;
+      }
+      if( (!waitForAcknowledgement(sd, SeqNumber, NETLINK_TIMEOUT)) ||
+          (LastError != 0) ) {
+         char ifNameBuffer[IF_NAMESIZE];
+         DMHS_LOG(error) << "Unable to add interface "
+                         << ((if_indextoname(ifIndex, ifNameBuffer) != nullptr) ? ifNameBuffer : "?")
+                         << " to VRF " << getVRFName(table);
+         continue;
       }
-   }
 
-   return (WaitingForAcknowlegement == false);
+      // ====== Install the routes again ====================================
+      restoreRoutes(routes, RT_TABLE_MAIN);
+      unsigned int clones = 0;
+      for(const uint8_t family : { AF_INET, AF_INET6 }) {
+         const ObjectSet& routeSet = RouteSets[std::pair<uint8_t, unsigned int>(family, table)];
+         for(auto iterator = routeSet.Objects.begin(); iterator != routeSet.Objects.end(); iterator++) {
+            const nlmsghdr* clone = (const nlmsghdr*)iterator->second.Message.data();
+            if(routeUsesInterface(clone, ifIndex)) {
+               queueMessage(clone, RTM_NEWROUTE, getInstallFlags(RTM_NEWROUTE));
+               clones++;
+            }
+         }
+      }
+      DMHS_LOG(info) << boost::format("Installed %u routes in the main table and %u in VRF %s again")
+                           % routes.size() % clones % getVRFName(table);
+      if(!sendQueuedRequests(sd)) {
+         return false;
+      }
+   }
+   return true;
 }
 
 
 // ###### Initialise DynMHS #################################################
-struct SimpleRequest {
-   int         RequestType;
-   const char* RequestName;
-};
 static bool initialiseDynMHS(int sd)
 {
    static const SimpleRequest InitRequests[] = {
-    { RTM_GETLINK,  "RTM_GETLINK"  },
-    { RTM_GETADDR,  "RTM_GETADDR"  },
-    { RTM_GETROUTE, "RTM_GETROUTE" },
-    { RTM_GETRULE,  "RTM_GETRULE"  }
+    { RTM_GETLINK,    "RTM_GETLINK"    },
+    { RTM_GETADDR,    "RTM_GETADDR"    },
+    { RTM_GETNEXTHOP, "RTM_GETNEXTHOP" },
+    { RTM_GETROUTE,   "RTM_GETROUTE"   },
+    { RTM_GETRULE,    "RTM_GETRULE"    }
   };
 
    Mode = Operational;
 
    for(unsigned int i = 0; i < sizeof(InitRequests) / sizeof(InitRequests[0]); i++) {
-      DMHS_LOG(debug) << "Making " << InitRequests[i].RequestName << " request ...";
-      queueSimpleNetlinkRequest(InitRequests[i].RequestType);
-      sendQueuedRequests(sd);
-      if(!waitForAcknowledgement(sd, SeqNumber, NETLINK_TIMEOUT)) {
-        DMHS_LOG(error) << "No response to " << InitRequests[i].RequestName << " request";
+      if(!requestDump(sd, InitRequests[i])) {
         return false;
       }
    }
+   updateAggregation();
+   updateNetworkRules();
+
+   return true;
+}
+
+
+// ###### Clean up the objects tagged with the DynMHS protocol ID ###########
+static bool cleanUpOwnedObjects(const int sd, const int auditSD)
+{
+   unsigned int removed = 0;
+
+   // ====== Dump the nexthop objects =======================================
+   /* The dump has to precede the queued removals, since it uses up a
+    * sequence number. */
+   std::vector<uint32_t> groups;
+   std::vector<uint32_t> nexthops;
+   if(!dumpOwnedNexthops(auditSD, [&](const nlmsghdr* message) {
+         const nhmsg* nhm = (const nhmsg*)NLMSG_DATA(message);
+         uint32_t                                  id;
+         NexthopInfo                               info;
+         const uint8_t*                            gateway;
+         std::vector<std::pair<uint32_t, uint8_t>> members;
+         if(parseNexthop(message, id, info, gateway, members)) {
+            ((nhm->nh_family == AF_UNSPEC) ? groups : nexthops).push_back(id);
+         }
+      })) {
+      return false;
+   }
+
+   // ====== Rules and routes ===============================================
+   static const uint8_t families[] = { AF_INET, AF_INET6 };
+   for(const uint8_t family : families) {
+      std::map<unsigned int, ObjectSet> ruleSnapshots;
+      std::map<unsigned int, ObjectSet> routeSnapshots;
+      if( (!dumpRules(auditSD, family, std::set<unsigned int>(), true, ruleSnapshots)) ||
+          (!dumpOwnedRoutes(auditSD, family, routeSnapshots)) ) {
+         return false;
+      }
+      for(auto iterator = ruleSnapshots.begin(); iterator != ruleSnapshots.end(); iterator++) {
+         DMHS_LOG(info) << "Removing rules for table " << iterator->first << " ...";
+         for(auto object = iterator->second.Objects.begin();
+             object != iterator->second.Objects.end(); object++) {
+            queueMessage((const nlmsghdr*)object->second.Message.data(), RTM_DELRULE,
+                         NLM_F_REQUEST | NLM_F_ACK);
+            removed++;
+         }
+      }
+      for(auto iterator = routeSnapshots.begin(); iterator != routeSnapshots.end(); iterator++) {
+         DMHS_LOG(info) << "Removing routes from table " << iterator->first << " ...";
+         for(auto object = iterator->second.Objects.begin();
+             object != iterator->second.Objects.end(); object++) {
+            queueMessage((const nlmsghdr*)object->second.Message.data(), RTM_DELROUTE,
+                         NLM_F_REQUEST | NLM_F_ACK);
+            removed++;
+         }
+      }
+   }
 
+   // ====== Nexthop objects, after the routes referencing them =============
+   nexthops.insert(nexthops.begin(), groups.begin(), groups.end());
+   if(!nexthops.empty()) {
+      DMHS_LOG(info) << "Removing " << nexthops.size() << " nexthops ...";
+   }
+   for(const uint32_t id : nexthops) {
+      struct _request {
+         nlmsghdr header;
+         nhmsg    nhm;
+         char     buffer[64];
+      } request;
+      memset(&request, 0, sizeof(request));
+      request.header.nlmsg_len = NLMSG_LENGTH(sizeof(request.nhm));
+      assure( addattr(&request.header, sizeof(request), NHA_ID,
+                      &id, sizeof(uint32_t)) == 0 );
+      queueMessage(&request.header, RTM_DELNEXTHOP, NLM_F_REQUEST | NLM_F_ACK);
+      removed++;
+   }
+   OwnedNexthops.clear();
+   OwnedNexthopKeys.clear();
+
+   DMHS_LOG(debug) << "Removing " << removed << " rules/routes/nexthops ...";
+   if(!sendQueuedRequests(sd)) {
+      return false;
+   }
+   if( (removed > 0) && (!waitForAcknowledgement(sd, SeqNumber, NETLINK_TIMEOUT)) ) {
+      DMHS_LOG(error) << "Timeout waiting for acknowledgement";
+   }
    return true;
 }
 
 
 // ###### Clean up DynMHS ###################################################
-static bool cleanUpDynMHS(int sd)
+static bool cleanUpDynMHS(int sd, int auditSD)
 {
+   // ====== Remove the objects tagged with the DynMHS protocol ID ==========
+   /* Tagged objects are found by filtered dumps. Untagged objects remain
+    * only if tagging is turned off. Then, the custom tables are flushed
+    * completely (Reset mode). */
+   if(Protocol != RTPROT_UNSPEC) {
+      Mode = Reset;
+      return cleanUpOwnedObjects(sd, auditSD);
+   }
+
    static const SimpleRequest ShutdownRequests[] = {
       { RTM_GETRULE,  "RTM_GETRULE"  },
       { RTM_GETROUTE, "RTM_GETROUTE" }
@@ -727,13 +5605,10 @@ static bool cleanUpDynMHS(int sd)
 
    // ====== Remove custom rules and tables =================================
    for(unsigned int i = 0; i < sizeof(ShutdownRequests) / sizeof(ShutdownRequests[0]); i++) {
-      DMHS_LOG(debug) << "Making " << ShutdownRequests[i].RequestName << " request ...";
       // ------ Request a dump of the rules/tables --------------------------
-      queueSimpleNetlinkRequest(ShutdownRequests[i].RequestType);
-      sendQueuedRequests(sd);
-      if(!waitForAcknowledgement(sd, SeqNumber, NETLINK_TIMEOUT)) {
-         DMHS_LOG(error) << "No response to " << ShutdownRequests[i].RequestName << " request";
-      }
+      /* A retry of an interrupted dump first sends the removals queued so
+       * far, so that the repeated dump only finds the remaining entries. */
+      requestDump(sd, ShutdownRequests[i]);
       // ------ Remove all entries in rules/tables --------------------------
       if(!RequestQueue.empty()) {
          // The removal requests are queued now. Send them, then wait until
@@ -768,6 +5643,7 @@ int main(int argc, char** argv)
    bool                     logColor;
    std::filesystem::path    configFile;
    std::filesystem::path    logFile;
+   std::string              temporaryAddresses = "include";
 
    boost::program_options::options_description commandLineOptions;
    commandLineOptions.add_options()
@@ -797,7 +5673,67 @@ int main(int argc, char** argv)
 
       ( "network,N",
            boost::program_options::value<std::vector<std::string>>(),
-           "Network to rule mapping" );
+           "Network to rule mapping" )
+      ( "auditinterval,A",
+           boost::program_options::value<unsigned int>(&AuditInterval)->default_value(AuditInterval),
+           "Interval between audit steps in s (0 to turn off)" )
+      ( "auditbudget,B",
+           boost::program_options::value<unsigned int>(&AuditBudget)->default_value(AuditBudget),
+           "Maximum number of repairs per audit step" )
+      ( "warmrestart,W",
+           boost::program_options::value<bool>(&WarmRestart)->default_value(WarmRestart),
+           "Leave rules and routes in place on shutdown, for a warm restart" )
+      ( "protocol,P",
+           boost::program_options::value<unsigned int>(&Protocol)->default_value(Protocol),
+           "Protocol ID for tagging rules and routes (0 to turn off)" )
+      ( "journal,J",
+           boost::program_options::value<bool>(&UseJournal)->default_value(UseJournal),
+           "Record owned rules and routes in a journal" )
+      ( "vrf,V",
+           boost::program_options::value<bool>(&VRFMode)->default_value(VRFMode),
+           "Use VRF devices instead of per-address rules" )
+      ( "prefixrules,R",
+           boost::program_options::value<bool>(&PrefixRules)->default_value(PrefixRules),
+           "Use one rule per on-link prefix instead of per address" )
+      ( "fwmarkrules,M",
+           boost::program_options::value<bool>(&FwMarkRules)->default_value(FwMarkRules),
+           "Add a fwmark rule (mark = table ID) for each network" )
+      ( "nexthops,H",
+           boost::program_options::value<bool>(&OwnNexthops)->default_value(OwnNexthops),
+           "Use shared nexthop objects for the gateways of the custom tables" )
+      ( "aggregate,G",
+           boost::program_options::value<bool>(&Aggregate)->default_value(Aggregate),
+           "Merge adjacent prefixes with the same next hop in the custom tables" )
+      ( "failover,F",
+           boost::program_options::value<bool>(&Failover)->default_value(Failover),
+           "Suspend the rules of a network while its link has no carrier" )
+      ( "probetarget,T",
+           boost::program_options::value<std::vector<std::string>>(),
+           "Target of the prober for networks without probe option" )
+      ( "probeinterval,E",
+           boost::program_options::value<unsigned int>(&ProbeInterval)->default_value(ProbeInterval),
+           "Interval between probe rounds in ms" )
+      ( "probewithdraw,X",
+           boost::program_options::value<bool>(&ProbeWithdraw)->default_value(ProbeWithdraw),
+           "Suspend the rules of a network while its probe targets are down" )
+      ( "multipath,U",
+           boost::program_options::value<unsigned int>(&MultipathMetric)->default_value(MultipathMetric),
+           "Metric of a multipath default route over all networks in the main table (0 to turn off)" )
+      ( "statsinterval,S",
+           boost::program_options::value<unsigned int>(&StatisticsInterval)->default_value(StatisticsInterval),
+           "Interval between samples of the interface statistics in ms" )
+      ( "destroysockets,K",
+           boost::program_options::value<bool>(&DestroySockets)->default_value(DestroySockets),
+           "Destroy the sockets bound to a removed address, or to an address of a suspended network" )
+      ( "flushconntrack,Y",
+           boost::program_options::value<bool>(&FlushConntrack)->default_value(FlushConntrack),
+           "Flush the conntrack entries of a removed address, or of an address of a suspended network" )
+      ( "deprecatedgrace,D",
+           boost::program_options::value<unsigned int>(&DeprecatedGrace)->default_value(DeprecatedGrace),
+           "Grace period in s before a deprecated IPv6 address loses its rule (0 to keep it)" )
+      ( "temporaryaddresses,Q",
+           boost::program_options::value<std::string>(&temporaryAddresses)->default_value(temporaryAddresses),
+           "Handling of temporary IPv6 addresses (include, exclude or aggregate)" );
 
       // ------ Deprecated! -------------------------------------------------
       ( "interface,I",
@@ -854,6 +5790,46 @@ int main(int argc, char** argv)
             boost::program_options::value<bool>(&logColor) )
          ( "NETWORK",
            boost::program_options::value<std::vector<std::string>>() )
+         ( "AUDITINTERVAL",
+            boost::program_options::value<unsigned int>(&AuditInterval) )
+         ( "AUDITBUDGET",
+            boost::program_options::value<unsigned int>(&AuditBudget) )
+         ( "WARMRESTART",
+            boost::program_options::value<bool>(&WarmRestart) )
+         ( "PROTOCOL",
+            boost::program_options::value<unsigned int>(&Protocol) )
+         ( "JOURNAL",
+            boost::program_options::value<bool>(&UseJournal) )
+         ( "VRF",
+            boost::program_options::value<bool>(&VRFMode) )
+         ( "PREFIXRULES",
+            boost::program_options::value<bool>(&PrefixRules) )
+         ( "FWMARKRULES",
+            boost::program_options::value<bool>(&FwMarkRules) )
+         ( "NEXTHOPS",
+            boost::program_options::value<bool>(&OwnNexthops) )
+         ( "AGGREGATE",
+            boost::program_options::value<bool>(&Aggregate) )
+         ( "FAILOVER",
+            boost::program_options::value<bool>(&Failover) )
+         ( "PROBETARGET",
+           boost::program_options::value<std::vector<std::string>>() )
+         ( "PROBEINTERVAL",
+            boost::program_options::value<unsigned int>(&ProbeInterval) )
+         ( "PROBEWITHDRAW",
+            boost::program_options::value<bool>(&ProbeWithdraw) )
+         ( "MULTIPATH",
+            boost::program_options::value<unsigned int>(&MultipathMetric) )
+         ( "STATSINTERVAL",
+            boost::program_options::value<unsigned int>(&StatisticsInterval) )
+         ( "DESTROYSOCKETS",
+            boost::program_options::value<bool>(&DestroySockets) )
+         ( "FLUSHCONNTRACK",
+            boost::program_options::value<bool>(&FlushConntrack) )
+         ( "DEPRECATEDGRACE",
+            boost::program_options::value<unsigned int>(&DeprecatedGrace) )
+         ( "TEMPORARYADDRESSES",
+            boost::program_options::value<std::string>(&temporaryAddresses) )
          // ------ Deprecated! -------------------------------------------------
          ( "NETWORK1", boost::program_options::value<std::vector<std::string>>() )
          ( "NETWORK2", boost::program_options::value<std::vector<std::string>>() )
@@ -894,27 +5870,136 @@ int main(int argc, char** argv)
    for(std::string& network : networkVector) {
       boost::trim_if(network, boost::is_any_of("\""));
       if(network != "") {
-         const int delimiter = network.rfind(':');
+         // ------ Syntax: interface:table[,option=value,...] ---------------
+         std::vector<std::string> options;
+         boost::split(options, network, boost::is_any_of(","));
+         const std::string mapping   = options[0];
+         const int         delimiter = mapping.rfind(':');
          if(delimiter == -1) {
             std::cerr << "ERROR: Bad network configuration " << network << "!\n";
             return 1;
          }
-         const std::string interface = network.substr(0, delimiter);
-         const std::string table     = network.substr(delimiter + 1,
-                                                      network.size());
-         unsigned int tableID = atol(table.c_str());
-         if( (tableID < 1000) || (tableID >= 30000) ) {
+         const std::string interface = mapping.substr(0, delimiter);
+         const std::string table     = mapping.substr(delimiter + 1,
+                                                      mapping.size());
+         NetworkConfig networkConfig;
+         networkConfig.Table          = atol(table.c_str());
+         networkConfig.PriorityBase   = networkConfig.Table;
+         networkConfig.PriorityStride = 0;
+         networkConfig.FwMark         = networkConfig.Table;
+         networkConfig.FwMarkMask     = (FwMarkRules) ? 0xffffffff : 0;
+         networkConfig.CloneFlags     = 0;
+         networkConfig.Weight         = 0;
+         networkConfig.Capacity       = 0.0;
+         networkConfig.MPTCPFlags     = 0;
+         if( (networkConfig.Table < 1000) || (networkConfig.Table >= 30000) ) {
             std::cerr << "ERROR: Bad table ID in network configuration "
                       << network << "!\n";
             return 1;
          }
-         InterfaceMap.insert(std::pair<std::string, unsigned int>(interface, tableID));
+         for(unsigned int i = 1; i < options.size(); i++) {
+            if(!parseNetworkOption(networkConfig, options[i])) {
+               std::cerr << "ERROR: Bad option " << options[i]
+                         << " in network configuration " << network << "!\n";
+               return 1;
+            }
+         }
+         if( (networkConfig.MPTCPFlags & MPTCP_PM_ADDR_FLAG_SIGNAL) &&
+             (networkConfig.MPTCPFlags & MPTCP_PM_ADDR_FLAG_FULLMESH) ) {
+            // The kernel rejects endpoints with both flags
+            std::cerr << "ERROR: mptcp=signal and mptcp=fullmesh cannot be combined"
+                      << " in network configuration " << network << "!\n";
+            return 1;
+         }
+         if( (!networkConfig.CGroups.empty()) && (networkConfig.FwMarkMask == 0) ) {
+            networkConfig.FwMarkMask = 0xffffffff;   // The hooks need a fwmark rule
+         }
+         if( (networkConfig.CloneFlags == 0) &&
+             (networkConfig.ClonePrefixes.getPrefixes() == 0) ) {
+            networkConfig.CloneFlags = CP_All;   // No clone policy: clone all routes
+         }
+         if(networkConfig.SourceTables.empty()) {
+            networkConfig.SourceTables.push_back(RT_TABLE_MAIN);
+         }
+         InterfaceMap.insert(std::pair<std::string, NetworkConfig>(interface, networkConfig));
       }
    }
    if(InterfaceMap.size() < 1) {
       std::cerr << "ERROR: No networks were defined!\n";
       return 1;
    }
+   const std::set<unsigned int> customTables = getCustomTables();
+   std::set<unsigned int>       sourceTables;
+   for(auto iterator = InterfaceMap.begin(); iterator != InterfaceMap.end(); iterator++) {
+      for(const unsigned int table : iterator->second.SourceTables) {
+         if(customTables.find(table) != customTables.end()) {
+            std::cerr << "ERROR: Source table " << table << " of " << iterator->first
+                      << " is a custom table!\n";
+            return 1;
+         }
+         sourceTables.insert(table);
+      }
+   }
+   SourceTables.assign(sourceTables.begin(), sourceTables.end());
+
+   // ====== Initialise the probe targets ===================================
+   std::vector<std::string> probeTargetVector;
+   if(commandLineVariablesMap.count("probetarget")) {
+      addStringsToVector(probeTargetVector, commandLineVariablesMap["probetarget"].as<std::vector<std::string>>());
+   }
+   if(configFileVariablesMap.count("PROBETARGET")) {
+      addStringsToVector(probeTargetVector, configFileVariablesMap["PROBETARGET"].as<std::vector<std::string>>());
+   }
+   std::vector<Prober::Address> probeTargets;
+   for(std::string& probeTarget : probeTargetVector) {
+      boost::trim_if(probeTarget, boost::is_any_of("\""));
+      Prober::Address target;
+      if(!parseProbeTarget(probeTarget, target)) {
+         std::cerr << "ERROR: Bad probe target " << probeTarget << "!\n";
+         return 1;
+      }
+      probeTargets.push_back(target);
+   }
+   bool probing = false;
+   for(auto iterator = InterfaceMap.begin(); iterator != InterfaceMap.end(); iterator++) {
+      if(iterator->second.ProbeTargets.empty()) {
+         iterator->second.ProbeTargets = probeTargets;
+      }
+      probing = probing || (!iterator->second.ProbeTargets.empty());
+   }
+   if( (probing) && (ProbeInterval < 1) ) {
+      std::cerr << "ERROR: Bad probe interval " << ProbeInterval << "!\n";
+      return 1;
+   }
+   bool sampling = false;
+   for(auto iterator = InterfaceMap.begin(); iterator != InterfaceMap.end(); iterator++) {
+      sampling = sampling || (iterator->second.Capacity > 0.0);
+   }
+   if( (sampling) && (StatisticsInterval < 1) ) {
+      std::cerr << "ERROR: Bad statistics interval " << StatisticsInterval << "!\n";
+      return 1;
+   }
+   if(Protocol > 255) {
+      std::cerr << "ERROR: Bad protocol ID " << Protocol << "!\n";
+      return 1;
+   }
+   if(temporaryAddresses == "include") {
+      TemporaryAddresses = TA_Include;
+   }
+   else if(temporaryAddresses == "exclude") {
+      TemporaryAddresses = TA_Exclude;
+   }
+   else if(temporaryAddresses == "aggregate") {
+      TemporaryAddresses = TA_Aggregate;
+   }
+   else {
+      std::cerr << "ERROR: Bad temporary address handling " << temporaryAddresses << "!\n";
+      return 1;
+   }
+
+   if(!checkRuleLayout()) {
+      return 1;
+   }
 
    // ====== Initialize logger ==============================================
    initialiseLogger(logLevel, logColor,
@@ -923,7 +6008,30 @@ int main(int argc, char** argv)
    DMHS_LOG(info) << "Starting DynMHS " << DYNMHS_VERSION << " ...";
    for(auto iterator = InterfaceMap.begin(); iterator != InterfaceMap.end(); iterator++) {
       DMHS_LOG(info) << "Mapping: " << iterator->first
-                     << " -> table " << iterator->second;
+                     << " -> table " << iterator->second.Table
+                     << getNetworkOptions(iterator->second);
+   }
+   removeRedundantUIDRanges();
+   if( (OwnNexthops) && (Protocol == RTPROT_UNSPEC) ) {
+      // Owned nexthop objects can only be found again by their protocol ID
+      DMHS_LOG(warning) << "Nexthop objects require a protocol ID -> turned off";
+      OwnNexthops = false;
+   }
+   NextNexthopID = NEXTHOP_ID_BASE;   // Instances with other protocol IDs do not collide
+   if( (MultipathMetric > 0) && (Protocol == RTPROT_UNSPEC) ) {
+      // Without protocol ID, the route would be cloned like any other route
+      DMHS_LOG(warning) << "The multipath default route requires a protocol ID -> turned off";
+      MultipathMetric = 0;
+   }
+   if( (sampling) && (MultipathMetric == 0) ) {
+      // The utilisation only affects the weights of the multipath default route
+      DMHS_LOG(warning) << "The capacity option requires the multipath default route -> sampling turned off";
+      sampling = false;
+   }
+   if( (probing) && (VRFMode) ) {
+      // The prober uses the addresses behind the rules, which VRF mode does not have
+      DMHS_LOG(warning) << "Probing is not supported in VRF mode -> turned off";
+      probing = false;
    }
 
 
@@ -933,6 +6041,7 @@ int main(int argc, char** argv)
       DMHS_LOG(error) << "socket(AF_NETLINK) failed: " << strerror(errno);
       return 1;
    }
+   EventSD = sd;
    const int sndbuf = 65536;
    if(setsockopt(sd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf)) < 0) {
       DMHS_LOG(error) << "setsockopt(SO_SNDBUF) failed: " << strerror(errno);
@@ -954,16 +6063,103 @@ int main(int argc, char** argv)
       DMHS_LOG(error) << "bind(AF_NETLINK) failed: " << strerror(errno);
       return 1;
    }
+   const int nexthopGroup = RTNLGRP_NEXTHOP;   // Not available as RTMGRP_* bit
+   if(setsockopt(sd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP,
+                 &nexthopGroup, sizeof(nexthopGroup)) < 0) {
+      DMHS_LOG(warning) << "setsockopt(NETLINK_ADD_MEMBERSHIP) failed: " << strerror(errno);
+   }
+
+   // ====== Open Netlink socket for audit dumps ============================
+   /* The audit socket does not join any multicast group, so that it only
+    * receives the responses to its own dump requests. */
+   int auditSD = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+   if(auditSD < 0) {
+      DMHS_LOG(error) << "socket(AF_NETLINK) failed: " << strerror(errno);
+      return 1;
+   }
+   const int strictCheck = 1;
+   if(setsockopt(auditSD, SOL_NETLINK, NETLINK_GET_STRICT_CHK,
+                 &strictCheck, sizeof(strictCheck)) < 0) {
+      // Older kernels do not filter dumps. Then, all filtering is in userspace.
+      DMHS_LOG(warning) << "setsockopt(NETLINK_GET_STRICT_CHK) failed: " << strerror(errno);
+   }
 
 
    // ====== Request initial configuration ==================================
    // cleanUpDynMHS(sd);
+   if(UseJournal) {
+      std::error_code ec;
+      std::filesystem::create_directories(RUNTIME_DIRECTORY, ec);
+      if(!OwnershipJournal.open(JOURNAL_FILE)) {
+         DMHS_LOG(warning) << "Continuing without journal";
+      }
+   }
+   if(!removeVRFDevices(sd, auditSD, true)) {
+      return 1;
+   }
+   if(OwnershipJournal.getObjects() > 0) {
+      if(!adoptJournalState(sd, auditSD)) {
+         return 1;
+      }
+   }
+   else if(!adoptKernelState(sd, auditSD)) {
+      return 1;
+   }
+   if( (VRFMode) && (!setupVRFDevices(sd, auditSD)) ) {
+      return 1;
+   }
+   if( (Protocol != RTPROT_UNSPEC) && (!loadOwnedNexthops(auditSD)) ) {
+      return 1;
+   }
    if(!initialiseDynMHS(sd)) {
       return 1;
    }
    if(!sendQueuedRequests(sd)) {
       return 1;
    }
+   if(!reconcileKernelState(sd)) {
+      return 1;
+   }
+   removeUnusedNexthops();
+   if(!sendQueuedRequests(sd)) {
+      return 1;
+   }
+   if(!moveIntoVRFDevices(sd, auditSD)) {
+      return 1;
+   }
+   publishFwMarks();
+   attachCGroupHooks();
+   if( (DestroySockets) && (!AddressSocketDestroyer.open()) ) {
+      DMHS_LOG(warning) << "Continuing without destroying sockets";
+   }
+   if( (FlushConntrack) && (!AddressConntrackFlusher.open()) ) {
+      DMHS_LOG(warning) << "Continuing without flushing conntrack entries";
+   }
+   for(auto iterator = InterfaceMap.begin(); iterator != InterfaceMap.end(); iterator++) {
+      if(iterator->second.MPTCPFlags != 0) {
+         if(EndpointManager.open()) {
+            updateMPTCPEndpoints();
+         }
+         else {
+            DMHS_LOG(warning) << "Continuing without managing MPTCP endpoints";
+         }
+         break;
+      }
+   }
+   if(probing) {
+      if(HealthProber.open()) {
+         for(auto iterator = InterfaceMap.begin(); iterator != InterfaceMap.end(); iterator++) {
+            HealthProber.setTargets(iterator->second.Table, iterator->second.ProbeTargets);
+         }
+         updateProbeSources();
+      }
+      else {
+         DMHS_LOG(warning) << "Continuing without prober";
+      }
+   }
+   if(!LifetimeWheel.open()) {
+      DMHS_LOG(warning) << "Continuing without timerfd, expiring lifetimes by the poll timeout";
+   }
    Mode = Operational;
 
 
@@ -981,23 +6177,61 @@ int main(int argc, char** argv)
 
    // ====== Main loop ======================================================
    DMHS_LOG(info) << "Main loop ...";
+   std::chrono::time_point<std::chrono::steady_clock> nextAudit =
+      std::chrono::steady_clock::now() + std::chrono::seconds(AuditInterval);
+   std::chrono::time_point<std::chrono::steady_clock> nextProbe =
+      std::chrono::steady_clock::now();
+   std::chrono::time_point<std::chrono::steady_clock> nextSample =
+      std::chrono::steady_clock::now();
    while(true) {
       // ====== Wait for events =============================================
-      pollfd pfd[2];
+      int timeout = -1;
+      if(AuditInterval > 0) {
+         timeout = std::max(0L, (long)std::chrono::duration_cast<std::chrono::milliseconds>(
+                                   nextAudit - std::chrono::steady_clock::now()).count());
+      }
+      if(HealthProber.isOpen()) {
+         const int probeTimeout =
+            std::max(0L, (long)std::chrono::duration_cast<std::chrono::milliseconds>(
+                               nextProbe - std::chrono::steady_clock::now()).count());
+         timeout = (timeout < 0) ? probeTimeout : std::min(timeout, probeTimeout);
+      }
+      if(sampling) {
+         const int sampleTimeout =
+            std::max(0L, (long)std::chrono::duration_cast<std::chrono::milliseconds>(
+                               nextSample - std::chrono::steady_clock::now()).count());
+         timeout = (timeout < 0) ? sampleTimeout : std::min(timeout, sampleTimeout);
+      }
+      if( (LifetimeWheel.getDescriptor() < 0) && (LifetimeWheel.getTimers() > 0) ) {
+         // Without timerfd, the poll timeout drives the lifetime timers.
+         // It is rounded up, so that the wakeup is not too early.
+         const int lifetimeTimeout =
+            std::max(0L, (long)std::chrono::ceil<std::chrono::milliseconds>(
+                               LifetimeWheel.getNextExpiry() - std::chrono::steady_clock::now()).count());
+         timeout = (timeout < 0) ? lifetimeTimeout : std::min(timeout, lifetimeTimeout);
+      }
+      pollfd pfd[5];
       pfd[0].fd     = sd;
       pfd[0].events = POLLIN;
       pfd[1].fd     = sfd;
       pfd[1].events = POLLIN;
-      const int events = poll((pollfd*)&pfd, 2, -1);
+      pfd[2].fd     = HealthProber.getSocketDescriptor(0);   // Negative if closed
+      pfd[2].events = POLLIN;
+      pfd[3].fd     = HealthProber.getSocketDescriptor(1);
+      pfd[3].events = POLLIN;
+      pfd[4].fd     = LifetimeWheel.getDescriptor();   // Negative if closed
+      pfd[4].events = POLLIN;
+      const int events = poll((pollfd*)&pfd, 5, timeout);
 
       // ====== Handle events ===============================================
       if(events > 0) {
          // ------ Read Netlink responses -----------------------------------
          if(pfd[0].revents & POLLIN) {
-            if(!receiveNetlinkMessages(sd, true)) {
+            if(!receiveNetlinkMessages(sd, true, true)) {
                DMHS_LOG(error) << "recvmsg() failed: " << strerror(errno);
                break;
             }
+            updateAggregation();
          }
 
          // ------ Signal (SIGINT) ------------------------------------------
@@ -1008,11 +6242,62 @@ int main(int argc, char** argv)
                break;
             }
          }
+
+         // ------ Replies to the probes ------------------------------------
+         if( (pfd[2].revents & POLLIN) || (pfd[3].revents & POLLIN) ) {
+            HealthProber.receiveReplies();
+         }
+
+         // ------ Expired lifetimes ----------------------------------------
+         if(pfd[4].revents & POLLIN) {
+            handleLifetimeExpiry();
+         }
+      }
+      if( (LifetimeWheel.getDescriptor() < 0) && (LifetimeWheel.getTimers() > 0) &&
+          (std::chrono::steady_clock::now() >= LifetimeWheel.getNextExpiry()) ) {
+         handleLifetimeExpiry();
+      }
+
+      // ====== Probe round =================================================
+      if( (HealthProber.isOpen()) &&
+          (std::chrono::steady_clock::now() >= nextProbe) ) {
+         handleProbeRound();
+         nextProbe = std::chrono::steady_clock::now() + std::chrono::milliseconds(ProbeInterval);
+      }
+
+      // ====== Interface statistics ========================================
+      if( (sampling) &&
+          (std::chrono::steady_clock::now() >= nextSample) ) {
+         sampleStatistics(auditSD);
+         nextSample = std::chrono::steady_clock::now() + std::chrono::milliseconds(StatisticsInterval);
       }
 
       if(!sendQueuedRequests(sd)) {
          return 1;
       }
+      if( (!PendingVRFMembers.empty()) && (!moveIntoVRFDevices(sd, auditSD)) ) {
+         return 1;
+      }
+      if(ResyncNecessary) {
+         ResyncNecessary = false;
+         resynchroniseDynMHS(sd, auditSD);
+      }
+      cleanUpWithdrawnAddresses();
+      if( (MPTCPEndpointsChanged) && (EndpointManager.isOpen()) ) {
+         updateMPTCPEndpoints();
+      }
+
+      // ====== Compact the journal =========================================
+      if(OwnershipJournal.needsCompaction()) {
+         OwnershipJournal.compact();
+      }
+
+      // ====== Audit =======================================================
+      if( (AuditInterval > 0) &&
+          (std::chrono::steady_clock::now() >= nextAudit) ) {
+         auditDynMHS(sd, auditSD);
+         nextAudit = std::chrono::steady_clock::now() + std::chrono::seconds(AuditInterval);
+      }
    }
 
 
@@ -1022,7 +6307,33 @@ int main(int argc, char** argv)
    if(sigprocmask(SIG_UNBLOCK, &mask, NULL) == -1) {
       perror("sigprocmask() call failed!");
    }
-   cleanUpDynMHS(sd);
+   if(WarmRestart) {
+      DMHS_LOG(info) << "Leaving rules and routes in place for warm restart";
+      saveOwnedTables();
+   }
+   else {
+      cleanUpDynMHS(sd, auditSD);
+      removeVRFDevices(sd, auditSD, false);
+      unlink(FWMARKS_FILE);
+      unlink(FWMARKS_NFT_FILE);
+      OwnershipJournal.clear();
+   }
+   if(HealthProber.isOpen()) {
+      HealthProber.close();
+      unlink(HEALTH_FILE);
+   }
+   AddressSocketDestroyer.close();
+   AddressConntrackFlusher.close();
+   LifetimeWheel.close();
+   if(EndpointManager.isOpen()) {
+      if(!WarmRestart) {
+         updateMPTCPEndpoints(true);
+      }
+      EndpointManager.close();
+   }
+   detachCGroupHooks();
+   OwnershipJournal.close();
+   close(auditSD);
    close(sd);
    close(sfd);
 
@@ -0,0 +1,349 @@
+// ==========================================================================
+//                    ____              __  __ _   _ ____
+//                   |  _ \ _   _ _ __ |  \/  | | | / ___|
+//                   | | | | | | | '_ \| |\/| | |_| \___ \
+//                   | |_| | |_| | | | | |  | |  _  |___) |
+//                   |____/ \__, |_| |_|_|  |_|_| |_|____/
+//                          |___/
+//
+//                ---  Dynamic Multi-Homing Setup (DynMHS)  ---
+//                     https://www.nntb.no/~dreibh/dynmhs/
+// ==========================================================================
+//
+// Dynamic Multi-Homing Setup (DynMHS)
+// Copyright (C) 2024-2026 by Thomas Dreibholz
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Contact: dreibh@simula.no
+
+#include "journal.h"
+#include "logger.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+#define JOURNAL_MAGIC          "DMHSJRN1"
+#define JOURNAL_INITIAL_SIZE   (256 * 1024)
+#define JOURNAL_MIN_DEAD       256
+#define JOURNAL_ALIGN(length)  (((length) + 7) & ~((size_t)7))
+
+enum JournalRecordType {
+   JRT_Add    = 1,
+   JRT_Remove = 2
+};
+
+struct Journal::Header {
+   char     Magic[8];
+   uint64_t Used;   // Offset behind the last valid record
+};
+
+struct Journal::Record {
+   uint32_t Length;   // Length of the record, including padding
+   uint16_t Type;
+   uint16_t KeyLength;
+   uint32_t DataLength;
+   uint32_t Reserved;
+};
+
+
+// ###### Constructor #######################################################
+Journal::Journal()
+{
+   FD          = -1;
+   Data        = nullptr;
+   Size        = 0;
+   DeadRecords = 0;
+}
+
+
+// ###### Destructor ########################################################
+Journal::~Journal()
+{
+   close();
+}
+
+
+// ###### Open journal ######################################################
+bool Journal::open(const char* fileName)
+{
+   close();
+   FileName = fileName;
+   FD = ::open(fileName, O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+   if(FD < 0) {
+      DMHS_LOG(error) << "Unable to open journal " << FileName << ": " << strerror(errno);
+      return false;
+   }
+
+   // ====== Map the file, initialise it if it is new or invalid ============
+   struct stat status;
+   if( (fstat(FD, &status) != 0) ||
+       (!map(std::max((size_t)status.st_size, (size_t)JOURNAL_INITIAL_SIZE))) ) {
+      close();
+      return false;
+   }
+   if(status.st_size == 0) {
+      clear();
+   }
+   else if(!replay()) {
+      DMHS_LOG(warning) << "Journal " << FileName << " is invalid -> starting a new one";
+      clear();
+   }
+   return true;
+}
+
+
+// ###### Close journal #####################################################
+void Journal::close()
+{
+   unmap();
+   if(FD >= 0) {
+      ::close(FD);
+      FD = -1;
+   }
+   Index.clear();
+   DeadRecords = 0;
+}
+
+
+// ###### Map the journal file ##############################################
+bool Journal::map(const size_t size)
+{
+   unmap();
+   if(ftruncate(FD, size) != 0) {
+      DMHS_LOG(error) << "Unable to resize journal " << FileName << ": " << strerror(errno);
+      return false;
+   }
+   void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, FD, 0);
+   if(data == MAP_FAILED) {
+      DMHS_LOG(error) << "Unable to map journal " << FileName << ": " << strerror(errno);
+      return false;
+   }
+   Data = (char*)data;
+   Size = size;
+   return true;
+}
+
+
+// ###### Unmap the journal file ############################################
+void Journal::unmap()
+{
+   if(Data != nullptr) {
+      munmap(Data, Size);
+      Data = nullptr;
+      Size = 0;
+   }
+}
+
+
+// ###### Make sure there is space for appending a record ###################
+bool Journal::reserve(const size_t length)
+{
+   const Header* header = (const Header*)Data;
+   if(header->Used + length <= Size) {
+      return true;
+   }
+   size_t newSize = Size;
+   while(header->Used + length > newSize) {
+      newSize *= 2;
+   }
+   return map(newSize);
+}
+
+
+// ###### Replay the journal to rebuild the index ###########################
+bool Journal::replay()
+{
+   const Header* header = (const Header*)Data;
+   if( (memcmp(header->Magic, JOURNAL_MAGIC, sizeof(header->Magic)) != 0) ||
+       (header->Used < sizeof(Header)) || (header->Used > Size) ) {
+      return false;
+   }
+
+   size_t offset = sizeof(Header);
+   while(offset < header->Used) {
+      const Record* record = (const Record*)&Data[offset];
+      if( (offset + sizeof(Record) > header->Used) ||
+          (record->Length < sizeof(Record) + record->KeyLength + record->DataLength) ||
+          (offset + record->Length > header->Used) ) {
+         return false;
+      }
+      const std::string key((const char*)record + sizeof(Record), record->KeyLength);
+      if(record->Type == JRT_Add) {
+         if(Index.find(key) != Index.end()) {
+            DeadRecords++;
+         }
+         Index[key] = offset;
+      }
+      else if(record->Type == JRT_Remove) {
+         if(Index.erase(key) > 0) {
+            DeadRecords++;
+         }
+         DeadRecords++;
+      }
+      else {
+         return false;
+      }
+      offset += record->Length;
+   }
+   return true;
+}
+
+
+// ###### Append a record ###################################################
+size_t Journal::appendRecord(const uint16_t     type,
+                             const std::string& key,
+                             const void*        data,
+                             const size_t       length)
+{
+   const size_t recordLength = JOURNAL_ALIGN(sizeof(Record) + key.size() + length);
+   if(!reserve(recordLength)) {
+      return 0;
+   }
+
+   // ====== Write the record ===============================================
+   Header*      header = (Header*)Data;
+   const size_t offset = header->Used;
+   Record*      record = (Record*)&Data[offset];
+   record->Length     = recordLength;
+   record->Type       = type;
+   record->KeyLength  = key.size();
+   record->DataLength = length;
+   record->Reserved   = 0;
+   memcpy((char*)record + sizeof(Record), key.data(), key.size());
+   if(length > 0) {
+      memcpy((char*)record + sizeof(Record) + key.size(), data, length);
+   }
+
+   // ====== Make the record valid ==========================================
+   __atomic_store_n(&header->Used, offset + recordLength, __ATOMIC_RELEASE);
+   return offset;
+}
+
+
+// ###### Add an object #####################################################
+void Journal::add(const std::string& key, const void* data, const size_t length)
+{
+   if(Data != nullptr) {
+      const size_t offset = appendRecord(JRT_Add, key, data, length);
+      if(offset > 0) {
+         if(Index.find(key) != Index.end()) {
+            DeadRecords++;
+         }
+         Index[key] = offset;
+      }
+   }
+}
+
+
+// ###### Remove an object ##################################################
+void Journal::remove(const std::string& key)
+{
+   if( (Data != nullptr) && (Index.find(key) != Index.end()) ) {
+      if(appendRecord(JRT_Remove, key, nullptr, 0) > 0) {
+         Index.erase(key);
+         DeadRecords += 2;
+      }
+   }
+}
+
+
+// ###### Remove all objects ################################################
+void Journal::clear()
+{
+   if(Data != nullptr) {
+      Header* header = (Header*)Data;
+      memcpy(header->Magic, JOURNAL_MAGIC, sizeof(header->Magic));
+      header->Used = sizeof(Header);
+      Index.clear();
+      DeadRecords = 0;
+   }
+}
+
+
+// ###### Check whether a compaction is useful ##############################
+bool Journal::needsCompaction() const
+{
+   return (DeadRecords >= JOURNAL_MIN_DEAD) && (DeadRecords > Index.size());
+}
+
+
+// ###### Compact the journal ###############################################
+/* The live records are written into a new file, which then atomically
+ * replaces the journal. So, a crash during the compaction leaves either the
+ * old or the new journal. */
+bool Journal::compact()
+{
+   if(Data == nullptr) {
+      return false;
+   }
+
+   // ====== Write the live records into a new file =========================
+   const std::string newFileName = FileName + ".new";
+   const int newFD = ::open(newFileName.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                            S_IRUSR | S_IWUSR);
+   if(newFD < 0) {
+      DMHS_LOG(error) << "Unable to create " << newFileName << ": " << strerror(errno);
+      return false;
+   }
+   Header newHeader;
+   memcpy(newHeader.Magic, JOURNAL_MAGIC, sizeof(newHeader.Magic));
+   newHeader.Used = sizeof(Header);
+   std::map<std::string, size_t> newIndex;
+   bool                          success = (pwrite(newFD, &newHeader, sizeof(newHeader), 0) ==
+                                               (ssize_t)sizeof(newHeader));
+   for(auto iterator = Index.begin(); (iterator != Index.end()) && (success); iterator++) {
+      const Record* record = (const Record*)&Data[iterator->second];
+      success = (pwrite(newFD, record, record->Length, newHeader.Used) == (ssize_t)record->Length);
+      newIndex[iterator->first] = newHeader.Used;
+      newHeader.Used += record->Length;
+   }
+   success = success &&
+             (pwrite(newFD, &newHeader, sizeof(newHeader), 0) == (ssize_t)sizeof(newHeader)) &&
+             (rename(newFileName.c_str(), FileName.c_str()) == 0);
+   if(!success) {
+      DMHS_LOG(error) << "Unable to compact journal " << FileName << ": " << strerror(errno);
+      ::close(newFD);
+      unlink(newFileName.c_str());
+      return false;
+   }
+
+   // ====== Map the new file ===============================================
+   DMHS_LOG(debug) << "Compacted journal: " << DeadRecords << " dead records removed, "
+                   << newIndex.size() << " objects";
+   unmap();
+   ::close(FD);
+   FD          = newFD;
+   DeadRecords = 0;
+   Index.swap(newIndex);
+   return map(std::max((size_t)JOURNAL_INITIAL_SIZE, JOURNAL_ALIGN(2 * newHeader.Used)));
+}
+
+
+// ###### Iterate over all objects ##########################################
+void Journal::forEach(const std::function<void(const std::string& key,
+                                               const void*        data,
+                                               const size_t       length)>& callback) const
+{
+   for(auto iterator = Index.begin(); iterator != Index.end(); iterator++) {
+      const Record* record = (const Record*)&Data[iterator->second];
+      callback(iterator->first,
+               (const char*)record + sizeof(Record) + record->KeyLength,
+               record->DataLength);
+   }
+}
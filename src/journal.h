@@ -0,0 +1,88 @@
+// ==========================================================================
+//                    ____              __  __ _   _ ____
+//                   |  _ \ _   _ _ __ |  \/  | | | / ___|
+//                   | | | | | | | '_ \| |\/| | |_| \___ \
+//                   | |_| | |_| | | | | |  | |  _  |___) |
+//                   |____/ \__, |_| |_|_|  |_|_| |_|____/
+//                          |___/
+//
+//                ---  Dynamic Multi-Homing Setup (DynMHS)  ---
+//                     https://www.nntb.no/~dreibh/dynmhs/
+// ==========================================================================
+//
+// Dynamic Multi-Homing Setup (DynMHS)
+// Copyright (C) 2024-2026 by Thomas Dreibholz
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Contact: dreibh@simula.no
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+
+
+// ###### Persistent journal of owned kernel objects ########################
+/* The journal is an append-only, memory-mapped file. Each record either adds
+ * an object (key and Netlink message to install it) or removes an object
+ * (key only). A record becomes valid when the used size in the file header
+ * is advanced after writing it, so a crash never leaves a partial record.
+ * Superseded records are removed by compaction. */
+class Journal
+{
+   public:
+   Journal();
+   ~Journal();
+
+   bool open(const char* fileName);
+   void close();
+   inline bool isOpen() const { return Data != nullptr; }
+
+   void add(const std::string& key, const void* data, const size_t length);
+   void remove(const std::string& key);
+   void clear();
+
+   inline size_t getObjects() const { return Index.size(); }
+   bool needsCompaction() const;
+   bool compact();
+
+   void forEach(const std::function<void(const std::string& key,
+                                         const void*        data,
+                                         const size_t       length)>& callback) const;
+
+   private:
+   struct Header;
+   struct Record;
+
+   bool map(const size_t size);
+   void unmap();
+   bool reserve(const size_t length);
+   bool replay();
+   size_t appendRecord(const uint16_t type, const std::string& key,
+                       const void* data, const size_t length);
+
+   std::string                   FileName;
+   int                           FD;
+   char*                         Data;
+   size_t                        Size;
+   size_t                        DeadRecords;
+   std::map<std::string, size_t> Index;   // Key -> offset of its add record
+};
+
+#endif
@@ -0,0 +1,275 @@
+// ==========================================================================
+//                    ____              __  __ _   _ ____
+//                   |  _ \ _   _ _ __ |  \/  | | | / ___|
+//                   | | | | | | | '_ \| |\/| | |_| \___ \
+//                   | |_| | |_| | | | | |  | |  _  |___) |
+//                   |____/ \__, |_| |_|_|  |_|_| |_|____/
+//                          |___/
+//
+//                ---  Dynamic Multi-Homing Setup (DynMHS)  ---
+//                     https://www.nntb.no/~dreibh/dynmhs/
+// ==========================================================================
+//
+// Dynamic Multi-Homing Setup (DynMHS)
+// Copyright (C) 2024-2026 by Thomas Dreibholz
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Contact: dreibh@simula.no
+
+#include "mptcppathmanager.h"
+#include "logger.h"
+
+#include <cstring>
+#include <boost/format.hpp>
+#include <netinet/in.h>
+#include <linux/genetlink.h>
+#include <linux/mptcp.h>
+
+
+struct GenericRequest {
+   nlmsghdr   Header;
+   genlmsghdr Message;
+};
+
+
+// ###### Constructor #######################################################
+MPTCPPathManager::MPTCPPathManager()
+{
+   FamilyID = 0;
+}
+
+
+// ###### Destructor ########################################################
+MPTCPPathManager::~MPTCPPathManager()
+{
+   close();
+}
+
+
+// ###### Open the generic netlink socket ###################################
+bool MPTCPPathManager::open()
+{
+   close();
+   if(!Netlink.open(NETLINK_GENERIC)) {
+      return false;
+   }
+   if(!resolveFamily()) {
+      DMHS_LOG(warning) << "The MPTCP path manager is not available";
+      close();
+      return false;
+   }
+   return true;
+}
+
+
+// ###### Close the generic netlink socket ##################################
+void MPTCPPathManager::close()
+{
+   Netlink.close();
+   FamilyID = 0;
+}
+
+
+// ###### Make a generic netlink request ####################################
+static void makeRequest(std::vector<char>& request,
+                        const uint16_t     type,
+                        const uint16_t     flags,
+                        const uint8_t      command,
+                        const uint8_t      version)
+{
+   GenericRequest header;
+   memset(&header, 0, sizeof(header));
+   header.Header.nlmsg_type  = type;
+   header.Header.nlmsg_flags = flags;
+   header.Message.cmd        = command;
+   header.Message.version    = version;
+   request.insert(request.end(), (const char*)&header, (const char*)&header + sizeof(header));
+}
+
+
+// ###### Resolve the ID of the MPTCP path manager family ###################
+bool MPTCPPathManager::resolveFamily()
+{
+   std::vector<char> request;
+   makeRequest(request, GENL_ID_CTRL, NLM_F_REQUEST | NLM_F_ACK,
+               CTRL_CMD_GETFAMILY, 1);
+   NetlinkSocket::appendAttribute(request, CTRL_ATTR_FAMILY_NAME,
+                                  MPTCP_PM_NAME, sizeof(MPTCP_PM_NAME));
+   ((nlmsghdr*)request.data())->nlmsg_len = request.size();
+   const bool resolved = Netlink.query((nlmsghdr*)request.data(), "Generic netlink family query",
+                                       [&](const nlmsghdr* header) {
+      if( (header->nlmsg_type == GENL_ID_CTRL) &&
+          (header->nlmsg_len >= NLMSG_LENGTH(GENL_HDRLEN)) ) {
+         const uint16_t* id = (const uint16_t*)NetlinkSocket::getPayload(
+            NetlinkSocket::findAttribute((const char*)NLMSG_DATA(header) + GENL_HDRLEN,
+                                         header->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN),
+                                         CTRL_ATTR_FAMILY_ID),
+            sizeof(uint16_t));
+         if(id != nullptr) {
+            FamilyID = *id;
+         }
+      }
+   });
+   return (resolved) && (FamilyID != 0);
+}
+
+
+// ###### Dump the installed endpoints ######################################
+bool MPTCPPathManager::dumpEndpoints(std::vector<InstalledEndpoint>& endpoints)
+{
+   std::vector<char> request;
+   makeRequest(request, FamilyID, NLM_F_REQUEST | NLM_F_DUMP,
+               MPTCP_PM_CMD_GET_ADDR, MPTCP_PM_VER);
+   ((nlmsghdr*)request.data())->nlmsg_len = request.size();
+   return Netlink.query((nlmsghdr*)request.data(), "MPTCP endpoint dump",
+                        [&](const nlmsghdr* header) {
+      if(header->nlmsg_len < NLMSG_LENGTH(GENL_HDRLEN)) {
+         return;
+      }
+
+      // ====== Parse the endpoint ==========================================
+      const nlattr* address = NetlinkSocket::findAttribute((const char*)NLMSG_DATA(header) + GENL_HDRLEN,
+                                                           header->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN),
+                                                           MPTCP_PM_ATTR_ADDR);
+      if(address == nullptr) {
+         return;
+      }
+      const char*     data    = (const char*)address + NLA_HDRLEN;
+      const int       size    = address->nla_len - NLA_HDRLEN;
+      const uint16_t* family  = (const uint16_t*)NetlinkSocket::getPayload(NetlinkSocket::findAttribute(data, size, MPTCP_PM_ADDR_ATTR_FAMILY), sizeof(uint16_t));
+      const uint8_t*  id      = (const uint8_t*)NetlinkSocket::getPayload(NetlinkSocket::findAttribute(data, size, MPTCP_PM_ADDR_ATTR_ID), sizeof(uint8_t));
+      const uint32_t* flags   = (const uint32_t*)NetlinkSocket::getPayload(NetlinkSocket::findAttribute(data, size, MPTCP_PM_ADDR_ATTR_FLAGS), sizeof(uint32_t));
+      const int32_t*  ifIndex = (const int32_t*)NetlinkSocket::getPayload(NetlinkSocket::findAttribute(data, size, MPTCP_PM_ADDR_ATTR_IF_IDX), sizeof(int32_t));
+      const uint16_t* port    = (const uint16_t*)NetlinkSocket::getPayload(NetlinkSocket::findAttribute(data, size, MPTCP_PM_ADDR_ATTR_PORT), sizeof(uint16_t));
+      if( (family == nullptr) || (id == nullptr) ||
+          ( (port != nullptr) && (*port != 0) ) ) {
+         return;   // Endpoints with port are never managed
+      }
+      const size_t   addressLength = (*family == AF_INET6) ? 16 : 4;
+      const uint8_t* addressData   = (const uint8_t*)NetlinkSocket::getPayload(
+         NetlinkSocket::findAttribute(data, size, (*family == AF_INET6) ? MPTCP_PM_ADDR_ATTR_ADDR6 :
+                                                                            MPTCP_PM_ADDR_ATTR_ADDR4),
+         addressLength);
+      if(addressData == nullptr) {
+         return;
+      }
+      InstalledEndpoint endpoint;
+      endpoint.Settings.Family  = *family;
+      endpoint.Settings.IfIndex = (ifIndex != nullptr) ? *ifIndex : 0;
+      endpoint.Settings.Flags   = (flags != nullptr) ? *flags : 0;
+      endpoint.ID               = *id;
+      memset(&endpoint.Settings.Address, 0, sizeof(endpoint.Settings.Address));
+      memcpy(&endpoint.Settings.Address, addressData, addressLength);
+      endpoints.push_back(endpoint);
+   });
+}
+
+
+// ###### Append a request for an endpoint to a batch #######################
+void MPTCPPathManager::appendRequest(std::vector<char>& batch,
+                                     const uint8_t      command,
+                                     const Endpoint&    endpoint,
+                                     const uint8_t      id)
+{
+   const size_t offset = batch.size();
+   makeRequest(batch, FamilyID, NLM_F_REQUEST | NLM_F_ACK,
+               command, MPTCP_PM_VER);
+
+   // ====== Nested address attribute =======================================
+   const size_t   nested = batch.size();
+   const uint16_t family = endpoint.Family;
+   NetlinkSocket::appendAttribute(batch, NLA_F_NESTED | MPTCP_PM_ATTR_ADDR, nullptr, 0);
+   NetlinkSocket::appendAttribute(batch, MPTCP_PM_ADDR_ATTR_FAMILY, &family, sizeof(family));
+   if(id != 0) {
+      NetlinkSocket::appendAttribute(batch, MPTCP_PM_ADDR_ATTR_ID, &id, sizeof(id));
+   }
+   if(endpoint.Family == AF_INET6) {
+      NetlinkSocket::appendAttribute(batch, MPTCP_PM_ADDR_ATTR_ADDR6, &endpoint.Address, 16);
+   }
+   else {
+      NetlinkSocket::appendAttribute(batch, MPTCP_PM_ADDR_ATTR_ADDR4, &endpoint.Address, 4);
+   }
+   NetlinkSocket::appendAttribute(batch, MPTCP_PM_ADDR_ATTR_FLAGS, &endpoint.Flags, sizeof(endpoint.Flags));
+   NetlinkSocket::appendAttribute(batch, MPTCP_PM_ADDR_ATTR_IF_IDX, &endpoint.IfIndex, sizeof(endpoint.IfIndex));
+   ((nlattr*)&batch[nested])->nla_len    = batch.size() - nested;
+   ((nlmsghdr*)&batch[offset])->nlmsg_len = batch.size() - offset;
+}
+
+
+// ###### Update the endpoints ##############################################
+bool MPTCPPathManager::update(const std::vector<Endpoint>& endpoints,
+                              const std::set<int>&          interfaces)
+{
+   if(!Netlink.isOpen()) {
+      return false;
+   }
+   std::vector<InstalledEndpoint> installedEndpoints;
+   if(!dumpEndpoints(installedEndpoints)) {
+      return false;
+   }
+
+   // ====== Remove the endpoints that differ from the expected ones ========
+   /* An endpoint with other flags or interface is replaced, since changing
+    * its interface is not possible. Implicit endpoints belong to the
+    * kernel. */
+   std::vector<char> batch;
+   std::vector<bool> installed(endpoints.size(), false);
+   unsigned int      removed = 0;
+   for(const InstalledEndpoint& installedEndpoint : installedEndpoints) {
+      if( (installedEndpoint.Settings.Flags & MPTCP_PM_ADDR_FLAG_IMPLICIT) ||
+          (interfaces.find(installedEndpoint.Settings.IfIndex) == interfaces.end()) ) {
+         continue;
+      }
+      bool expected = false;
+      for(unsigned int i = 0; i < endpoints.size(); i++) {
+         if( (endpoints[i].Family  == installedEndpoint.Settings.Family)  &&
+             (endpoints[i].IfIndex == installedEndpoint.Settings.IfIndex) &&
+             (endpoints[i].Flags   == installedEndpoint.Settings.Flags)   &&
+             (memcmp(&endpoints[i].Address, &installedEndpoint.Settings.Address,
+                     sizeof(endpoints[i].Address)) == 0) ) {
+            installed[i] = true;
+            expected     = true;
+            break;
+         }
+      }
+      if(!expected) {
+         appendRequest(batch, MPTCP_PM_CMD_DEL_ADDR, installedEndpoint.Settings, installedEndpoint.ID);
+         removed++;
+      }
+   }
+
+   // ====== Add the missing endpoints ======================================
+   unsigned int added = 0;
+   for(unsigned int i = 0; i < endpoints.size(); i++) {
+      if(!installed[i]) {
+         appendRequest(batch, MPTCP_PM_CMD_ADD_ADDR, endpoints[i], 0);
+         added++;
+      }
+   }
+
+   if(added + removed == 0) {
+      return true;
+   }
+   DMHS_LOG(info) << boost::format("Updating MPTCP endpoints: %u added, %u removed")
+                        % added % removed;
+   bool       success = true;
+   const bool sent    = Netlink.sendRequests(batch, "MPTCP endpoint update",
+                                             [&](const int error) {
+      DMHS_LOG(warning) << "MPTCP endpoint update failed: " << strerror(error);
+      success = false;
+      return true;   // Wait for the other acknowledgements
+   });
+   return (sent) && (success);
+}
@@ -0,0 +1,84 @@
+// ==========================================================================
+//                    ____              __  __ _   _ ____
+//                   |  _ \ _   _ _ __ |  \/  | | | / ___|
+//                   | | | | | | | '_ \| |\/| | |_| \___ \
+//                   | |_| | |_| | | | | |  | |  _  |___) |
+//                   |____/ \__, |_| |_|_|  |_|_| |_|____/
+//                          |___/
+//
+//                ---  Dynamic Multi-Homing Setup (DynMHS)  ---
+//                     https://www.nntb.no/~dreibh/dynmhs/
+// ==========================================================================
+//
+// Dynamic Multi-Homing Setup (DynMHS)
+// Copyright (C) 2024-2026 by Thomas Dreibholz
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Contact: dreibh@simula.no
+
+#ifndef MPTCPPATHMANAGER_H
+#define MPTCPPATHMANAGER_H
+
+#include "netlinksocket.h"
+
+#include <cstdint>
+#include <set>
+#include <vector>
+
+
+// ###### Manager of the MPTCP path manager endpoints #######################
+/* The endpoints are managed through the generic netlink MPTCP path manager.
+ * An update dumps the endpoints, and then adds and removes endpoints by a
+ * batch of acknowledged requests. Only the endpoints on the given
+ * interfaces are touched, so that manually added endpoints on other
+ * interfaces remain. */
+class MPTCPPathManager
+{
+   public:
+   struct Endpoint {
+      uint8_t  Family;
+      uint8_t  Address[16];
+      int      IfIndex;
+      uint32_t Flags;     // MPTCP_PM_ADDR_FLAG_*
+   };
+
+   MPTCPPathManager();
+   ~MPTCPPathManager();
+
+   bool open();
+   void close();
+   inline bool isOpen() const { return Netlink.isOpen(); }
+
+   bool update(const std::vector<Endpoint>& endpoints,
+               const std::set<int>&          interfaces);
+
+   private:
+   struct InstalledEndpoint {
+      Endpoint Settings;
+      uint8_t  ID;
+   };
+
+   bool resolveFamily();
+   bool dumpEndpoints(std::vector<InstalledEndpoint>& endpoints);
+   void appendRequest(std::vector<char>&   batch,
+                      const uint8_t        command,
+                      const Endpoint&      endpoint,
+                      const uint8_t        id);
+
+   NetlinkSocket Netlink;
+   uint16_t      FamilyID;
+};
+
+#endif
@@ -0,0 +1,270 @@
+// ==========================================================================
+//                    ____              __  __ _   _ ____
+//                   |  _ \ _   _ _ __ |  \/  | | | / ___|
+//                   | | | | | | | '_ \| |\/| | |_| \___ \
+//                   | |_| | |_| | | | | |  | |  _  |___) |
+//                   |____/ \__, |_| |_|_|  |_|_| |_|____/
+//                          |___/
+//
+//                ---  Dynamic Multi-Homing Setup (DynMHS)  ---
+//                     https://www.nntb.no/~dreibh/dynmhs/
+// ==========================================================================
+//
+// Dynamic Multi-Homing Setup (DynMHS)
+// Copyright (C) 2024-2026 by Thomas Dreibholz
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Contact: dreibh@simula.no
+
+#include "netlinksocket.h"
+#include "logger.h"
+
+#include <cstring>
+#include <boost/format.hpp>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+
+#define NETLINK_SOCKET_BUFFER  65536   // 64 KiB
+#define NETLINK_SOCKET_BATCH   32768   // 32 KiB of requests
+#define NETLINK_SOCKET_TIMEOUT 5000    // 5000 ms
+
+
+// ###### Constructor #######################################################
+NetlinkSocket::NetlinkSocket()
+{
+   SD        = -1;
+   SeqNumber = 0;
+}
+
+
+// ###### Destructor ########################################################
+NetlinkSocket::~NetlinkSocket()
+{
+   close();
+}
+
+
+// ###### Open the netlink socket ###########################################
+bool NetlinkSocket::open(const int protocol)
+{
+   close();
+   SD = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, protocol);
+   if(SD < 0) {
+      DMHS_LOG(warning) << boost::format("socket(AF_NETLINK, %d) failed: %s")
+                              % protocol % strerror(errno);
+      return false;
+   }
+   return true;
+}
+
+
+// ###### Close the netlink socket ##########################################
+void NetlinkSocket::close()
+{
+   if(SD >= 0) {
+      ::close(SD);
+      SD = -1;
+   }
+}
+
+
+// ###### Send a request and receive its replies ############################
+/* The request has to be a dump (NLM_F_DUMP), or to ask for an
+ * acknowledgement (NLM_F_ACK). Otherwise, the end of the replies is not
+ * known. */
+bool NetlinkSocket::query(nlmsghdr*                                    request,
+                          const char*                                  description,
+                          const std::function<void(const nlmsghdr*)>& callback)
+{
+   request->nlmsg_seq = ++SeqNumber;
+   if(send(SD, request, request->nlmsg_len, 0) < 0) {
+      DMHS_LOG(warning) << "send() failed: " << strerror(errno);
+      return false;
+   }
+
+   nlmsghdr buffer[NETLINK_SOCKET_BUFFER / sizeof(nlmsghdr)];
+   while(true) {
+      pollfd pfd[1];
+      pfd[0].fd     = SD;
+      pfd[0].events = POLLIN;
+      if(poll((pollfd*)&pfd, 1, NETLINK_SOCKET_TIMEOUT) < 1) {
+         DMHS_LOG(warning) << boost::format("%s timed out") % description;
+         return false;
+      }
+      int length = recv(SD, buffer, sizeof(buffer), 0);
+      if(length < 0) {
+         DMHS_LOG(warning) << "recv() failed: " << strerror(errno);
+         return false;
+      }
+      for(const nlmsghdr* header = (const nlmsghdr*)buffer;
+          NLMSG_OK(header, length); header = NLMSG_NEXT(header, length)) {
+         if(header->nlmsg_seq != request->nlmsg_seq) {
+            continue;
+         }
+         if(header->nlmsg_type == NLMSG_DONE) {
+            return true;
+         }
+         else if(header->nlmsg_type == NLMSG_ERROR) {
+            const nlmsgerr* errormsg = (const nlmsgerr*)NLMSG_DATA(header);
+            if(errormsg->error == 0) {
+               return true;   // Acknowledgement
+            }
+            DMHS_LOG(warning) << boost::format("%s failed: %s")
+                                    % description % strerror(-errormsg->error);
+            return false;
+         }
+         callback(header);
+      }
+   }
+}
+
+
+// ###### Send requests in batches ##########################################
+/* The requests get their sequence numbers here. The error callback gets
+ * the error of a failed request, and returns false to stop. */
+bool NetlinkSocket::sendRequests(std::vector<char>&              requests,
+                                 const char*                     description,
+                                 const std::function<bool(int)>& errorCallback)
+{
+   std::vector<char> batch;
+   unsigned int      acknowledgements = 0;
+   size_t            offset           = 0;
+   while(offset < requests.size()) {
+      nlmsghdr* request = (nlmsghdr*)&requests[offset];
+      request->nlmsg_seq = ++SeqNumber;
+      if( (batch.size() + request->nlmsg_len > NETLINK_SOCKET_BATCH) &&
+          (!sendBatch(batch, acknowledgements, description, errorCallback)) ) {
+         return false;
+      }
+      if(batch.empty()) {
+         acknowledgements = 0;
+      }
+      batch.insert(batch.end(), (const char*)request,
+                   (const char*)request + request->nlmsg_len);
+      if(request->nlmsg_flags & NLM_F_ACK) {
+         acknowledgements++;
+      }
+      offset += NLMSG_ALIGN(request->nlmsg_len);
+   }
+   requests.clear();
+   return ( (batch.empty()) ||
+            (sendBatch(batch, acknowledgements, description, errorCallback)) );
+}
+
+
+// ###### Send a batch of requests ##########################################
+/* Waits for the acknowledgements, then collects the errors of the requests
+ * without NLM_F_ACK that are already there. */
+bool NetlinkSocket::sendBatch(std::vector<char>&              batch,
+                              const unsigned int              acknowledgements,
+                              const char*                     description,
+                              const std::function<bool(int)>& errorCallback)
+{
+   if(send(SD, batch.data(), batch.size(), 0) < 0) {
+      DMHS_LOG(warning) << "send() failed: " << strerror(errno);
+      batch.clear();
+      return false;
+   }
+   batch.clear();
+
+   unsigned int acknowledged = 0;
+   nlmsghdr     buffer[NETLINK_SOCKET_BUFFER / sizeof(nlmsghdr)];
+   while(true) {
+      const bool waiting = (acknowledged < acknowledgements);
+      if(waiting) {
+         pollfd pfd[1];
+         pfd[0].fd     = SD;
+         pfd[0].events = POLLIN;
+         if(poll((pollfd*)&pfd, 1, NETLINK_SOCKET_TIMEOUT) < 1) {
+            DMHS_LOG(warning) << boost::format("%s timed out") % description;
+            return false;
+         }
+      }
+      int length = recv(SD, buffer, sizeof(buffer), (waiting) ? 0 : MSG_DONTWAIT);
+      if(length <= 0) {
+         if(waiting) {
+            DMHS_LOG(warning) << "recv() failed: " << strerror(errno);
+            return false;
+         }
+         return true;
+      }
+      for(const nlmsghdr* header = (const nlmsghdr*)buffer;
+          NLMSG_OK(header, length); header = NLMSG_NEXT(header, length)) {
+         if(header->nlmsg_type == NLMSG_ERROR) {
+            const nlmsgerr* errormsg = (const nlmsgerr*)NLMSG_DATA(header);
+            acknowledged++;
+            if( (errormsg->error != 0) && (!errorCallback(-errormsg->error)) ) {
+               return false;
+            }
+         }
+      }
+   }
+}
+
+
+// ###### Find a netlink attribute ##########################################
+const nlattr* NetlinkSocket::findAttribute(const void*          data,
+                                           int                  length,
+                                           const unsigned short type)
+{
+   for(const nlattr* attribute = (const nlattr*)data;
+       (length >= (int)sizeof(nlattr)) &&
+          (attribute->nla_len >= sizeof(nlattr)) && (attribute->nla_len <= length);
+       length -= NLA_ALIGN(attribute->nla_len),
+          attribute = (const nlattr*)((const char*)attribute + NLA_ALIGN(attribute->nla_len))) {
+      if((attribute->nla_type & NLA_TYPE_MASK) == type) {
+         return attribute;
+      }
+   }
+   return nullptr;
+}
+
+
+// ###### Get the payload of a netlink attribute ############################
+const void* NetlinkSocket::getPayload(const nlattr* attribute, const size_t length)
+{
+   if( (attribute != nullptr) && (attribute->nla_len >= NLA_HDRLEN + length) ) {
+      return (const char*)attribute + NLA_HDRLEN;
+   }
+   return nullptr;
+}
+
+
+// ###### Append a netlink attribute ########################################
+void NetlinkSocket::appendAttribute(std::vector<char>&   message,
+                                    const unsigned short type,
+                                    const void*          data,
+                                    const size_t         length)
+{
+   nlattr attribute;
+   attribute.nla_type = type;
+   attribute.nla_len  = NLA_HDRLEN + length;
+   message.insert(message.end(), (const char*)&attribute, (const char*)&attribute + sizeof(attribute));
+   message.insert(message.end(), (const char*)data, (const char*)data + length);
+   message.resize(NLA_ALIGN(message.size()), 0);
+}
+
+
+// ###### Append a netlink attribute as it is ###############################
+void NetlinkSocket::appendAttribute(std::vector<char>& message, const nlattr* attribute)
+{
+   if(attribute != nullptr) {
+      message.insert(message.end(), (const char*)attribute,
+                     (const char*)attribute + attribute->nla_len);
+      message.resize(NLA_ALIGN(message.size()), 0);
+   }
+}
@@ -0,0 +1,84 @@
+// ==========================================================================
+//                    ____              __  __ _   _ ____
+//                   |  _ \ _   _ _ __ |  \/  | | | / ___|
+//                   | | | | | | | '_ \| |\/| | |_| \___ \
+//                   | |_| | |_| | | | | |  | |  _  |___) |
+//                   |____/ \__, |_| |_|_|  |_|_| |_|____/
+//                          |___/
+//
+//                ---  Dynamic Multi-Homing Setup (DynMHS)  ---
+//                     https://www.nntb.no/~dreibh/dynmhs/
+// ==========================================================================
+//
+// Dynamic Multi-Homing Setup (DynMHS)
+// Copyright (C) 2024-2026 by Thomas Dreibholz
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Contact: dreibh@simula.no
+
+#ifndef NETLINKSOCKET_H
+#define NETLINKSOCKET_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <linux/netlink.h>
+
+
+// ###### Netlink socket for requests, dumps and batches ####################
+/* A query sends one request, and hands each reply to a callback, until the
+ * end of the dump or the acknowledgement. Other requests are collected
+ * first, and then sent in batches. The kernel handles the requests of a
+ * batch within send(). Without NLM_F_ACK, only errors are returned, e.g.
+ * for an object that is gone in the meantime. The requests use the same
+ * socket as the dumps, so they are only sent after a dump is complete. */
+class NetlinkSocket
+{
+   public:
+   NetlinkSocket();
+   ~NetlinkSocket();
+
+   bool open(const int protocol);
+   void close();
+   inline bool isOpen() const { return SD >= 0; }
+
+   bool query(nlmsghdr*                                    request,
+              const char*                                  description,
+              const std::function<void(const nlmsghdr*)>& callback);
+   bool sendRequests(std::vector<char>&              requests,
+                     const char*                     description,
+                     const std::function<bool(int)>& errorCallback);
+
+   static const nlattr* findAttribute(const void*          data,
+                                      int                  length,
+                                      const unsigned short type);
+   static const void* getPayload(const nlattr* attribute, const size_t length);
+   static void appendAttribute(std::vector<char>&   message,
+                               const unsigned short type,
+                               const void*          data,
+                               const size_t         length);
+   static void appendAttribute(std::vector<char>& message, const nlattr* attribute);
+
+   private:
+   bool sendBatch(std::vector<char>&              batch,
+                  const unsigned int              acknowledgements,
+                  const char*                     description,
+                  const std::function<bool(int)>& errorCallback);
+
+   int      SD;
+   uint32_t SeqNumber;
+};
+
+#endif
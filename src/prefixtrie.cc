@@ -0,0 +1,98 @@
+// ==========================================================================
+//                    ____              __  __ _   _ ____
+//                   |  _ \ _   _ _ __ |  \/  | | | / ___|
+//                   | | | | | | | '_ \| |\/| | |_| \___ \
+//                   | |_| | |_| | | | | |  | |  _  |___) |
+//                   |____/ \__, |_| |_|_|  |_|_| |_|____/
+//                          |___/
+//
+//                ---  Dynamic Multi-Homing Setup (DynMHS)  ---
+//                     https://www.nntb.no/~dreibh/dynmhs/
+// ==========================================================================
+//
+// Dynamic Multi-Homing Setup (DynMHS)
+// Copyright (C) 2024-2026 by Thomas Dreibholz
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Contact: dreibh@simula.no
+
+#include "prefixtrie.h"
+
+#include <sys/socket.h>
+
+
+// ###### Constructor #######################################################
+PrefixTrie::PrefixTrie()
+{
+   Nodes.resize(2);   // Roots of IPv4 and IPv6
+   for(Node& root : Nodes) {
+      root.Child[0] = root.Child[1] = 0;
+      root.Terminal = false;
+   }
+   Prefixes = 0;
+}
+
+
+// ###### Get the root node of an address family ############################
+uint32_t PrefixTrie::getRoot(const uint8_t family)
+{
+   return (family == AF_INET6) ? 1 : 0;
+}
+
+
+// ###### Insert a prefix ###################################################
+void PrefixTrie::insert(const uint8_t  family,
+                        const uint8_t* prefix,
+                        const uint8_t  prefixLength)
+{
+   uint32_t node = getRoot(family);
+   for(unsigned int i = 0; i < prefixLength; i++) {
+      const unsigned int bit = (prefix[i / 8] >> (7 - (i % 8))) & 1;
+      if(Nodes[node].Child[bit] == 0) {
+         Node child;
+         child.Child[0] = child.Child[1] = 0;
+         child.Terminal = false;
+         Nodes[node].Child[bit] = Nodes.size();
+         Nodes.push_back(child);
+      }
+      node = Nodes[node].Child[bit];
+   }
+   if(!Nodes[node].Terminal) {
+      Nodes[node].Terminal = true;
+      Prefixes++;
+   }
+}
+
+
+// ###### Check whether a prefix is covered by an inserted prefix ###########
+bool PrefixTrie::covers(const uint8_t  family,
+                        const uint8_t* prefix,
+                        const uint8_t  prefixLength) const
+{
+   uint32_t node = getRoot(family);
+   for(unsigned int i = 0; ; i++) {
+      if(Nodes[node].Terminal) {
+         return true;
+      }
+      if(i >= prefixLength) {
+         return false;
+      }
+      const unsigned int bit = (prefix[i / 8] >> (7 - (i % 8))) & 1;
+      node = Nodes[node].Child[bit];
+      if(node == 0) {
+         return false;
+      }
+   }
+}
@@ -0,0 +1,64 @@
+// ==========================================================================
+//                    ____              __  __ _   _ ____
+//                   |  _ \ _   _ _ __ |  \/  | | | / ___|
+//                   | | | | | | | '_ \| |\/| | |_| \___ \
+//                   | |_| | |_| | | | | |  | |  _  |___) |
+//                   |____/ \__, |_| |_|_|  |_|_| |_|____/
+//                          |___/
+//
+//                ---  Dynamic Multi-Homing Setup (DynMHS)  ---
+//                     https://www.nntb.no/~dreibh/dynmhs/
+// ==========================================================================
+//
+// Dynamic Multi-Homing Setup (DynMHS)
+// Copyright (C) 2024-2026 by Thomas Dreibholz
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Contact: dreibh@simula.no
+
+#ifndef PREFIXTRIE_H
+#define PREFIXTRIE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// ###### Binary trie of IPv4 and IPv6 prefixes #############################
+/* The nodes are kept in one vector, with the roots of IPv4 and IPv6 at
+ * fixed positions. A lookup walks at most one node per prefix bit, without
+ * any allocation. */
+class PrefixTrie
+{
+   public:
+   PrefixTrie();
+
+   void insert(const uint8_t family, const uint8_t* prefix, const uint8_t prefixLength);
+   bool covers(const uint8_t family, const uint8_t* prefix, const uint8_t prefixLength) const;
+   inline size_t getPrefixes() const { return Prefixes; }
+
+   private:
+   struct Node {
+      uint32_t Child[2];   // 0 for none
+      bool     Terminal;   // A prefix ends here
+   };
+
+   static uint32_t getRoot(const uint8_t family);
+
+   std::vector<Node> Nodes;
+   size_t            Prefixes;
+};
+
+#endif
@@ -0,0 +1,409 @@
+// ==========================================================================
+//                    ____              __  __ _   _ ____
+//                   |  _ \ _   _ _ __ |  \/  | | | / ___|
+//                   | | | | | | | '_ \| |\/| | |_| \___ \
+//                   | |_| | |_| | | | | |  | |  _  |___) |
+//                   |____/ \__, |_| |_|_|  |_|_| |_|____/
+//                          |___/
+//
+//                ---  Dynamic Multi-Homing Setup (DynMHS)  ---
+//                     https://www.nntb.no/~dreibh/dynmhs/
+// ==========================================================================
+//
+// Dynamic Multi-Homing Setup (DynMHS)
+// Copyright (C) 2024-2026 by Thomas Dreibholz
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Contact: dreibh@simula.no
+
+#include "prober.h"
+#include "logger.h"
+
+#include <cstring>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/icmp6.h>
+#include <netinet/ip.h>
+#include <netinet/ip_icmp.h>
+#include <sys/socket.h>
+
+
+#ifndef ICMP_FILTER
+#define ICMP_FILTER 1   // From <linux/icmp.h>, which conflicts with <netinet/ip_icmp.h>
+#endif
+
+#define PROBER_BATCH          64     // Messages per sendmmsg()/recvmmsg() call
+#define PROBER_DOWN_ROUNDS    3      // Rounds without reply until down
+#define PROBER_UP_ROUNDS      2      // Rounds with replies until up again
+#define PROBER_DEGRADED_LOSS  0.25   // Loss rate of a degraded network
+
+
+// ###### Constructor #######################################################
+Prober::Prober()
+{
+   SD[0]      = -1;
+   SD[1]      = -1;
+   Identifier = getpid() & 0xffff;
+   Sequence   = 0;
+}
+
+
+// ###### Destructor ########################################################
+Prober::~Prober()
+{
+   close();
+}
+
+
+// ###### Open the raw sockets ##############################################
+/* A family without socket (e.g. IPv6 turned off) is not probed. */
+bool Prober::open()
+{
+   close();
+   SD[0] = socket(AF_INET, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_ICMP);
+   if(SD[0] >= 0) {
+      const uint32_t filter = ~(1U << ICMP_ECHOREPLY);   // Bitmap of blocked types
+      if(setsockopt(SD[0], SOL_RAW, ICMP_FILTER, &filter, sizeof(filter)) < 0) {
+         DMHS_LOG(warning) << "setsockopt(ICMP_FILTER) failed: " << strerror(errno);
+      }
+   }
+   else {
+      DMHS_LOG(warning) << "socket(AF_INET, IPPROTO_ICMP) failed: " << strerror(errno);
+   }
+   SD[1] = socket(AF_INET6, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_ICMPV6);
+   if(SD[1] >= 0) {
+      icmp6_filter filter;
+      ICMP6_FILTER_SETBLOCKALL(&filter);
+      ICMP6_FILTER_SETPASS(ICMP6_ECHO_REPLY, &filter);
+      if(setsockopt(SD[1], IPPROTO_ICMPV6, ICMP6_FILTER, &filter, sizeof(filter)) < 0) {
+         DMHS_LOG(warning) << "setsockopt(ICMP6_FILTER) failed: " << strerror(errno);
+      }
+   }
+   else {
+      DMHS_LOG(warning) << "socket(AF_INET6, IPPROTO_ICMPV6) failed: " << strerror(errno);
+   }
+   return isOpen();
+}
+
+
+// ###### Close the raw sockets #############################################
+void Prober::close()
+{
+   for(unsigned int i = 0; i < 2; i++) {
+      if(SD[i] >= 0) {
+         ::close(SD[i]);
+         SD[i] = -1;
+      }
+   }
+   Probes.clear();
+}
+
+
+// ###### Set the targets of a network ######################################
+void Prober::setTargets(const unsigned int network, const std::vector<Address>& targets)
+{
+   const auto found = Networks.find(network);
+   if(found != Networks.end()) {
+      found->second.Targets = targets;
+   }
+   else {
+      Network& entry = Networks[network];
+      entry.Targets = targets;
+      memset(&entry.Sent, 0, sizeof(entry.Sent));
+      memset(&entry.Received, 0, sizeof(entry.Received));
+      entry.Round        = 0;
+      entry.FailedRounds = 0;
+      entry.GoodRounds   = 0;
+      entry.Status       = { Unknown, 0.0, 0.0 };
+   }
+}
+
+
+// ###### Set the source addresses of a network #############################
+void Prober::setSources(const unsigned int network, const std::vector<Address>& sources)
+{
+   const auto found = Networks.find(network);
+   if(found != Networks.end()) {
+      found->second.Sources = sources;
+   }
+}
+
+
+// ###### Get the health of a network #######################################
+const Prober::Health* Prober::getHealth(const unsigned int network) const
+{
+   const auto found = Networks.find(network);
+   if(found != Networks.end()) {
+      return &found->second.Status;
+   }
+   return nullptr;
+}
+
+
+// ###### Get the name of a health state ####################################
+const char* Prober::getStateName(const HealthState state)
+{
+   static const char* names[] = { "unknown", "up", "degraded", "down" };
+   return names[state];
+}
+
+
+// ###### Evaluate the last round of a network ##############################
+/* A network is down after PROBER_DOWN_ROUNDS rounds without any reply. It
+ * is up again after PROBER_UP_ROUNDS rounds with replies, so that a single
+ * reply does not make a broken network flap. */
+bool Prober::evaluate(Network& network)
+{
+   const HealthState oldState = network.Status.State;
+   const unsigned int round   = network.Round;
+   if(network.Sent[round] == 0) {
+      network.Status.State = Unknown;   // No source address or target
+   }
+   else {
+      if(network.Received[round] == 0) {
+         network.FailedRounds++;
+         network.GoodRounds = 0;
+      }
+      else {
+         network.GoodRounds++;
+         network.FailedRounds = 0;
+      }
+
+      // ====== Loss rate within the window =================================
+      unsigned int sent     = 0;
+      unsigned int received = 0;
+      for(unsigned int i = 0; i < WindowSize; i++) {
+         sent     += network.Sent[i];
+         received += network.Received[i];
+      }
+      network.Status.Loss = 1.0 - (double)received / (double)sent;
+
+      // ====== Health state ================================================
+      if(network.FailedRounds >= PROBER_DOWN_ROUNDS) {
+         network.Status.State = Down;
+      }
+      else if( (network.GoodRounds > 0) &&
+               ( (oldState != Down) || (network.GoodRounds >= PROBER_UP_ROUNDS) ) ) {
+         network.Status.State = (network.Status.Loss >= PROBER_DEGRADED_LOSS) ? Degraded : Up;
+      }
+   }
+
+   // ====== Next round =====================================================
+   network.Round = (round + 1) % WindowSize;
+   network.Sent[network.Round]     = 0;
+   network.Received[network.Round] = 0;
+   return (network.Status.State != oldState);
+}
+
+
+// ###### Send the probes of one address family #############################
+void Prober::sendProbes(const unsigned int familyIndex)
+{
+   const uint8_t family = (familyIndex == 0) ? AF_INET : AF_INET6;
+   struct Message {
+      union {
+         sockaddr_in  In;
+         sockaddr_in6 In6;
+      }          Destination;
+      icmphdr    Header;   // Same layout as icmp6_hdr for echo requests
+      char       Control[CMSG_SPACE(sizeof(in6_pktinfo))];
+      iovec      IOVec;
+   };
+   Message  messages[PROBER_BATCH];
+   mmsghdr  headers[PROBER_BATCH];
+   unsigned int count = 0;
+
+   const std::chrono::time_point<std::chrono::steady_clock> now =
+      std::chrono::steady_clock::now();
+   for(auto iterator = Networks.begin(); iterator != Networks.end(); iterator++) {
+      Network& network = iterator->second;
+      for(const Address& source : network.Sources) {
+         if(source.Family != family) {
+            continue;
+         }
+         for(const Address& target : network.Targets) {
+            if(target.Family != family) {
+               continue;
+            }
+
+            // ====== Build the echo request ================================
+            Message& message = messages[count];
+            mmsghdr& header  = headers[count];
+            memset(&message, 0, sizeof(message));
+            memset(&header, 0, sizeof(header));
+            Sequence++;
+            message.Header.type             = (family == AF_INET) ? ICMP_ECHO : ICMP6_ECHO_REQUEST;
+            message.Header.un.echo.id       = htons(Identifier);
+            message.Header.un.echo.sequence = htons(Sequence);
+            if(family == AF_INET) {
+               // The kernel only computes the checksum for ICMPv6
+               const uint16_t* data = (const uint16_t*)&message.Header;
+               uint32_t        sum  = 0;
+               for(unsigned int i = 0; i < sizeof(message.Header) / 2; i++) {
+                  sum += data[i];
+               }
+               sum = (sum >> 16) + (sum & 0xffff);
+               sum += (sum >> 16);
+               message.Header.checksum = ~sum;
+            }
+            message.IOVec = { &message.Header, sizeof(message.Header) };
+            header.msg_hdr.msg_iov     = &message.IOVec;
+            header.msg_hdr.msg_iovlen  = 1;
+            header.msg_hdr.msg_name    = &message.Destination;
+            header.msg_hdr.msg_control = &message.Control;
+
+            // ====== Source address and interface ==========================
+            /* The interface is set as well, so that the probe takes the path
+             * of the network even while its rules are suspended. */
+            cmsghdr* cmsg = (cmsghdr*)&message.Control;
+            if(family == AF_INET) {
+               message.Destination.In.sin_family = AF_INET;
+               memcpy(&message.Destination.In.sin_addr, target.Address, 4);
+               header.msg_hdr.msg_namelen    = sizeof(sockaddr_in);
+               header.msg_hdr.msg_controllen = CMSG_SPACE(sizeof(in_pktinfo));
+               cmsg->cmsg_level = IPPROTO_IP;
+               cmsg->cmsg_type  = IP_PKTINFO;
+               cmsg->cmsg_len   = CMSG_LEN(sizeof(in_pktinfo));
+               in_pktinfo* info = (in_pktinfo*)CMSG_DATA(cmsg);
+               info->ipi_ifindex = source.IfIndex;
+               memcpy(&info->ipi_spec_dst, source.Address, 4);
+            }
+            else {
+               message.Destination.In6.sin6_family = AF_INET6;
+               memcpy(&message.Destination.In6.sin6_addr, target.Address, 16);
+               header.msg_hdr.msg_namelen    = sizeof(sockaddr_in6);
+               header.msg_hdr.msg_controllen = CMSG_SPACE(sizeof(in6_pktinfo));
+               cmsg->cmsg_level = IPPROTO_IPV6;
+               cmsg->cmsg_type  = IPV6_PKTINFO;
+               cmsg->cmsg_len   = CMSG_LEN(sizeof(in6_pktinfo));
+               in6_pktinfo* info = (in6_pktinfo*)CMSG_DATA(cmsg);
+               info->ipi6_ifindex = source.IfIndex;
+               memcpy(&info->ipi6_addr, source.Address, 16);
+            }
+
+            Probe& probe = Probes[Sequence];
+            probe.Network  = iterator->first;
+            probe.SendTime = now;
+            memcpy(&probe.Target, target.Address, sizeof(probe.Target));
+            network.Sent[network.Round]++;
+
+            // ====== Send a full batch =====================================
+            if(++count == PROBER_BATCH) {
+               if(sendmmsg(SD[familyIndex], headers, count, 0) < 0) {
+                  DMHS_LOG(debug) << "sendmmsg() failed: " << strerror(errno);
+               }
+               count = 0;
+            }
+         }
+      }
+   }
+   if( (count > 0) && (sendmmsg(SD[familyIndex], headers, count, 0) < 0) ) {
+      DMHS_LOG(debug) << "sendmmsg() failed: " << strerror(errno);
+   }
+}
+
+
+// ###### Evaluate the last round, and start the next one ###################
+void Prober::probe(std::vector<unsigned int>& changedNetworks)
+{
+   changedNetworks.clear();
+   for(auto iterator = Networks.begin(); iterator != Networks.end(); iterator++) {
+      if(evaluate(iterator->second)) {
+         changedNetworks.push_back(iterator->first);
+      }
+   }
+
+   Probes.clear();   // Replies arriving later count as lost
+   for(unsigned int familyIndex = 0; familyIndex < 2; familyIndex++) {
+      if(SD[familyIndex] >= 0) {
+         sendProbes(familyIndex);
+      }
+   }
+}
+
+
+// ###### Receive the replies ###############################################
+void Prober::receiveReplies()
+{
+   struct Message {
+      sockaddr_in6 Source;
+      char         Data[128];   // IPv4 header and ICMP header
+      iovec        IOVec;
+   };
+   Message messages[PROBER_BATCH];
+   mmsghdr headers[PROBER_BATCH];
+
+   for(unsigned int familyIndex = 0; familyIndex < 2; familyIndex++) {
+      if(SD[familyIndex] < 0) {
+         continue;
+      }
+      int received;
+      do {
+         for(unsigned int i = 0; i < PROBER_BATCH; i++) {
+            messages[i].IOVec = { &messages[i].Data, sizeof(messages[i].Data) };
+            memset(&headers[i], 0, sizeof(headers[i]));
+            headers[i].msg_hdr.msg_iov     = &messages[i].IOVec;
+            headers[i].msg_hdr.msg_iovlen  = 1;
+            headers[i].msg_hdr.msg_name    = &messages[i].Source;
+            headers[i].msg_hdr.msg_namelen = sizeof(messages[i].Source);
+         }
+         received = recvmmsg(SD[familyIndex], headers, PROBER_BATCH, MSG_DONTWAIT, nullptr);
+         const std::chrono::time_point<std::chrono::steady_clock> now =
+            std::chrono::steady_clock::now();
+         for(int i = 0; i < received; i++) {
+            // ====== Find the echo reply ===================================
+            const char*    data   = messages[i].Data;
+            unsigned int   length = headers[i].msg_len;
+            const uint8_t* source;
+            if(familyIndex == 0) {
+               const iphdr* ip = (const iphdr*)data;   // Raw IPv4 sockets get the IP header
+               if( (length < sizeof(iphdr)) || (length < 4U * ip->ihl + sizeof(icmphdr)) ) {
+                  continue;
+               }
+               data   += 4 * ip->ihl;
+               length -= 4 * ip->ihl;
+               source  = (const uint8_t*)&((const sockaddr_in*)&messages[i].Source)->sin_addr;
+            }
+            else {
+               if(length < sizeof(icmp6_hdr)) {
+                  continue;
+               }
+               source = (const uint8_t*)&messages[i].Source.sin6_addr;
+            }
+            const icmphdr* icmp = (const icmphdr*)data;
+            if( (icmp->type != ((familyIndex == 0) ? ICMP_ECHOREPLY : ICMP6_ECHO_REPLY)) ||
+                (ntohs(icmp->un.echo.id) != Identifier) ) {
+               continue;   // Not a reply to this prober
+            }
+            const auto found = Probes.find(ntohs(icmp->un.echo.sequence));
+            if( (found == Probes.end()) ||
+                (memcmp(found->second.Target, source, (familyIndex == 0) ? 4 : 16) != 0) ) {
+               continue;
+            }
+
+            // ====== Update loss and RTT of the network ====================
+            const auto network = Networks.find(found->second.Network);
+            if(network != Networks.end()) {
+               const double rtt = std::chrono::duration<double, std::milli>(
+                                     now - found->second.SendTime).count();
+               Health& status = network->second.Status;
+               status.RTT = (status.RTT > 0.0) ? (0.875 * status.RTT + 0.125 * rtt) : rtt;
+               network->second.Received[network->second.Round]++;
+            }
+            Probes.erase(found);
+         }
+      } while(received == PROBER_BATCH);
+   }
+}
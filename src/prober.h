@@ -0,0 +1,111 @@
+// ==========================================================================
+//                    ____              __  __ _   _ ____
+//                   |  _ \ _   _ _ __ |  \/  | | | / ___|
+//                   | | | | | | | '_ \| |\/| | |_| \___ \
+//                   | |_| | |_| | | | | |  | |  _  |___) |
+//                   |____/ \__, |_| |_|_|  |_|_| |_|____/
+//                          |___/
+//
+//                ---  Dynamic Multi-Homing Setup (DynMHS)  ---
+//                     https://www.nntb.no/~dreibh/dynmhs/
+// ==========================================================================
+//
+// Dynamic Multi-Homing Setup (DynMHS)
+// Copyright (C) 2024-2026 by Thomas Dreibholz
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Contact: dreibh@simula.no
+
+#ifndef PROBER_H
+#define PROBER_H
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+
+// ###### Active path prober ################################################
+/* The prober sends ICMP/ICMPv6 echo requests from the source addresses of
+ * each network to its targets, over the interface of the source address.
+ * All requests of a round are sent by one sendmmsg() call per address
+ * family, the replies are received in batches by recvmmsg(). At the start
+ * of the next round, the replies of the previous round are evaluated,
+ * giving the loss rate and the smoothed RTT of each network, and its
+ * health state. */
+class Prober
+{
+   public:
+   enum HealthState {
+      Unknown  = 0,
+      Up       = 1,
+      Degraded = 2,   // Reachable, but with high loss
+      Down     = 3
+   };
+   struct Address {
+      uint8_t      Family;
+      unsigned int IfIndex;   // Interface of a source address
+      uint8_t      Address[16];
+   };
+   struct Health {
+      HealthState State;
+      double      Loss;   // Fraction of probes lost within the window
+      double      RTT;    // Smoothed RTT in ms (0 if unknown)
+   };
+
+   Prober();
+   ~Prober();
+
+   bool open();
+   void close();
+   inline bool isOpen() const { return (SD[0] >= 0) || (SD[1] >= 0); }
+   inline int getSocketDescriptor(const unsigned int index) const { return SD[index]; }
+
+   void setTargets(const unsigned int network, const std::vector<Address>& targets);
+   void setSources(const unsigned int network, const std::vector<Address>& sources);
+   void probe(std::vector<unsigned int>& changedNetworks);
+   void receiveReplies();
+   const Health* getHealth(const unsigned int network) const;
+   static const char* getStateName(const HealthState state);
+
+   private:
+   static const unsigned int WindowSize = 10;   // Rounds
+   struct Network {
+      std::vector<Address> Targets;
+      std::vector<Address> Sources;
+      unsigned int         Sent[WindowSize];       // Probes sent per round
+      unsigned int         Received[WindowSize];   // Replies received per round
+      unsigned int         Round;                  // Position in the window
+      unsigned int         FailedRounds;           // Successive rounds without reply
+      unsigned int         GoodRounds;             // Successive rounds with replies
+      Health               Status;
+   };
+   struct Probe {
+      unsigned int                                       Network;
+      uint8_t                                            Target[16];
+      std::chrono::time_point<std::chrono::steady_clock> SendTime;
+   };
+
+   bool evaluate(Network& network);
+   void sendProbes(const unsigned int familyIndex);
+
+   int                              SD[2];   // IPv4 and IPv6 sockets
+   uint16_t                         Identifier;
+   uint16_t                         Sequence;
+   std::map<unsigned int, Network>  Networks;
+   std::map<uint16_t, Probe>        Probes;   // Sequence number -> probe of this round
+};
+
+#endif
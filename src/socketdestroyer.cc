@@ -0,0 +1,172 @@
+// ==========================================================================
+//                    ____              __  __ _   _ ____
+//                   |  _ \ _   _ _ __ |  \/  | | | / ___|
+//                   | | | | | | | '_ \| |\/| | |_| \___ \
+//                   | |_| | |_| | | | | |  | |  _  |___) |
+//                   |____/ \__, |_| |_|_|  |_|_| |_|____/
+//                          |___/
+//
+//                ---  Dynamic Multi-Homing Setup (DynMHS)  ---
+//                     https://www.nntb.no/~dreibh/dynmhs/
+// ==========================================================================
+//
+// Dynamic Multi-Homing Setup (DynMHS)
+// Copyright (C) 2024-2026 by Thomas Dreibholz
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Contact: dreibh@simula.no
+
+#include "socketdestroyer.h"
+#include "logger.h"
+
+#include <cstring>
+#include <netinet/in.h>
+#include <linux/inet_diag.h>
+#include <linux/sock_diag.h>
+
+
+#define SOCKET_DESTROYER_STATES (0xfff & ~(1 << 10))   // All states but listen
+
+struct DestroyRequest {
+   nlmsghdr         Header;
+   inet_diag_req_v2 Request;
+};
+
+
+// ###### Constructor #######################################################
+SocketDestroyer::SocketDestroyer()
+{
+}
+
+
+// ###### Destructor ########################################################
+SocketDestroyer::~SocketDestroyer()
+{
+   close();
+}
+
+
+// ###### Open the sock_diag socket #########################################
+bool SocketDestroyer::open()
+{
+   return Netlink.open(NETLINK_SOCK_DIAG);
+}
+
+
+// ###### Close the sock_diag socket ########################################
+void SocketDestroyer::close()
+{
+   Netlink.close();
+}
+
+
+// ###### Destroy the sockets bound to one of the addresses #################
+unsigned int SocketDestroyer::destroy(const std::vector<Address>& addresses)
+{
+   static const uint8_t families[]  = { AF_INET, AF_INET6 };
+   static const uint8_t protocols[] = { IPPROTO_TCP, IPPROTO_UDP };
+   unsigned int         destroyed   = 0;
+   if( (Netlink.isOpen()) && (!addresses.empty()) ) {
+      // IPv6 sockets are always walked, since they may use IPv4-mapped addresses
+      for(const uint8_t family : families) {
+         for(const uint8_t protocol : protocols) {
+            destroyed += destroy(family, protocol, addresses);
+         }
+      }
+   }
+   return destroyed;
+}
+
+
+// ###### Check whether a socket is bound to one of the addresses ###########
+static bool matchesAddress(const uint8_t                                 family,
+                           const uint32_t*                               source,
+                           const bool                                    connected,
+                           const std::vector<SocketDestroyer::Address>& addresses)
+{
+   static const uint32_t mappedPrefix[3] = { 0, 0, htonl(0xffff) };
+   for(const SocketDestroyer::Address& address : addresses) {
+      if( (address.ConnectedOnly) && (!connected) ) {
+         continue;
+      }
+      if(address.Family == AF_INET6) {
+         if( (family == AF_INET6) && (memcmp(source, &address.Address, 16) == 0) ) {
+            return true;
+         }
+      }
+      else if(family == AF_INET) {
+         if(memcmp(source, &address.Address, 4) == 0) {
+            return true;
+         }
+      }
+      else if( (memcmp(source, &mappedPrefix, sizeof(mappedPrefix)) == 0) &&
+               (memcmp(&source[3], &address.Address, 4) == 0) ) {
+         return true;   // IPv4-mapped IPv6 address
+      }
+   }
+   return false;
+}
+
+
+// ###### Destroy the sockets of a family and protocol ######################
+unsigned int SocketDestroyer::destroy(const uint8_t               family,
+                                      const uint8_t               protocol,
+                                      const std::vector<Address>& addresses)
+{
+   // ====== Find the sockets bound to one of the addresses =================
+   DestroyRequest request;
+   memset(&request, 0, sizeof(request));
+   request.Header.nlmsg_len       = sizeof(request);
+   request.Header.nlmsg_type      = SOCK_DIAG_BY_FAMILY;
+   request.Header.nlmsg_flags     = NLM_F_REQUEST | NLM_F_DUMP;
+   request.Request.sdiag_family   = family;
+   request.Request.sdiag_protocol = protocol;
+   request.Request.idiag_states   = SOCKET_DESTROYER_STATES;
+   std::vector<char> requests;
+   const bool        dumped = Netlink.query(&request.Header, "Socket dump",
+                                            [&](const nlmsghdr* header) {
+      const inet_diag_msg* diag = (const inet_diag_msg*)NLMSG_DATA(header);
+      if(header->nlmsg_len < NLMSG_LENGTH(sizeof(*diag))) {
+         return;
+      }
+      // A socket without peer, e.g. an unconnected UDP socket, has no
+      // destination port.
+      if(matchesAddress(family, diag->id.idiag_src,
+                        (diag->id.idiag_dport != 0), addresses)) {
+         DestroyRequest destroyRequest = request;
+         destroyRequest.Header.nlmsg_type  = SOCK_DESTROY;
+         destroyRequest.Header.nlmsg_flags = NLM_F_REQUEST;
+         destroyRequest.Request.id         = diag->id;   // Including the cookie
+         requests.insert(requests.end(), (const char*)&destroyRequest,
+                         (const char*)&destroyRequest + sizeof(destroyRequest));
+      }
+   });
+   if(!dumped) {
+      return 0;
+   }
+
+   // ====== Destroy the sockets ============================================
+   const unsigned int sockets   = requests.size() / sizeof(DestroyRequest);
+   const bool         destroyed = Netlink.sendRequests(requests, "SOCK_DESTROY",
+                                                       [](const int error) {
+      if(error == EOPNOTSUPP) {
+         DMHS_LOG(warning) << "SOCK_DESTROY is not supported by the kernel";
+         return false;
+      }
+      DMHS_LOG(debug) << "SOCK_DESTROY failed: " << strerror(error);
+      return true;
+   });
+   return (destroyed) ? sockets : 0;
+}
@@ -0,0 +1,73 @@
+// ==========================================================================
+//                    ____              __  __ _   _ ____
+//                   |  _ \ _   _ _ __ |  \/  | | | / ___|
+//                   | | | | | | | '_ \| |\/| | |_| \___ \
+//                   | |_| | |_| | | | | |  | |  _  |___) |
+//                   |____/ \__, |_| |_|_|  |_|_| |_|____/
+//                          |___/
+//
+//                ---  Dynamic Multi-Homing Setup (DynMHS)  ---
+//                     https://www.nntb.no/~dreibh/dynmhs/
+// ==========================================================================
+//
+// Dynamic Multi-Homing Setup (DynMHS)
+// Copyright (C) 2024-2026 by Thomas Dreibholz
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Contact: dreibh@simula.no
+
+#ifndef SOCKETDESTROYER_H
+#define SOCKETDESTROYER_H
+
+#include "netlinksocket.h"
+
+#include <cstdint>
+#include <vector>
+
+
+// ###### Destroyer of sockets bound to an address ##########################
+/* The sockets are found by one sock_diag dump per address family and
+ * protocol. Then, all matching sockets are destroyed by SOCK_DESTROY
+ * requests, sent in batches by the NetlinkSocket. The kernel aborts a
+ * destroyed TCP connection with ECONNABORTED, so that the application can
+ * reconnect at once. This requires a kernel with CONFIG_INET_DIAG_DESTROY.
+ * For an address that is still present, only the connected sockets are
+ * destroyed, so that e.g. a server socket bound to the address stays. */
+class SocketDestroyer
+{
+   public:
+   struct Address {
+      uint8_t Family;
+      bool    ConnectedOnly;   // Address is still present
+      uint8_t Address[16];
+   };
+
+   SocketDestroyer();
+   ~SocketDestroyer();
+
+   bool open();
+   void close();
+   inline bool isOpen() const { return Netlink.isOpen(); }
+
+   unsigned int destroy(const std::vector<Address>& addresses);
+
+   private:
+   unsigned int destroy(const uint8_t family, const uint8_t protocol,
+                        const std::vector<Address>& addresses);
+
+   NetlinkSocket Netlink;
+};
+
+#endif
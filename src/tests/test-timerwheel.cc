@@ -0,0 +1,194 @@
+// ==========================================================================
+//                    ____              __  __ _   _ ____
+//                   |  _ \ _   _ _ __ |  \/  | | | / ___|
+//                   | | | | | | | '_ \| |\/| | |_| \___ \
+//                   | |_| | |_| | | | | |  | |  _  |___) |
+//                   |____/ \__, |_| |_|_|  |_|_| |_|____/
+//                          |___/
+//
+//                ---  Dynamic Multi-Homing Setup (DynMHS)  ---
+//                     https://www.nntb.no/~dreibh/dynmhs/
+// ==========================================================================
+//
+// Dynamic Multi-Homing Setup (DynMHS)
+// Copyright (C) 2024-2026 by Thomas Dreibholz
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Contact: dreibh@simula.no
+
+#include "../timerwheel.h"
+
+#include <algorithm>
+#include <iostream>
+
+
+// Each level has 64 slots, i.e. level n covers 64^(n+1) ticks.
+#define LEVEL1 64ULL
+#define LEVEL2 (64ULL * 64)
+#define LEVEL3 (64ULL * 64 * 64)
+#define TOP    (64ULL * 64 * 64 * 64)   // Beyond the range of the top level
+
+static unsigned int Failures = 0;
+
+
+// ###### Get the time point of a tick ######################################
+static std::chrono::steady_clock::time_point at(const TimerWheel& wheel, const uint64_t tick)
+{
+   return wheel.getOrigin() + std::chrono::seconds(tick);
+}
+
+
+// ###### Expire up to a tick and compare the expired timers ################
+static void expectExpired(TimerWheel&              wheel,
+                          const uint64_t           tick,
+                          std::vector<std::string> expected)
+{
+   std::vector<std::string> expired;
+   wheel.expire(expired, at(wheel, tick));
+   std::sort(expired.begin(), expired.end());
+   std::sort(expected.begin(), expected.end());
+   if(expired != expected) {
+      std::cerr << "FAILED: tick " << tick << ": expired {";
+      for(const std::string& key : expired) {
+         std::cerr << " " << key;
+      }
+      std::cerr << " }, expected {";
+      for(const std::string& key : expected) {
+         std::cerr << " " << key;
+      }
+      std::cerr << " }\n";
+      Failures++;
+   }
+}
+
+
+// ###### Check a condition #################################################
+static void expect(const bool condition, const char* description)
+{
+   if(!condition) {
+      std::cerr << "FAILED: " << description << "\n";
+      Failures++;
+   }
+}
+
+
+// ###### Timers at the boundaries of the levels ############################
+/* Each timer must expire exactly at its tick, neither earlier nor later,
+ * also after being moved down from the upper levels, or placed again from
+ * the end of the top level. */
+static void testLevelBoundaries()
+{
+   static const uint64_t ticks[] = {
+      1, LEVEL1 - 1, LEVEL1, LEVEL1 + 1, 2 * LEVEL1,
+      LEVEL2 - 1, LEVEL2, LEVEL2 + 1,
+      LEVEL3 - 1, LEVEL3, LEVEL3 + 1,
+      TOP - 1, TOP, TOP + 1, 2 * TOP + 7
+   };
+   TimerWheel wheel;
+   for(const uint64_t tick : ticks) {
+      wheel.schedule(std::to_string(tick), at(wheel, tick));
+   }
+   expect(wheel.getTimers() == sizeof(ticks) / sizeof(ticks[0]), "all timers scheduled");
+   for(const uint64_t tick : ticks) {
+      expectExpired(wheel, tick - 1, { });
+      expectExpired(wheel, tick, { std::to_string(tick) });
+   }
+   expect(wheel.getTimers() == 0, "no timers left");
+}
+
+
+// ###### Timers scheduled and expired with a stale current tick ############
+/* The wheel only advances on expire(). Timers scheduled after a long time
+ * without expire() are placed relative to the stale current tick, and a
+ * late expire() has to expire all timers that are due, at once. */
+static void testStaleCurrentTick()
+{
+   TimerWheel wheel;
+   wheel.schedule("a", at(wheel, 5000 + 10));
+   wheel.schedule("b", at(wheel, 5000 + LEVEL2 + 3));
+   expectExpired(wheel, 5000, { });
+   expectExpired(wheel, 5009, { });
+   expectExpired(wheel, 5010, { "a" });
+
+   // A timer in the past expires at the next tick.
+   wheel.schedule("c", at(wheel, 3));
+   expectExpired(wheel, 5010, { });
+   expectExpired(wheel, 5011, { "c" });
+
+   // A late expire() expires everything that is due.
+   wheel.schedule("d", at(wheel, 6000));
+   wheel.schedule("e", at(wheel, 5000 + LEVEL2 + 4));
+   expectExpired(wheel, 5000 + LEVEL2 + 3, { "b", "d" });
+   expectExpired(wheel, 100000, { "e" });
+
+   // Without timers, the wheel jumps to the current tick.
+   wheel.schedule("f", at(wheel, 100000 + LEVEL1));
+   expectExpired(wheel, 100000 + LEVEL1 - 1, { });
+   expectExpired(wheel, 100000 + LEVEL1, { "f" });
+}
+
+
+// ###### Rescheduling and cancelling #######################################
+static void testRescheduleAndCancel()
+{
+   TimerWheel wheel;
+   wheel.schedule("a", at(wheel, 10));
+   wheel.schedule("b", at(wheel, 20));
+   wheel.schedule("c", at(wheel, LEVEL2 + 5));
+   wheel.schedule("a", at(wheel, LEVEL1 + 1));   // Rescheduled to level 1
+   wheel.cancel("b");
+   wheel.cancel("x");   // Not scheduled
+   expect(wheel.getTimers() == 2, "two timers left after cancel");
+   expectExpired(wheel, 20, { });
+   expectExpired(wheel, LEVEL1 + 1, { "a" });
+   wheel.schedule("c", at(wheel, LEVEL1 + 2));   // Rescheduled to level 0
+   expectExpired(wheel, LEVEL1 + 2, { "c" });
+   expectExpired(wheel, LEVEL2 + 5, { });
+   expect(wheel.getTimers() == 0, "no timers left after expiry");
+}
+
+
+// ###### Next expiry for a poll timeout ####################################
+/* A timer above level 0 needs a wakeup to be moved down, before the one at
+ * its expiry. */
+static void testNextExpiry()
+{
+   TimerWheel wheel;
+   expect(wheel.getNextExpiry() == std::chrono::steady_clock::time_point::max(),
+          "no next expiry without timers");
+   wheel.schedule("a", at(wheel, LEVEL2 + 1));
+   expect(wheel.getNextExpiry() == at(wheel, LEVEL2), "next expiry at level 2 slot");
+   expectExpired(wheel, LEVEL2, { });
+   expect(wheel.getNextExpiry() == at(wheel, LEVEL2 + 1), "next expiry after moving down");
+   expectExpired(wheel, LEVEL2 + 1, { "a" });
+   expect(wheel.getNextExpiry() == std::chrono::steady_clock::time_point::max(),
+          "no next expiry after expiry");
+}
+
+
+// ###### Main program ######################################################
+int main()
+{
+   testLevelBoundaries();
+   testStaleCurrentTick();
+   testRescheduleAndCancel();
+   testNextExpiry();
+   if(Failures > 0) {
+      std::cerr << Failures << " check(s) failed!\n";
+      return 1;
+   }
+   std::cout << "Test passed!\n";
+   return 0;
+}
@@ -0,0 +1,290 @@
+// ==========================================================================
+//                    ____              __  __ _   _ ____
+//                   |  _ \ _   _ _ __ |  \/  | | | / ___|
+//                   | | | | | | | '_ \| |\/| | |_| \___ \
+//                   | |_| | |_| | | | | |  | |  _  |___) |
+//                   |____/ \__, |_| |_|_|  |_|_| |_|____/
+//                          |___/
+//
+//                ---  Dynamic Multi-Homing Setup (DynMHS)  ---
+//                     https://www.nntb.no/~dreibh/dynmhs/
+// ==========================================================================
+//
+// Dynamic Multi-Homing Setup (DynMHS)
+// Copyright (C) 2024-2026 by Thomas Dreibholz
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Contact: dreibh@simula.no
+
+#include "timerwheel.h"
+#include "logger.h"
+
+#include <cstring>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+
+// ###### Constructor #######################################################
+TimerWheel::TimerWheel()
+{
+   FD          = -1;
+   Origin      = std::chrono::steady_clock::now();
+   CurrentTick = 0;
+   ArmedTick   = 0;
+   for(unsigned int i = 0; i < Levels * Slots; i++) {
+      Heads[i] = -1;
+   }
+}
+
+
+// ###### Destructor ########################################################
+TimerWheel::~TimerWheel()
+{
+   close();
+}
+
+
+// ###### Open the timerfd ##################################################
+bool TimerWheel::open()
+{
+   close();
+   FD = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+   if(FD < 0) {
+      DMHS_LOG(warning) << "timerfd_create() failed: " << strerror(errno);
+      return false;
+   }
+   ArmedTick = 0;
+   arm();
+   return true;
+}
+
+
+// ###### Close the timerfd #################################################
+void TimerWheel::close()
+{
+   if(FD >= 0) {
+      ::close(FD);
+      FD = -1;
+   }
+}
+
+
+// ###### Get the tick of a time point, rounded up ##########################
+uint64_t TimerWheel::getTick(const std::chrono::steady_clock::time_point timePoint) const
+{
+   if(timePoint <= Origin) {
+      return 0;
+   }
+   const std::chrono::nanoseconds elapsed = timePoint - Origin;
+   return (elapsed.count() + 999999999LL) / 1000000000LL;
+}
+
+
+// ###### Schedule a timer, or reschedule it ################################
+void TimerWheel::schedule(const std::string&                          key,
+                          const std::chrono::steady_clock::time_point expiry)
+{
+   uint32_t   timer;
+   const auto found = Index.find(key);
+   if(found != Index.end()) {
+      timer = found->second;
+      unlink(timer);
+   }
+   else {
+      if(FreeTimers.empty()) {
+         timer = Timers.size();
+         Timers.resize(Timers.size() + 1);
+      }
+      else {
+         timer = FreeTimers.back();
+         FreeTimers.pop_back();
+      }
+      Timers[timer].Key = key;
+      Index.insert(std::pair<std::string, uint32_t>(key, timer));
+   }
+   Timers[timer].Expiry = std::max(getTick(expiry), CurrentTick + 1);
+   insert(timer);
+   if( (ArmedTick == 0) || (Timers[timer].Expiry < ArmedTick) ) {
+      arm();
+   }
+}
+
+
+// ###### Cancel a timer ####################################################
+/* The timerfd stays armed; an unnecessary wakeup just finds no timer. */
+void TimerWheel::cancel(const std::string& key)
+{
+   const auto found = Index.find(key);
+   if(found != Index.end()) {
+      unlink(found->second);
+      Timers[found->second].Key.clear();
+      FreeTimers.push_back(found->second);
+      Index.erase(found);
+   }
+}
+
+
+// ###### Insert a timer into its slot ######################################
+/* The level is given by the distance to the expiry. A timer beyond the
+ * range of the top level is placed at its end, and placed again when it is
+ * moved down. */
+void TimerWheel::insert(const uint32_t timer)
+{
+   const uint64_t delta  = Timers[timer].Expiry - CurrentTick;
+   unsigned int   level  = 0;
+   while( (level < Levels - 1) && (delta >= (1ULL << (LevelBits * (level + 1)))) ) {
+      level++;
+   }
+   const uint64_t placed = (delta >= (1ULL << (LevelBits * Levels))) ?
+                              CurrentTick + (1ULL << (LevelBits * Levels)) - 1 :
+                              Timers[timer].Expiry;
+   const uint32_t slot   = level * Slots + ((placed >> (LevelBits * level)) & (Slots - 1));
+   Timers[timer].Slot     = slot;
+   Timers[timer].Previous = -1;
+   Timers[timer].Next     = Heads[slot];
+   if(Heads[slot] >= 0) {
+      Timers[Heads[slot]].Previous = timer;
+   }
+   Heads[slot] = timer;
+}
+
+
+// ###### Remove a timer from its slot ######################################
+void TimerWheel::unlink(const uint32_t timer)
+{
+   if(Timers[timer].Previous >= 0) {
+      Timers[Timers[timer].Previous].Next = Timers[timer].Next;
+   }
+   else {
+      Heads[Timers[timer].Slot] = Timers[timer].Next;
+   }
+   if(Timers[timer].Next >= 0) {
+      Timers[Timers[timer].Next].Previous = Timers[timer].Previous;
+   }
+}
+
+
+// ###### Advance the wheel up to a tick ####################################
+void TimerWheel::advance(const uint64_t tick, std::vector<std::string>& expired)
+{
+   while( (CurrentTick < tick) && (!Index.empty()) ) {
+      CurrentTick++;
+
+      // ====== Move the timers of the reached slots down, from the top =====
+      for(unsigned int level = Levels - 1; level >= 1; level--) {
+         if((CurrentTick & ((1ULL << (LevelBits * level)) - 1)) == 0) {
+            const uint32_t slot  = level * Slots + ((CurrentTick >> (LevelBits * level)) & (Slots - 1));
+            int32_t        timer = Heads[slot];
+            Heads[slot] = -1;
+            while(timer >= 0) {
+               const int32_t next = Timers[timer].Next;
+               insert(timer);
+               timer = next;
+            }
+         }
+      }
+
+      // ====== Expire the timers of the current slot =======================
+      const uint32_t slot  = CurrentTick & (Slots - 1);
+      int32_t        timer = Heads[slot];
+      Heads[slot] = -1;
+      while(timer >= 0) {
+         const int32_t next = Timers[timer].Next;
+         expired.push_back(Timers[timer].Key);
+         Index.erase(Timers[timer].Key);
+         Timers[timer].Key.clear();
+         FreeTimers.push_back(timer);
+         timer = next;
+      }
+   }
+   CurrentTick = std::max(CurrentTick, tick);
+}
+
+
+// ###### Get the tick of the next occupied slot ############################
+/* Returns 0 if there is no timer. For a slot above level 0, this is the
+ * tick at which its timers are moved down. */
+uint64_t TimerWheel::getNextTick() const
+{
+   uint64_t next = 0;
+   for(unsigned int level = 0; level < Levels; level++) {
+      const uint64_t base = CurrentTick >> (LevelBits * level);
+      for(unsigned int j = 1; j <= Slots; j++) {
+         if(Heads[level * Slots + ((base + j) & (Slots - 1))] >= 0) {
+            const uint64_t candidate = (base + j) << (LevelBits * level);
+            if( (next == 0) || (candidate < next) ) {
+               next = candidate;
+            }
+            break;
+         }
+      }
+   }
+   return next;
+}
+
+
+// ###### Get the time of the next occupied slot ############################
+std::chrono::steady_clock::time_point TimerWheel::getNextExpiry() const
+{
+   const uint64_t next = getNextTick();
+   if(next == 0) {
+      return std::chrono::steady_clock::time_point::max();
+   }
+   return Origin + std::chrono::seconds(next);
+}
+
+
+// ###### Arm the timerfd for the next occupied slot ########################
+void TimerWheel::arm()
+{
+   if(FD < 0) {
+      return;
+   }
+   const uint64_t next = getNextTick();
+   if(next != ArmedTick) {
+      itimerspec value;
+      memset(&value, 0, sizeof(value));
+      if(next != 0) {
+         const std::chrono::nanoseconds expiry =
+            (Origin + std::chrono::seconds(next)).time_since_epoch();
+         value.it_value.tv_sec  = expiry.count() / 1000000000LL;
+         value.it_value.tv_nsec = expiry.count() % 1000000000LL;
+      }
+      if(timerfd_settime(FD, TFD_TIMER_ABSTIME, &value, nullptr) != 0) {
+         DMHS_LOG(warning) << "timerfd_settime() failed: " << strerror(errno);
+      }
+      ArmedTick = next;
+   }
+}
+
+
+// ###### Expire the due timers #############################################
+/* The keys of the expired timers are appended to expired, so that the
+ * caller can handle them in one batch. The current time may be given,
+ * e.g. to drive the wheel in a test. */
+void TimerWheel::expire(std::vector<std::string>&                   expired,
+                        const std::chrono::steady_clock::time_point now)
+{
+   uint64_t expirations;
+   if(FD >= 0) {
+      if( (read(FD, &expirations, sizeof(expirations)) < 0) && (errno != EAGAIN) ) {
+         DMHS_LOG(warning) << "read() of timerfd failed: " << strerror(errno);
+      }
+   }
+   const std::chrono::nanoseconds elapsed = now - Origin;
+   advance(elapsed.count() / 1000000000LL, expired);
+   ArmedTick = 0;   // The timerfd has fired
+   arm();
+}
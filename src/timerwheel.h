@@ -0,0 +1,96 @@
+// ==========================================================================
+//                    ____              __  __ _   _ ____
+//                   |  _ \ _   _ _ __ |  \/  | | | / ___|
+//                   | | | | | | | '_ \| |\/| | |_| \___ \
+//                   | |_| | |_| | | | | |  | |  _  |___) |
+//                   |____/ \__, |_| |_|_|  |_|_| |_|____/
+//                          |___/
+//
+//                ---  Dynamic Multi-Homing Setup (DynMHS)  ---
+//                     https://www.nntb.no/~dreibh/dynmhs/
+// ==========================================================================
+//
+// Dynamic Multi-Homing Setup (DynMHS)
+// Copyright (C) 2024-2026 by Thomas Dreibholz
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Contact: dreibh@simula.no
+
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+
+// ###### Hierarchical timer wheel driven by a timerfd ######################
+/* The timers have a resolution of one second. Each level has 64 slots; a
+ * timer is placed on the lowest level whose range covers its expiry, and
+ * moves down one level whenever the wheel has advanced into its slot. So,
+ * scheduling and cancelling take constant time, regardless of the number
+ * of timers. The timerfd is armed for the next occupied slot only. Without
+ * timerfd, the caller has to call expire() at the next expiry instead. */
+class TimerWheel
+{
+   public:
+   TimerWheel();
+   ~TimerWheel();
+
+   bool open();
+   void close();
+   inline int getDescriptor() const { return FD; }
+   inline size_t getTimers() const { return Index.size(); }
+   inline std::chrono::steady_clock::time_point getOrigin() const { return Origin; }
+   std::chrono::steady_clock::time_point getNextExpiry() const;
+
+   void schedule(const std::string& key, const std::chrono::steady_clock::time_point expiry);
+   void cancel(const std::string& key);
+   void expire(std::vector<std::string>&                   expired,
+               const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+   private:
+   static const unsigned int LevelBits = 6;
+   static const unsigned int Slots     = 1 << LevelBits;
+   static const unsigned int Levels    = 4;
+
+   struct Timer {
+      std::string Key;
+      uint64_t    Expiry;     // In ticks
+      int32_t     Previous;   // -1 for none
+      int32_t     Next;       // -1 for none
+      uint32_t    Slot;       // Level * Slots + slot
+   };
+
+   uint64_t getTick(const std::chrono::steady_clock::time_point timePoint) const;
+   void insert(const uint32_t timer);
+   void unlink(const uint32_t timer);
+   void advance(const uint64_t tick, std::vector<std::string>& expired);
+   uint64_t getNextTick() const;
+   void arm();
+
+   int                                   FD;
+   std::chrono::steady_clock::time_point Origin;       // Tick 0
+   uint64_t                              CurrentTick;  // Last processed tick
+   uint64_t                              ArmedTick;    // 0 for disarmed
+   int32_t                               Heads[Levels * Slots];
+   std::vector<Timer>                    Timers;
+   std::vector<uint32_t>                 FreeTimers;
+   std::map<std::string, uint32_t>       Index;
+};
+
+#endif